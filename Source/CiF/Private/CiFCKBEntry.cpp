@@ -17,5 +17,6 @@ void UCiFCKBEntry::initTruthEntry(const FName head, const ESubjectiveLabel conne
 	mConnection = connectionType;
 	const auto truthFName = StaticEnum<ETruthLabel>()->GetNameByValue(static_cast<int64>(tail));
 	mTail = truthFName;
+	mTruthLabel = tail;
 	mType = ECKBLabelType::GENERAL_TRUTH;
 }
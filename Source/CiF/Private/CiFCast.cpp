@@ -34,6 +34,7 @@ void UCiFCast::addCharacter(UCiFCharacter* c)
 {
 	mCharacters.AddUnique(c);
 	mCharactersByName.Add(c->mObjectName, c);
+	markCharactersChanged();
 }
 
 UCiFCast* UCiFCast::loadFromJson(const TSharedPtr<FJsonObject> json, const UObject* worldContextObject)
@@ -3,11 +3,150 @@
 
 #include "CiFCulturalKnowledgeBase.h"
 #include "CiFCKBEntry.h"
+#include "Algo/Unique.h"
 
 void UCiFCulturalKnowledgeBase::findItems(const FName character,
                                           TArray<FName>& outputItems,
                                           const ESubjectiveLabel connectionType,
                                           const ETruthLabel label) const
+{
+	TArray<int32> itemIds;
+	findItemIds(character, itemIds, connectionType, label);
+	for (const auto itemId : itemIds) {
+		outputItems.Push(mItemNames[itemId]);
+	}
+}
+
+void UCiFCulturalKnowledgeBase::findItemIds(const FName character,
+                                            TArray<int32>& outItemIds,
+                                            const ESubjectiveLabel connectionType,
+                                            const ETruthLabel label) const
+{
+	const auto headItems = mItemsByHead.Find({character, connectionType});
+	const auto truthItems = mItemsByTruth.Find(label);
+	if (headItems && truthItems) {
+		intersectItemIds(*headItems, *truthItems, outItemIds);
+	}
+}
+
+const TBitArray<>& UCiFCulturalKnowledgeBase::getItemBits(const FName character,
+                                                         const ESubjectiveLabel connectionType,
+                                                         const ETruthLabel label) const
+{
+	auto& itemBits = mItemBitsCache.FindOrAdd({character, connectionType, label});
+	if (!itemBits) {
+		// all the bitsets have the same size, so they can be combined word by word
+		itemBits = MakeUnique<TBitArray<>>(false, mItemNames.Num());
+		TArray<int32> itemIds;
+		findItemIds(character, itemIds, connectionType, label);
+		for (const auto itemId : itemIds) {
+			(*itemBits)[itemId] = true;
+		}
+	}
+	return *itemBits;
+}
+
+int32 UCiFCulturalKnowledgeBase::countCommonItems(const TBitArray<>& itemBits1, const TBitArray<>& itemBits2)
+{
+	// bits past the end of the last word are always clear
+	const int32 numWords = FMath::DivideAndRoundUp(FMath::Min(itemBits1.Num(), itemBits2.Num()), NumBitsPerDWORD);
+	const uint32* words1 = itemBits1.GetData();
+	const uint32* words2 = itemBits2.GetData();
+	int32 count = 0;
+	for (int32 i = 0; i < numWords; i++) {
+		count += FMath::CountBits(words1[i] & words2[i]);
+	}
+	return count;
+}
+
+void UCiFCulturalKnowledgeBase::intersectItemIds(const TArray<int32>& itemIds1, const TArray<int32>& itemIds2, TArray<int32>& outItemIds)
+{
+	int32 i = 0;
+	int32 j = 0;
+	while (i < itemIds1.Num() && j < itemIds2.Num()) {
+		if (itemIds1[i] < itemIds2[j]) {
+			i++;
+		}
+		else if (itemIds2[j] < itemIds1[i]) {
+			j++;
+		}
+		else {
+			outItemIds.Add(itemIds1[i]);
+			i++;
+			j++;
+		}
+	}
+}
+
+void UCiFCulturalKnowledgeBase::buildIndex()
+{
+	mItemNames.Reset();
+	mItemIds.Reset();
+	mItemsByHead.Reset();
+	mItemsByTruth.Reset();
+	mItemBitsCache.Reset();
+
+	// every item is indexed under its connection and under the wildcard connection
+	for (const auto entry : mSubjectiveEntries) {
+		const int32 itemId = getItemId(entry->mTail);
+		mItemsByHead.FindOrAdd({entry->mHead, entry->mConnection}).Add(itemId);
+		mItemsByHead.FindOrAdd({entry->mHead, ESubjectiveLabel::INVALID}).Add(itemId);
+	}
+	for (const auto entry : mGeneralTruthEntries) {
+		const int32 itemId = getItemId(entry->mHead);
+		mItemsByTruth.FindOrAdd(entry->mTruthLabel).Add(itemId);
+		mItemsByTruth.FindOrAdd(ETruthLabel::INVALID).Add(itemId);
+	}
+
+	const auto makeSortedSet = [](TArray<int32>& itemIds) {
+		itemIds.Sort();
+		itemIds.SetNum(Algo::Unique(itemIds));
+	};
+	for (auto& [key, itemIds] : mItemsByHead) {
+		makeSortedSet(itemIds);
+	}
+	for (auto& [label, itemIds] : mItemsByTruth) {
+		makeSortedSet(itemIds);
+	}
+}
+
+void UCiFCulturalKnowledgeBase::addEntry(UCiFCKBEntry* entry)
+{
+	if (!entry) {
+		return;
+	}
+	if (entry->mType == ECKBLabelType::SUBJECTIVE) {
+		mSubjectiveEntries.Add(entry);
+	}
+	else if (entry->mType == ECKBLabelType::GENERAL_TRUTH) {
+		mGeneralTruthEntries.Add(entry);
+	}
+	else {
+		UE_LOG(LogTemp, Warning, TEXT("Trying to add a CKB entry without a type, head %s"), *entry->mHead.ToString());
+		return;
+	}
+	buildIndex();
+}
+
+void UCiFCulturalKnowledgeBase::removeEntry(UCiFCKBEntry* entry)
+{
+	if (mSubjectiveEntries.Remove(entry) + mGeneralTruthEntries.Remove(entry) > 0) {
+		buildIndex();
+	}
+}
+
+int32 UCiFCulturalKnowledgeBase::getItemId(const FName item)
+{
+	if (const auto itemId = mItemIds.Find(item)) {
+		return *itemId;
+	}
+	return mItemIds.Add(item, mItemNames.Add(item));
+}
+
+void UCiFCulturalKnowledgeBase::findItemsByScan(const FName character,
+                                                TArray<FName>& outputItems,
+                                                const ESubjectiveLabel connectionType,
+                                                const ETruthLabel label) const
 {
 	TArray<UCiFCKBEntry*> charAndConnectionMatches;
 	TArray<UCiFCKBEntry*> labelMatches;
@@ -47,8 +186,9 @@ void UCiFCulturalKnowledgeBase::findItems(const FName character,
 
 	for (int32 i = 0; i < charAndConnectionMatches.Num(); ++i) {
 		for (int32 j = 0; j < labelMatches.Num(); ++j) {
+			// an item is found once however many entries match it, like the indexed lookup (see getItemBits)
 			if (charAndConnectionMatches[i]->mTail == labelMatches[j]->mHead) {
-				outputItems.Push(charAndConnectionMatches[i]->mTail);
+				outputItems.AddUnique(charAndConnectionMatches[i]->mTail);
 			}
 		}
 	}
@@ -86,5 +226,6 @@ UCiFCulturalKnowledgeBase* UCiFCulturalKnowledgeBase::loadFromJson(const TShared
 		}
 	}
 
+	ckb->buildIndex();
 	return ckb;
 }
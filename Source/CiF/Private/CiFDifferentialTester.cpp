@@ -0,0 +1,122 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CiFDifferentialTester.h"
+
+#include "CiFGameObject.h"
+#include "CiFManager.h"
+#include "CiFPredicate.h"
+#include "CiFRule.h"
+#include "CiFSocialExchange.h"
+#include "CiFSocialFactsDataBase.h"
+#include "CiFTrigger.h"
+
+void UCiFDifferentialTester::init(UCiFManager* cifManager)
+{
+	mCifManager = cifManager;
+	reset();
+}
+
+void UCiFDifferentialTester::reset()
+{
+	mNumChecks = 0;
+	mNumDivergences = 0;
+	mFirstDivergence = FCiFDivergence();
+}
+
+bool UCiFDifferentialTester::isActive() const
+{
+	// evaluations made by the reference pass itself are not checked again
+	return mIsEnabled && mCifManager && !mCifManager->mIsReferenceEvaluation;
+}
+
+void UCiFDifferentialTester::checkPredicate(UCiFPredicate* pred,
+                                            const UCiFGameObject* c1,
+                                            const UCiFGameObject* c2,
+                                            const UCiFGameObject* c3,
+                                            const UCiFSocialExchange* se,
+                                            const bool optimizedResult)
+{
+	bool referenceResult;
+	{
+		TGuardValue<bool> referenceGuard(mCifManager->mIsReferenceEvaluation, true);
+		referenceResult = pred->evaluate(c1, c2, c3, se);
+	}
+	mNumChecks++;
+
+	if (referenceResult != optimizedResult) {
+		FCiFDivergence divergence;
+		pred->toString(divergence.mDescription);
+		divergence.mTuple = {c1 ? c1->mObjectName : NAME_None, c2 ? c2->mObjectName : NAME_None, c3 ? c3->mObjectName : NAME_None};
+		divergence.mReferenceResult = referenceResult;
+		divergence.mOptimizedResult = optimizedResult;
+		reportDivergence(divergence);
+	}
+}
+
+void UCiFDifferentialTester::checkPreconditionFilter(UCiFSocialExchange* se,
+                                                     UCiFCharacter* initiator,
+                                                     UCiFGameObject* responder,
+                                                     const TArray<UCiFGameObject*>& possibleOthers)
+{
+	bool referenceResult;
+	{
+		TGuardValue<bool> referenceGuard(mCifManager->mIsReferenceEvaluation, true);
+		referenceResult = se->checkPreconditionsVariableOther(initiator, responder, possibleOthers);
+	}
+	mNumChecks++;
+
+	if (referenceResult) {
+		FCiFDivergence divergence;
+		divergence.mDescription = FString::Printf(TEXT("precondition prefilter of %s"), *se->mName.ToString());
+		divergence.mTuple = {initiator->mObjectName, responder->mObjectName, NAME_None};
+		divergence.mReferenceResult = true;
+		divergence.mOptimizedResult = false;
+		reportDivergence(divergence);
+	}
+}
+
+void UCiFDifferentialTester::checkTriggerMatches(const TArray<FCiFTriggerMatch>& optimized, const TArray<FCiFTriggerMatch>& reference)
+{
+	mNumChecks++;
+
+	const auto report = [this](const FCiFTriggerMatch& match, const bool referenceResult) {
+		FCiFDivergence divergence;
+		FString condition;
+		match.mTrigger->mCondition->toString(condition);
+		divergence.mDescription = FString::Printf(TEXT("trigger %d: %s"), match.mTrigger->mId, *condition);
+		divergence.mTuple = {match.mFirst ? match.mFirst->mObjectName : NAME_None,
+		                     match.mSecond ? match.mSecond->mObjectName : NAME_None,
+		                     match.mThird ? match.mThird->mObjectName : NAME_None};
+		divergence.mReferenceResult = referenceResult;
+		divergence.mOptimizedResult = !referenceResult;
+		reportDivergence(divergence);
+	};
+
+	for (const auto& match : optimized) {
+		if (!reference.Contains(match)) {
+			report(match, false);
+		}
+	}
+	for (const auto& match : reference) {
+		if (!optimized.Contains(match)) {
+			report(match, true);
+		}
+	}
+}
+
+void UCiFDifferentialTester::reportDivergence(const FCiFDivergence& divergence)
+{
+	mNumDivergences++;
+	if (mNumDivergences > 1) {
+		return;
+	}
+
+	mFirstDivergence = divergence;
+	mFirstDivergence.mTurn = mCifManager->mTime;
+	UE_LOG(LogTemp, Error, TEXT("Differential test diverged at turn %d: %s on (%s, %s, %s) is %s in reference and %s optimized"),
+	       mFirstDivergence.mTurn, *divergence.mDescription,
+	       *divergence.mTuple[0].ToString(), *divergence.mTuple[1].ToString(), *divergence.mTuple[2].ToString(),
+	       divergence.mReferenceResult ? TEXT("true") : TEXT("false"),
+	       divergence.mOptimizedResult ? TEXT("true") : TEXT("false"));
+}
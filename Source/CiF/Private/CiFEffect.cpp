@@ -160,6 +160,16 @@ bool UCiFEffect::isRoleRequired(const FName role) const
 	return mCondition->isRoleRequired(role) || mChange->isRoleRequired(role);
 }
 
+bool UCiFEffect::isResponderRequired() const
+{
+	return mCondition->isResponderRequired() || mChange->isResponderRequired();
+}
+
+bool UCiFEffect::isOtherRequired() const
+{
+	return mCondition->isOtherRequired() || mChange->isOtherRequired();
+}
+
 UCiFPredicate* UCiFEffect::getCKBReferencePredicate() const
 {
 	for (const auto p : mCondition->mPredicates) {
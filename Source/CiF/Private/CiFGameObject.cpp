@@ -4,6 +4,9 @@
 #include "CiFGameObject.h"
 
 #include "CiFGameObjectStatus.h"
+#include "CiFJournal.h"
+#include "CiFSessionRecorder.h"
+#include "CiFSocialStateDiff.h"
 
 // Sets default values for this component's properties
 UCiFGameObject::UCiFGameObject()
@@ -42,6 +45,22 @@ bool UCiFGameObject::hasStatus(const EStatus statusType, const UCiFGameObject* t
 
 void UCiFGameObject::addStatus(const EStatus statusType, const int32 duration, const FName towards)
 {
+	// nested calls (category expansion, expired statuses) are reproduced by replaying this one
+	FCiFJournalScope journalScope;
+	FCiFSessionCallScope sessionScope(UCiFSessionRecorder::mActiveRecorder);
+	if (sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::ADD_STATUS;
+		event.mInitiator = mObjectName;
+		event.mResponder = towards;
+		event.mEnumValue = static_cast<uint8>(statusType);
+		event.mValue = duration;
+		UCiFSessionRecorder::mActiveRecorder->recordEvent(event);
+	}
+	if (const auto journal = UCiFJournal::getActiveJournal()) {
+		journal->logAddStatus(mObjectName, statusType, duration, towards);
+	}
+
 	// if the type of the status is category
 	if (statusType < EStatus::FIRST_NOT_DIRECTED_STATUS) {
 		// apply all statuses in that category
@@ -69,6 +88,9 @@ void UCiFGameObject::addStatus(const EStatus statusType, const int32 duration, c
 				statusArrayWrapper.statusArray.Add(newStatus);
 				mStatuses.Add(statusType, statusArrayWrapper);
 			}
+			if (const auto diff = FCiFSocialStateDiff::getActiveDiff()) {
+				diff->recordStatusAdded(this, statusType, newStatus);
+			}
 
 			// setup the partner status if it has a partner and the status reciprocal - for now not sure about
 			// which types are reciprocal, TODO maybe implement later
@@ -83,7 +105,12 @@ void UCiFGameObject::addStatus(const EStatus statusType, const int32 duration, c
 	if (status) {
 		// if this object already has the status and also has duration, update the duration
 		if (status->mHasDuration && duration > 0) {
+			const auto diff = FCiFSocialStateDiff::getActiveDiff();
+			const auto previous = diff ? FCiFStatusRecord::make(statusType, status) : FCiFStatusRecord();
 			status->setDuration(duration);
+			if (diff) {
+				diff->recordStatusUpdated(this, previous, status);
+			}
 		}
 	}
 	else {
@@ -99,6 +126,9 @@ void UCiFGameObject::addStatus(const EStatus statusType, const int32 duration, c
 			statusArrayWrapper.statusArray.Add(newStatus);
 			mStatuses.Add(statusType, statusArrayWrapper);
 		}
+		if (const auto diff = FCiFSocialStateDiff::getActiveDiff()) {
+			diff->recordStatusAdded(this, statusType, newStatus);
+		}
 
 		// TODO --	if this is a reciprocal status, like dating, i think it is also
 		//			needed to call towards->addStatus(statusType, duration, this)
@@ -114,10 +144,27 @@ void UCiFGameObject::addStatus(const EStatus statusType, const int32 duration, c
 
 void UCiFGameObject::removeStatus(const EStatus statusType, const FName towards)
 {
+	FCiFJournalScope journalScope;
+	FCiFSessionCallScope sessionScope(UCiFSessionRecorder::mActiveRecorder);
+	if (sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::REMOVE_STATUS;
+		event.mInitiator = mObjectName;
+		event.mResponder = towards;
+		event.mEnumValue = static_cast<uint8>(statusType);
+		UCiFSessionRecorder::mActiveRecorder->recordEvent(event);
+	}
+	if (const auto journal = UCiFJournal::getActiveJournal()) {
+		journal->logRemoveStatus(mObjectName, statusType, towards);
+	}
+
 	auto statusArrWrapper = mStatuses.Find(statusType);
 	if (statusArrWrapper) {
 		for (int32 i = statusArrWrapper->statusArray.Num() - 1; i >= 0; i--) {
 			if (statusArrWrapper->statusArray[i]->mDirectedTowards == towards) {
+				if (const auto diff = FCiFSocialStateDiff::getActiveDiff()) {
+					diff->recordStatusRemoved(this, statusType, statusArrWrapper->statusArray[i]);
+				}
 				statusArrWrapper->statusArray.RemoveAt(i);
 				break;
 			}
@@ -131,10 +178,33 @@ void UCiFGameObject::removeStatus(const EStatus statusType, const FName towards)
 
 void UCiFGameObject::updateStatusDurations(const int32 timeElapsed)
 {
+	FCiFJournalScope journalScope;
+	FCiFSessionCallScope sessionScope(UCiFSessionRecorder::mActiveRecorder);
+	if (sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::UPDATE_STATUS_DURATIONS;
+		event.mInitiator = mObjectName;
+		event.mValue = timeElapsed;
+		UCiFSessionRecorder::mActiveRecorder->recordEvent(event);
+	}
+	// journaled before the removals of the statuses that run out, which are journaled by removeStatus
+	if (const auto journal = UCiFJournal::getActiveJournal()) {
+		journal->logUpdateStatusDurations(mObjectName, timeElapsed);
+	}
+
 	for (auto it = mStatuses.CreateIterator(); it; ++it) {
 		// loop backwards through the array to remove status to not mess with indices while passing over the array
 		for (int32 i = it.Value().statusArray.Num() - 1; i >= 0; i--) {
-			if (it.Value().statusArray[i]->updateRemainingDuration(timeElapsed) <= 0) {
+			const auto status = it.Value().statusArray[i];
+			if (const auto diff = FCiFSocialStateDiff::getActiveDiff()) {
+				const auto previous = FCiFStatusRecord::make(it.Key(), status);
+				status->updateRemainingDuration(timeElapsed);
+				diff->recordStatusUpdated(this, previous, status);
+			}
+			else {
+				status->updateRemainingDuration(timeElapsed);
+			}
+			if (status->mRemainingDuration <= 0) {
 				removeStatus(it.Key(), it.Value().statusArray[i]->mDirectedTowards);
 			}
 		}
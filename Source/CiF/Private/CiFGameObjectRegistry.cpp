@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CiFGameObjectRegistry.h"
+
+#include "CiFCharacter.h"
+#include "CiFItem.h"
+#include "CiFKnowledge.h"
+
+void FCiFGameObjectRegistry::build(const TArray<UCiFCharacter*>& characters, const TArray<UCiFItem*>& items, const TArray<UCiFKnowledge*>& knowledge, const uint32 version)
+{
+	reset();
+	mObjectsByHandle.Reserve(characters.Num() + items.Num() + knowledge.Num());
+	mHandles.Reserve(characters.Num() + items.Num() + knowledge.Num());
+	update(characters, items, knowledge, version);
+}
+
+void FCiFGameObjectRegistry::update(const TArray<UCiFCharacter*>& characters, const TArray<UCiFItem*>& items, const TArray<UCiFKnowledge*>& knowledge, const uint32 version)
+{
+	TSet<const UCiFGameObject*> sourceObjects;
+	sourceObjects.Append(characters);
+	sourceObjects.Append(items);
+	sourceObjects.Append(knowledge);
+
+	// iterated backwards, removing keeps the order of the objects before
+	for (int32 i = mObjects.Num() - 1; i >= 0; i--) {
+		if (!sourceObjects.Contains(mObjects[i])) {
+			remove(mObjects[i]);
+		}
+	}
+
+	for (const auto go : characters) {
+		add(go);
+	}
+	for (const auto go : items) {
+		add(go);
+	}
+	for (const auto go : knowledge) {
+		add(go);
+	}
+	mNumSourceObjects = characters.Num() + items.Num() + knowledge.Num();
+	mSourceVersion = version;
+}
+
+void FCiFGameObjectRegistry::reset()
+{
+	for (const auto go : mObjects) {
+		go->mHandle = INVALID_HANDLE;
+	}
+	mObjectsByHandle.Reset();
+	mObjects.Reset();
+	for (auto& objects : mObjectsByType) {
+		objects.Reset();
+	}
+	mHandles.Reset();
+	mNumSourceObjects = INDEX_NONE;
+}
+
+void FCiFGameObjectRegistry::add(UCiFGameObject* go)
+{
+	if (getObject(go->mHandle) == go) {
+		return;
+	}
+	if (mHandles.Contains(go->mObjectName)) {
+		// the first one is the one the name lookups found so far
+		UE_LOG(LogTemp, Warning, TEXT("Game object name '%s' is used by more than one game object"), *go->mObjectName.ToString());
+		return;
+	}
+
+	go->mHandle = mObjectsByHandle.Add(go);
+	mObjects.Add(go);
+	mObjectsByType[static_cast<int32>(go->mGameObjectType)].Add(go);
+	mHandles.Add(go->mObjectName, go->mHandle);
+}
+
+void FCiFGameObjectRegistry::remove(UCiFGameObject* go)
+{
+	mObjectsByHandle[go->mHandle] = nullptr;
+	mObjects.RemoveSingle(go);
+	mObjectsByType[static_cast<int32>(go->mGameObjectType)].RemoveSingle(go);
+	mHandles.Remove(go->mObjectName);
+	go->mHandle = INVALID_HANDLE;
+}
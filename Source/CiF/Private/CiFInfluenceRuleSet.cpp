@@ -19,12 +19,16 @@ float UCiFInfluenceRuleSet::scoreRules(UCiFCharacter* initiator,
                                        bool isResponder)
 {
 	int8 score = 0;
-	UE_LOG(LogTemp, Log, TEXT("START, %s, %s, %s, %s"), *(se->mName.ToString()), *(initiator->mObjectName.ToString()), *(responder->mObjectName.ToString()), *(other->mObjectName.ToString()));
+	if (UCiFManager::mIsTraceLogging) {
+		UE_LOG(LogTemp, Log, TEXT("START, %s, %s, %s, %s"), *(se->mName.ToString()), *(initiator->mObjectName.ToString()), *(responder->mObjectName.ToString()), *(other->mObjectName.ToString()));
+	}
 	
 	for (auto ir : mInfluenceRules) {
-		UE_LOG(LogTemp, Log, TEXT("ir %s, %d"), *(ir->mPredicates[0]->mName.ToString()), ir->mWeight);
+		if (UCiFManager::mIsTraceLogging) {
+			UE_LOG(LogTemp, Log, TEXT("ir %s, %d"), *(ir->mPredicates[0]->mName.ToString()), ir->mWeight);
+		}
 		if (ir->mWeight != 0) {
-			if (ir->isRoleRequired("other")) {
+			if (ir->isOtherRequired()) {
 				if (!other) {
 					UE_LOG(LogTemp, Error, TEXT("No other was passed in while needed"));
 					return 0;
@@ -83,7 +87,9 @@ float UCiFInfluenceRuleSet::scoreRules(UCiFCharacter* initiator,
 			}
 		}
 	}
-	UE_LOG(LogTemp, Log, TEXT("END, %d"), score);
+	if (UCiFManager::mIsTraceLogging) {
+		UE_LOG(LogTemp, Log, TEXT("END, %d"), score);
+	}
 
 	return score;
 }
@@ -113,7 +119,7 @@ float UCiFInfluenceRuleSet::scoreRulesWithVariableOther(UCiFCharacter* initiator
 	
 	for (auto ir : mInfluenceRules) {
 		if (ir->mWeight != 0) {
-			if (ir->isRoleRequired("other")) {
+			if (ir->isOtherRequired()) {
 				for (auto o : possibleOthers) {
 					if ((o->mObjectName != initiator->mObjectName) && (o->mObjectName != responder->mObjectName)) {
 						if (ir->evaluate(initiator, responder, other, se)) {
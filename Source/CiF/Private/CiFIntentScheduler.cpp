@@ -0,0 +1,205 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CiFIntentScheduler.h"
+
+#include "CiFCast.h"
+#include "CiFCharacter.h"
+#include "CiFManager.h"
+#include "CiFSessionRecorder.h"
+#include "CiFSocialExchange.h"
+#include "CiFSocialExchangesLibrary.h"
+
+void UCiFIntentScheduler::init(UCiFManager* cifManager)
+{
+	mCifManager = cifManager;
+}
+
+void UCiFIntentScheduler::startPass()
+{
+	checkf(mCifManager != nullptr, TEXT("Intent scheduler wasn't initialized with a CiF manager"));
+
+	// the pass is recorded as its start and its slices, so a replay interleaves them with the other calls as they were
+	FCiFSessionCallScope sessionScope(mCifManager->mSessionRecorder);
+	if (sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::INTENT_PASS_START;
+		event.mTime = mCifManager->mTime;
+		event.mValue = mExchangesPerWorkItem;
+		mCifManager->mSessionRecorder->recordEvent(event);
+	}
+
+	mCharacters = mCifManager->mCast->mCharacters;
+	mPossibleOthers = static_cast<TArray<UCiFGameObject*>>(mCharacters);
+	mNumExchanges = mCifManager->mSocialExchangesLib->num();
+
+	mIsInitiatorDone.Init(false, mCharacters.Num());
+	mInitiatorIndex = 0;
+	mResponderIndex = 0;
+	mExchangeIndex = 0;
+	mIsInitiatorStarted = false;
+
+	mProcessedExchanges = 0;
+	const int32 numCharacters = mCharacters.Num();
+	mTotalExchanges = numCharacters * FMath::Max(numCharacters - 1, 0) * mNumExchanges;
+
+	mIsRunning = true;
+
+	if (numCharacters == 0) {
+		UE_LOG(LogTemp, Warning, TEXT("No characters to form intents for"));
+		mIsRunning = false;
+		OnIntentFormationCompleted.Broadcast();
+	}
+}
+
+void UCiFIntentScheduler::cancelPass()
+{
+	FCiFSessionCallScope sessionScope(mCifManager->mSessionRecorder);
+	if (mIsRunning && sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::INTENT_PASS_CANCEL;
+		event.mTime = mCifManager->mTime;
+		mCifManager->mSessionRecorder->recordEvent(event);
+	}
+	mIsRunning = false;
+}
+
+bool UCiFIntentScheduler::runForBudget(const float budgetMs)
+{
+	if (!mIsRunning) {
+		return true;
+	}
+
+	FCiFSessionCallScope sessionScope(mCifManager->mSessionRecorder);
+	const double endTime = FPlatformTime::Seconds() + budgetMs / 1000.0;
+	int32 numWorkItems = 0;
+	do {
+		numWorkItems++;
+		if (!runWorkItem()) {
+			break;
+		}
+	} while (FPlatformTime::Seconds() < endTime);
+
+	endSlice(sessionScope, numWorkItems);
+	return !mIsRunning;
+}
+
+bool UCiFIntentScheduler::runWorkItems(const int32 numWorkItems)
+{
+	if (!mIsRunning) {
+		return true;
+	}
+
+	FCiFSessionCallScope sessionScope(mCifManager->mSessionRecorder);
+	int32 numRun = 0;
+	while (numRun < numWorkItems) {
+		numRun++;
+		if (!runWorkItem()) {
+			break;
+		}
+	}
+
+	endSlice(sessionScope, numRun);
+	return !mIsRunning;
+}
+
+void UCiFIntentScheduler::endSlice(const FCiFSessionCallScope& sessionScope, const int32 numWorkItems)
+{
+	if (numWorkItems > 0 && sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::INTENT_PASS_SLICE;
+		event.mTime = mCifManager->mTime;
+		event.mValue = numWorkItems;
+		mCifManager->mSessionRecorder->recordEvent(event);
+	}
+
+	if (mIsRunning) {
+		OnIntentFormationProgress.Broadcast(getProgress());
+	}
+}
+
+bool UCiFIntentScheduler::runWorkItem()
+{
+	checkf(IsInGameThread(), TEXT("Intent formation makes UObjects, it can only run on the game thread"));
+	const int32 exchangesPerItem = FMath::Max(mExchangesPerWorkItem, 1);
+	const auto initiator = mCharacters[mInitiatorIndex];
+	if (!mIsInitiatorStarted) {
+		// the previous pass's memory is kept until the initiator actually gets its turn
+		initiator->resetProspectiveMemory();
+		mIsInitiatorStarted = true;
+	}
+
+	const auto responder = mCharacters[mResponderIndex];
+	if (responder != initiator) {
+		const int32 chunkEnd = FMath::Min(mExchangeIndex + exchangesPerItem, mNumExchanges);
+		mCifManager->formIntentForSocialExchangeRange(initiator, responder, mPossibleOthers, mExchangeIndex, chunkEnd);
+		mProcessedExchanges += chunkEnd - mExchangeIndex;
+		mExchangeIndex = chunkEnd;
+	}
+	else {
+		mExchangeIndex = mNumExchanges;
+	}
+
+	if (!advanceCursor()) {
+		mIsRunning = false;
+		OnIntentFormationProgress.Broadcast(1.f);
+		OnIntentFormationCompleted.Broadcast();
+		return false;
+	}
+
+	return true;
+}
+
+bool UCiFIntentScheduler::isIntentFormedFor(const UCiFCharacter* character) const
+{
+	const int32 index = mCharacters.IndexOfByKey(character);
+	return index != INDEX_NONE && mIsInitiatorDone[index];
+}
+
+float UCiFIntentScheduler::getProgress() const
+{
+	if (mTotalExchanges == 0) {
+		return mIsRunning ? 0.f : 1.f;
+	}
+	return static_cast<float>(mProcessedExchanges) / mTotalExchanges;
+}
+
+void UCiFIntentScheduler::Tick(float DeltaTime)
+{
+	runForBudget(mFrameBudgetMs);
+}
+
+bool UCiFIntentScheduler::IsTickable() const
+{
+	return mIsRunning && !HasAnyFlags(RF_ClassDefaultObject);
+}
+
+TStatId UCiFIntentScheduler::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UCiFIntentScheduler, STATGROUP_Tickables);
+}
+
+bool UCiFIntentScheduler::advanceCursor()
+{
+	if (mExchangeIndex < mNumExchanges) {
+		return true;
+	}
+
+	mExchangeIndex = 0;
+	mResponderIndex++;
+	if (mResponderIndex < mCharacters.Num()) {
+		return true;
+	}
+
+	finishInitiator();
+	mResponderIndex = 0;
+	mInitiatorIndex++;
+	mIsInitiatorStarted = false;
+	return mInitiatorIndex < mCharacters.Num();
+}
+
+void UCiFIntentScheduler::finishInitiator()
+{
+	mIsInitiatorDone[mInitiatorIndex] = true;
+	OnCharacterIntentFormed.Broadcast(mCharacters[mInitiatorIndex]);
+}
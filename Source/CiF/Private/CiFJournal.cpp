@@ -0,0 +1,324 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CiFJournal.h"
+
+#include "CiFEffect.h"
+#include "CiFGameObject.h"
+#include "CiFGameObjectStatus.h"
+#include "CiFManager.h"
+#include "CiFRelationshipNetwork.h"
+#include "CiFSessionRecorder.h"
+#include "CiFSocialExchange.h"
+#include "CiFSocialExchangesLibrary.h"
+#include "CiFSocialFactsDataBase.h"
+#include "CiFSocialNetwork.h"
+#include "WriteAheadLog.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+	/* Appends a change with its arguments to the changes of the current call */
+	template <typename... ArgTypes>
+	void writeChange(TArray<uint8>& changes, ECiFJournalOp op, ArgTypes... args)
+	{
+		FMemoryWriter writer(changes, false, true);
+		writer << op;
+		(writer << ... << args);
+	}
+}
+
+UCiFJournal::UCiFJournal()
+	: mLog(MakeUnique<FWriteAheadLog>()) {}
+
+// defined here, where the write-ahead log is a complete type
+UCiFJournal::~UCiFJournal() = default;
+
+void UCiFJournal::init(UCiFManager* cifManager)
+{
+	mCifManager = cifManager;
+}
+
+bool UCiFJournal::start(const FString& filePath)
+{
+	checkf(mCifManager != nullptr, TEXT("Journal wasn't initialized with a CiF manager"));
+	if (mActiveJournal && mActiveJournal != this) {
+		UE_LOG(LogTemp, Warning, TEXT("Another journal is already journaling, stopping it"));
+		mActiveJournal->stop();
+	}
+
+	TArray<uint8> checkpointData;
+	writeCheckpoint(checkpointData);
+	if (!mLog->open(filePath, checkpointData)) {
+		return false;
+	}
+
+	mChanges.Reset();
+	mCheckpointTime = mCifManager->mTime;
+	mActiveJournal = this;
+	return true;
+}
+
+void UCiFJournal::stop()
+{
+	mLog->close();
+	mChanges.Reset();
+	mIsCheckpointRequested = false;
+	if (mActiveJournal == this) {
+		mActiveJournal = nullptr;
+	}
+}
+
+bool UCiFJournal::isJournaling() const
+{
+	return mLog && mLog->isOpen();
+}
+
+bool UCiFJournal::checkpoint()
+{
+	if (!isJournaling() || mIsSuspended) {
+		return false;
+	}
+
+	// the checkpoint already has the changes that weren't committed yet
+	TArray<uint8> checkpointData;
+	writeCheckpoint(checkpointData);
+	mChanges.Reset();
+	mIsCheckpointRequested = false;
+	if (!mLog->checkpoint(checkpointData)) {
+		UE_LOG(LogTemp, Error, TEXT("Stopped journaling the social state, the checkpoint couldn't be written"));
+		stop();
+		return false;
+	}
+
+	mCheckpointTime = mCifManager->mTime;
+	return true;
+}
+
+void UCiFJournal::requestCheckpoint()
+{
+	if (isJournaling() && !mIsSuspended) {
+		mIsCheckpointRequested = true;
+	}
+}
+
+void UCiFJournal::endCall()
+{
+	if (--mCallDepth > 0 || mChanges.IsEmpty() || !isJournaling()) {
+		return;
+	}
+
+	// the changes were made on a state the log doesn't have, the checkpoint has them instead
+	if (mIsCheckpointRequested) {
+		checkpoint();
+		return;
+	}
+
+	mLog->append(mChanges);
+	mChanges.Reset();
+	if (!mLog->commit()) {
+		// a missing call would make every change after it replay on the wrong state
+		UE_LOG(LogTemp, Error, TEXT("Stopped journaling the social state, changes couldn't be committed"));
+		stop();
+		return;
+	}
+
+	if (mCheckpointInterval > 0 && mCifManager->mTime - mCheckpointTime >= mCheckpointInterval) {
+		checkpoint();
+	}
+}
+
+bool UCiFJournal::recover(const FString& filePath)
+{
+	checkf(mCifManager != nullptr, TEXT("Journal wasn't initialized with a CiF manager"));
+	stop();
+
+	TArray<uint8> checkpointData;
+	TArray<TArray<uint8>> records;
+	if (!FWriteAheadLog::read(filePath, checkpointData, records)) {
+		return false;
+	}
+
+	{
+		// the replay calls the same functions the game does, they must not be recorded again
+		FCiFSessionCallScope sessionScope(mCifManager->mSessionRecorder);
+		if (!readCheckpoint(checkpointData)) {
+			return false;
+		}
+		for (const auto& record : records) {
+			replayChanges(record);
+		}
+	}
+	mCifManager->commitState();
+
+	UE_LOG(LogTemp, Log, TEXT("Recovered the social state at time %d from %s, replayed %d journaled calls"),
+	       mCifManager->mTime, *filePath, records.Num());
+
+	// journaling continues with a checkpoint of the recovered state
+	return start(filePath);
+}
+
+void UCiFJournal::BeginDestroy()
+{
+	stop();
+	Super::BeginDestroy();
+}
+
+/******************************** Changes ********************************/
+
+void UCiFJournal::logNetworkWeight(const ESocialNetworkType type, const uint8 c1, const uint8 c2, const uint8 weight)
+{
+	writeChange(mChanges, ECiFJournalOp::NETWORK_WEIGHT, type, c1, c2, weight);
+}
+
+void UCiFJournal::logAddStatus(const FName object, const EStatus statusType, const int32 duration, const FName towards)
+{
+	writeChange(mChanges, ECiFJournalOp::ADD_STATUS, object, statusType, duration, towards);
+}
+
+void UCiFJournal::logRemoveStatus(const FName object, const EStatus statusType, const FName towards)
+{
+	writeChange(mChanges, ECiFJournalOp::REMOVE_STATUS, object, statusType, towards);
+}
+
+void UCiFJournal::logUpdateStatusDurations(const FName object, const int32 timeElapsed)
+{
+	writeChange(mChanges, ECiFJournalOp::UPDATE_STATUS_DURATIONS, object, timeElapsed);
+}
+
+void UCiFJournal::logStatusDuration(const FName object, const EStatus statusType, const FName towards, const int32 remainingDuration)
+{
+	writeChange(mChanges, ECiFJournalOp::STATUS_DURATION, object, statusType, towards, remainingDuration);
+}
+
+void UCiFJournal::logSFDBRecord(const UCiFSocialFactsDataBase* sfdb, const FCiFSFDBRecord& record)
+{
+	writeChange(mChanges, ECiFJournalOp::SFDB_RECORD);
+	FMemoryWriter writer(mChanges, false, true);
+	sfdb->writeRecord(writer, record);
+}
+
+void UCiFJournal::logEffectSeen(const FName socialExchange, const IdType effectId, const int32 time)
+{
+	writeChange(mChanges, ECiFJournalOp::EFFECT_SEEN, socialExchange, effectId, time);
+}
+
+void UCiFJournal::logTime(const int32 time)
+{
+	writeChange(mChanges, ECiFJournalOp::TIME, time);
+}
+
+void UCiFJournal::replayChanges(const TArray<uint8>& changes)
+{
+	FMemoryReader reader(changes);
+	while (!reader.AtEnd() && !reader.IsError()) {
+		ECiFJournalOp op;
+		reader << op;
+
+		switch (op) {
+			case ECiFJournalOp::NETWORK_WEIGHT:
+				{
+					ESocialNetworkType type;
+					uint8 c1, c2, weight;
+					reader << type << c1 << c2 << weight;
+					UCiFSocialNetwork* network = type == ESocialNetworkType::RELATIONSHIP ?
+						                             mCifManager->mRelationshipNetworks :
+						                             mCifManager->getSocialNetworkByType(type);
+					if (network) {
+						network->setWeight(c1, c2, weight);
+					}
+					break;
+				}
+			case ECiFJournalOp::ADD_STATUS:
+				{
+					FName object, towards;
+					EStatus statusType;
+					int32 duration;
+					reader << object << statusType << duration << towards;
+					if (const auto go = mCifManager->getGameObjectByName(object)) {
+						go->addStatus(statusType, duration, towards);
+					}
+					break;
+				}
+			case ECiFJournalOp::REMOVE_STATUS:
+				{
+					FName object, towards;
+					EStatus statusType;
+					reader << object << statusType << towards;
+					if (const auto go = mCifManager->getGameObjectByName(object)) {
+						go->removeStatus(statusType, towards);
+					}
+					break;
+				}
+			case ECiFJournalOp::UPDATE_STATUS_DURATIONS:
+				{
+					FName object;
+					int32 timeElapsed;
+					reader << object << timeElapsed;
+					// the statuses that ran out are removed by the changes journaled right after this one
+					if (const auto go = mCifManager->getGameObjectByName(object)) {
+						for (const auto& [statusType, statusArrWrapper] : go->mStatuses) {
+							for (const auto status : statusArrWrapper.statusArray) {
+								status->updateRemainingDuration(timeElapsed);
+							}
+						}
+					}
+					break;
+				}
+			case ECiFJournalOp::STATUS_DURATION:
+				{
+					FName object, towards;
+					EStatus statusType;
+					int32 remainingDuration;
+					reader << object << statusType << towards << remainingDuration;
+					const auto go = mCifManager->getGameObjectByName(object);
+					if (const auto status = go ? go->getStatus(statusType, towards) : nullptr) {
+						status->mRemainingDuration = remainingDuration;
+					}
+					break;
+				}
+			case ECiFJournalOp::SFDB_RECORD:
+				mCifManager->mSFDB->readRecord(reader);
+				break;
+			case ECiFJournalOp::EFFECT_SEEN:
+				{
+					FName socialExchange;
+					IdType effectId;
+					int32 time;
+					reader << socialExchange << effectId << time;
+					const auto sg = mCifManager->mSocialExchangesLib->getSocialExchangeByName(socialExchange);
+					if (const auto effect = sg ? sg->getEffectById(effectId) : nullptr) {
+						effect->mLastSeenTime = time;
+					}
+					break;
+				}
+			case ECiFJournalOp::TIME:
+				{
+					int32 time;
+					reader << time;
+					mCifManager->mTime = time;
+					// compaction runs whenever the time advances, and depends on the history and the turns that can be undone
+					mCifManager->mSFDB->compactHistory(mCifManager->getEarliestRestorableTime());
+					break;
+				}
+			default:
+				UE_LOG(LogTemp, Error, TEXT("Unknown journaled change %d, the rest of the journaled call is skipped"), static_cast<uint8>(op));
+				return;
+		}
+	}
+}
+
+/******************************** Checkpoints ********************************/
+
+void UCiFJournal::writeCheckpoint(TArray<uint8>& outCheckpoint) const
+{
+	FMemoryWriter writer(outCheckpoint);
+	mCifManager->serializeState(writer);
+}
+
+bool UCiFJournal::readCheckpoint(const TArray<uint8>& checkpointData)
+{
+	FMemoryReader reader(checkpointData);
+	return mCifManager->serializeState(reader);
+}
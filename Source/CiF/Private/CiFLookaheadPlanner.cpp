@@ -0,0 +1,254 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CiFLookaheadPlanner.h"
+
+#include "CiFCast.h"
+#include "CiFCharacter.h"
+#include "CiFEffect.h"
+#include "CiFInfluenceRule.h"
+#include "CiFInfluenceRuleSet.h"
+#include "CiFJournal.h"
+#include "CiFManager.h"
+#include "CiFMicrotheory.h"
+#include "CiFPredicate.h"
+#include "CiFProspectiveMemory.h"
+#include "CiFRule.h"
+#include "CiFSessionRecorder.h"
+#include "CiFSocialExchange.h"
+#include "CiFSocialExchangeContext.h"
+#include "CiFSocialExchangesLibrary.h"
+#include "CiFSocialFactsDataBase.h"
+#include "CiFSocialStateDiff.h"
+#include "CiFTrigger.h"
+
+namespace
+{
+	/**
+	 * What scoring the responder leaves behind in a rollout - the rule records in its prospective memory and the last
+	 * scores of the exchange's responder rule set. Scoring only appends to these, so their lengths are enough to restore them
+	 */
+	struct FRolloutScoringMarks
+	{
+		FRolloutScoringMarks(const UCiFSocialExchange* se, const UCiFCharacter* responder)
+			: mRuleSet(se->mResponderIR),
+			  mMemory(responder->mProspectiveMemory),
+			  mNumRuleRecords(mMemory->mResponseSeRuleRecords.Num()),
+			  mNumLastScores(mRuleSet->mLastScore.Num()),
+			  mNumLastTruthValues(mRuleSet->mLastTruthValues.Num()),
+			  mTruthCount(mRuleSet->mTruthCount) {}
+
+		void restore() const
+		{
+			mMemory->mResponseSeRuleRecords.SetNum(mNumRuleRecords);
+			mRuleSet->mLastScore.SetNum(mNumLastScores);
+			mRuleSet->mLastTruthValues.SetNum(mNumLastTruthValues);
+			mRuleSet->mTruthCount = mTruthCount;
+		}
+
+		UCiFInfluenceRuleSet* mRuleSet;
+		UCiFProspectiveMemory* mMemory;
+		int32 mNumRuleRecords;
+		int32 mNumLastScores;
+		int32 mNumLastTruthValues;
+		int32 mTruthCount;
+	};
+
+	/* @return The sum of the increases of the goal network in a change rule */
+	int32 getGoalIncrease(const UCiFRule* change, const ESocialNetworkType goalNetworkType)
+	{
+		int32 increase = 0;
+		for (const auto p : change->mPredicates) {
+			if (p->mType == EPredicateType::NETWORK && p->mNetworkType == goalNetworkType &&
+				p->mComparatorType == EComparatorType::INCREASE) {
+				increase += p->mNetworkValue;
+			}
+		}
+		return increase;
+	}
+}
+
+void UCiFLookaheadPlanner::init(UCiFManager* cifManager)
+{
+	mCifManager = cifManager;
+	mIsBoundsValid = false;
+}
+
+bool UCiFLookaheadPlanner::planBestMove(UCiFCharacter* npc, const FCiFSocialGoal& goal, FCiFPlannedMove& outMove)
+{
+	checkf(mCifManager != nullptr, TEXT("Lookahead planner wasn't initialized with a CiF manager"));
+
+	const auto target = mCifManager->getGameObjectByName(goal.mTarget);
+	if (!npc || !target || target->mGameObjectType != ECiFGameObjectType::CHARACTER) {
+		UE_LOG(LogTemp, Error, TEXT("Lookahead planner needs an NPC and a character target"));
+		return false;
+	}
+
+	if (!mIsBoundsValid || mBoundsNetworkType != goal.mNetworkType) {
+		computeBounds(goal.mNetworkType);
+	}
+
+	mGoal = goal;
+	mExpandedNodes = 0;
+
+	// the search plays moves on the live state, nobody outside should be notified about them or record them
+	FCiFSessionCallScope sessionScope(mCifManager->mSessionRecorder);
+	const bool wasNotifying = mCifManager->mIsNotifyingChanges;
+	const auto lastResponderOther = mCifManager->mLastResponderOther;
+	mCifManager->mIsNotifyingChanges = false;
+	// folded history can't be restored, so the forks of the search must not compact it
+	TGuardValue<bool> compactionGuard(mCifManager->mSFDB->mIsCompactionSuspended, true);
+	// the rollouts are undone, so they aren't journaled or tracked by diffs either
+	TGuardValue<bool> journalGuard(mCifManager->mJournal->mIsSuspended, true);
+	TGuardValue<FCiFSocialStateDiff*> diffGuard(FCiFSocialStateDiff::mActiveDiff, nullptr);
+
+	outMove = FCiFPlannedMove();
+	search(npc, target, FMath::Clamp(mDepth, 1, 3), MIN_int32, &outMove);
+	outMove.mExpandedNodes = mExpandedNodes;
+
+	mCifManager->mIsNotifyingChanges = wasNotifying;
+	mCifManager->mLastResponderOther = lastResponderOther;
+
+	UE_LOG(LogTemp, Log, TEXT("Lookahead for %s: %s with %s (goal value %d, %d nodes)"),
+	       *(npc->mObjectName.ToString()), *(outMove.mSocialExchangeName.ToString()),
+	       *(outMove.mResponderName.ToString()), outMove.mGoalValue, mExpandedNodes);
+
+	return !outMove.mSocialExchangeName.IsNone();
+}
+
+void UCiFLookaheadPlanner::computeBounds(const ESocialNetworkType goalNetworkType)
+{
+	mBounds.Reset();
+
+	// microtheories are scored on top of the exchange's own rules, so their best case is added to every exchange
+	float maxMicrotheoriesVolition = 0;
+	for (const auto [name, mt] : mCifManager->mMicrotheoriesLib) {
+		for (const auto ir : mt->mInitiatorIR->mInfluenceRules) {
+			maxMicrotheoriesVolition += FMath::Max<int8>(ir->mWeight, 0);
+		}
+	}
+
+	// triggers run after every move, each of them can raise the goal edge once per binding that fires
+	int32 triggersIncrease = 0;
+	for (const auto trigger : mCifManager->mSFDB->mTriggers) {
+		triggersIncrease += getGoalIncrease(trigger->mChange, goalNetworkType);
+	}
+
+	const auto socialExchangesLib = mCifManager->mSocialExchangesLib;
+	for (int32 i = 0; i < socialExchangesLib->num(); i++) {
+		if (socialExchangesLib->getDescriptor(i).mResponderType != ECiFGameObjectType::CHARACTER) {
+			continue;
+		}
+		const auto se = socialExchangesLib->getSocialExchange(i);
+
+		FExchangeBounds bounds;
+		bounds.mExchange = se;
+		bounds.mMaxInitiatorVolition = maxMicrotheoriesVolition;
+		for (const auto ir : se->mInitiatorIR->mInfluenceRules) {
+			bounds.mMaxInitiatorVolition += FMath::Max<int8>(ir->mWeight, 0);
+		}
+
+		// an NPC will never want to initiate an exchange that can't get a positive volition
+		if (bounds.mMaxInitiatorVolition <= 0) {
+			continue;
+		}
+
+		for (const auto effect : se->mEffects) {
+			bounds.mMaxGoalIncrease = FMath::Max(bounds.mMaxGoalIncrease, getGoalIncrease(effect->mChange, goalNetworkType));
+		}
+		bounds.mMaxGoalIncrease += triggersIncrease;
+
+		mBounds.Add(bounds);
+	}
+
+	mBounds.Sort([](const FExchangeBounds& a, const FExchangeBounds& b) {
+		return a.mMaxGoalIncrease > b.mMaxGoalIncrease;
+	});
+
+	mBoundsNetworkType = goalNetworkType;
+	mIsBoundsValid = true;
+}
+
+int32 UCiFLookaheadPlanner::search(UCiFCharacter* npc,
+                                   UCiFGameObject* target,
+                                   const int32 depth,
+                                   int32 bestSoFar,
+                                   FCiFPlannedMove* outFirstMove)
+{
+	const int32 current = evaluateGoal(npc, target);
+	if (depth == 0) {
+		return current;
+	}
+
+	// the root must return a move, deeper nodes can also stop without playing anything more
+	int32 best = outFirstMove ? MIN_int32 : current;
+	const int32 maxGoalIncrease = mBounds.IsEmpty() ? 0 : mBounds[0].mMaxGoalIncrease;
+
+	for (const auto& bounds : mBounds) {
+		// the exchange itself is played once, and the moves after it can be any exchange. the bounds are sorted, so once
+		// the best case of an exchange can't beat the best sequence, neither can the rest
+		const int32 upperBound = current + bounds.mMaxGoalIncrease + maxGoalIncrease * (depth - 1);
+		if (upperBound <= FMath::Max(best, bestSoFar)) {
+			break;
+		}
+
+		const auto se = bounds.mExchange;
+		for (const auto responder : mCifManager->mCast->mCharacters) {
+			if (mExpandedNodes >= mNodeBudget) {
+				return best;
+			}
+			if (responder == npc) {
+				continue;
+			}
+
+			TArray<UCiFGameObject*> possibleOthers;
+			se->getPossibleOthers(possibleOthers, npc->mObjectName, responder->mObjectName);
+			if (!se->checkPreconditionsVariableOther(npc, responder, possibleOthers)) {
+				continue;
+			}
+
+			// every rollout draws from its own substream so the plan doesn't depend on the expansion order
+			const FRandomStream substream = mCifManager->makeSubstream(GetTypeHash(se->mName), (depth << 8) | responder->mNetworkId);
+			TGuardValue<const FRandomStream*> streamGuard(mCifManager->mActiveRandomStream, &substream);
+
+			const auto forkedState = mCifManager->fork();
+			const FRolloutScoringMarks scoringMarks(se, responder);
+			const auto context = mCifManager->playGame(se, npc, responder, nullptr, possibleOthers, static_cast<TArray<UCiFGameObject*>>(mCifManager->mCast->mCharacters));
+			if (!context) {
+				scoringMarks.restore();
+				continue;
+			}
+			mExpandedNodes++;
+
+			// the effect's last seen time is part of the salience of later moves, so it is restored along with the state
+			const auto effect = se->getEffectById(context->mEffectId);
+			const int32 lastSeenTime = effect->mLastSeenTime;
+			mCifManager->changeSocialState(context, possibleOthers);
+
+			const int32 value = search(npc, target, depth - 1, FMath::Max(best, bestSoFar), nullptr);
+
+			effect->mLastSeenTime = lastSeenTime;
+			scoringMarks.restore();
+			mCifManager->restoreFork(*forkedState);
+
+			if (value > best) {
+				best = value;
+				if (outFirstMove) {
+					outFirstMove->mSocialExchangeName = se->mName;
+					outFirstMove->mResponderName = responder->mObjectName;
+					outFirstMove->mGoalValue = value;
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+int32 UCiFLookaheadPlanner::evaluateGoal(const UCiFCharacter* npc, const UCiFGameObject* target) const
+{
+	if (mGoal.mIsTargetTowardsSelf) {
+		return mCifManager->getNetworkWeightByType(mGoal.mNetworkType, target->mNetworkId, npc->mNetworkId);
+	}
+	return mCifManager->getNetworkWeightByType(mGoal.mNetworkType, npc->mNetworkId, target->mNetworkId);
+}
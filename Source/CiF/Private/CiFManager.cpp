@@ -5,16 +5,21 @@
 #include "CiFCast.h"
 #include "CiFCharacter.h"
 #include "CiFCulturalKnowledgeBase.h"
+#include "CiFDifferentialTester.h"
 #include "CiFInfluenceRule.h"
+#include "CiFIntentScheduler.h"
 #include "CiFInstantiation.h"
 #include "CiFItem.h"
+#include "CiFJournal.h"
 #include "CiFKnowledge.h"
+#include "CiFLookaheadPlanner.h"
 #include "CiFMicrotheory.h"
 #include "CiFPredicate.h"
 #include "CiFProspectiveMemory.h"
 #include "CiFRelationshipNetwork.h"
 #include "CiFRule.h"
 #include "CiFRuleRecord.h"
+#include "CiFSessionRecorder.h"
 #include "CiFSocialExchange.h"
 #include "CiFSocialExchangeContext.h"
 #include "CiFSocialExchangesLibrary.h"
@@ -22,6 +27,9 @@
 #include "CiFTrigger.h"
 #include "CiFTriggerContext.h"
 #include "ReadWriteFiles.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
 
 UCiFManager::UCiFManager()
 {
@@ -31,6 +39,7 @@ UCiFManager::UCiFManager()
 void UCiFManager::init(const UObject* worldContextObject)
 {
 	mWorldContextObject = const_cast<UObject*>(worldContextObject);
+	setRandomSeed(FPlatformTime::Cycles());
 	
 	mSocialExchangesLib = NewObject<UCiFSocialExchangesLibrary>(const_cast<UObject*>(worldContextObject));
 	mSFDB = NewObject<UCiFSocialFactsDataBase>(const_cast<UObject*>(worldContextObject));
@@ -57,6 +66,7 @@ void UCiFManager::init(const UObject* worldContextObject)
 	const FString knowledgePath = FPaths::Combine(*FPaths::ProjectPluginsDir(), *FString("CiF/Content/Data/knowledgeList.json"));
 	UE_LOG(LogTemp, Log, TEXT("Reading knowledge list from %s"), *knowledgePath);
 	loadKnowledgeList(knowledgePath, worldContextObject);
+	mGameObjectRegistry.build(mCast->mCharacters, mItemArray, mKnowledgeArray, mCast->getVersion());
 
 	const FString sfdbPath = FPaths::Combine(*FPaths::ProjectPluginsDir(), *FString("CiF/Content/Data/sfdb.json"));
 	UE_LOG(LogTemp, Log, TEXT("Reading SFDB from %s"), *sfdbPath);
@@ -74,6 +84,23 @@ void UCiFManager::init(const UObject* worldContextObject)
 	UE_LOG(LogTemp, Log, TEXT("Reading CKB from %s"), *ckbPath);
 	loadCKB(ckbPath, worldContextObject);
 
+	mIntentScheduler = NewObject<UCiFIntentScheduler>(this);
+	mIntentScheduler->init(this);
+
+	mLookaheadPlanner = NewObject<UCiFLookaheadPlanner>(this);
+	mLookaheadPlanner->init(this);
+
+	mSessionRecorder = NewObject<UCiFSessionRecorder>(this);
+	mSessionRecorder->init(this);
+
+	mDifferentialTester = NewObject<UCiFDifferentialTester>(this);
+	mDifferentialTester->init(this);
+
+	mJournal = NewObject<UCiFJournal>(this);
+	mJournal->init(this);
+
+	commitState();
+
 	UE_LOG(LogTemp, Log, TEXT("Finished loading all"));
 }
 
@@ -156,7 +183,7 @@ void UCiFManager::loadSFDB(const FString& filePath, const UObject* worldContextO
 	for (const auto scJson : scsJson) {
 		auto sc = UCiFStatusContext::loadFromJson(scJson->AsObject(), worldContextObject);
 		if (sc) {
-			mSFDB->mContexts.Add(sc);
+			mSFDB->addContext(sc);
 		}
 	}
 
@@ -164,7 +191,7 @@ void UCiFManager::loadSFDB(const FString& filePath, const UObject* worldContextO
 	for (const auto tcJson : tcsJson) {
 		auto tc = UCiFTriggerContext::loadFromJson(tcJson->AsObject(), worldContextObject);
 		if (tc) {
-			mSFDB->mContexts.Add(tc);
+			mSFDB->addContext(tc);
 		}
 	}
 
@@ -172,7 +199,7 @@ void UCiFManager::loadSFDB(const FString& filePath, const UObject* worldContextO
 	for (const auto sgJson : sgcsJson) {
 		auto sgc = UCiFSocialExchangeContext::loadFromJson(sgJson->AsObject(), worldContextObject);
 		if (sgc) {
-			mSFDB->mContexts.Add(sgc);
+			mSFDB->addContext(sgc);
 		}
 		else {
 			UE_LOG(LogTemp, Warning, TEXT("SocialGmaeContext failed to load from file"));
@@ -184,16 +211,12 @@ void UCiFManager::loadSFDB(const FString& filePath, const UObject* worldContextO
 	// for (const auto bsJson : backstoryJson) {
 	// 	auto bsc = UCiFSocialExchangeContext::loadFromJson(bsJson->AsObject(), worldContextObject);
 	// 	if (bsc) {
-	// 		mSFDB->mContexts.Add(bsc);
+	// 		mSFDB->addContext(bsc);
 	// 	}
 	// 	else {
 	// 		UE_LOG(LogTemp, Warning, TEXT("SocialGmaeContext failed to load from file"));
 	// 	}
 	// }
-
-	// sort the contexts in SFDB in the specified order (ascending in our case)
-	// if want to sort in a descending order, need to provide lambda function that return a > b as true
-	mSFDB->mContexts.Sort();
 }
 
 void UCiFManager::loadSocialNetworks(const FString& filePath, const UObject* worldContextObject)
@@ -234,7 +257,7 @@ void UCiFManager::loadTriggers(const FString& filePath, const UObject* worldCont
 	for (const auto triggerJson : triggersJson) {
 		auto t = UCiFTrigger::loadFromJson(triggerJson->AsObject(), worldContextObject);
 		if (t) {
-			mSFDB->mTriggers.Add(t);
+			mSFDB->addTrigger(t);
 		}
 		else {
 			UE_LOG(LogTemp, Warning, TEXT("Trigger failed to load from file"));
@@ -244,6 +267,14 @@ void UCiFManager::loadTriggers(const FString& filePath, const UObject* worldCont
 
 void UCiFManager::formIntentForAll()
 {
+	FCiFSessionCallScope sessionScope(mSessionRecorder);
+	if (sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::FORM_INTENT_ALL;
+		event.mTime = mTime;
+		mSessionRecorder->recordEvent(event);
+	}
+
 	clearProspectiveMemory();
 
 	for (auto c : mCast->mCharacters) {
@@ -251,8 +282,22 @@ void UCiFManager::formIntentForAll()
 	}
 }
 
+void UCiFManager::formIntentForAllTimeSliced()
+{
+	mIntentScheduler->startPass();
+}
+
 void UCiFManager::formIntent(UCiFCharacter* initiator)
 {
+	FCiFSessionCallScope sessionScope(mSessionRecorder);
+	if (sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::FORM_INTENT;
+		event.mTime = mTime;
+		event.mInitiator = initiator->mObjectName;
+		mSessionRecorder->recordEvent(event);
+	}
+
 	clearProspectiveMemory();
 
 	for (const auto responder : mCast->mCharacters) {
@@ -266,8 +311,56 @@ void UCiFManager::formIntentForSocialGames(UCiFCharacter* initiator,
                                            UCiFGameObject* responder,
                                            const TArray<UCiFGameObject*>& possibleOthers)
 {
-	for (auto [name, se] : mSocialExchangesLib->mSocialExchanges) {
-		formIntentForSpecificSocialExchange(se, initiator, responder, possibleOthers);
+	FCiFSessionCallScope sessionScope(mSessionRecorder);
+	if (sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::FORM_INTENT_SOCIAL_GAMES;
+		event.mTime = mTime;
+		event.mInitiator = initiator->mObjectName;
+		event.mResponder = responder->mObjectName;
+		UCiFSessionRecorder::namesOf(possibleOthers, event.mOtherCast);
+		mSessionRecorder->recordEvent(event);
+	}
+
+	formIntentForSocialExchangeRange(initiator, responder, possibleOthers, 0, mSocialExchangesLib->num());
+}
+
+void UCiFManager::formIntentForSocialExchangeRange(UCiFCharacter* initiator,
+                                                   UCiFGameObject* responder,
+                                                   const TArray<UCiFGameObject*>& possibleOthers,
+                                                   const int32 firstIndex,
+                                                   const int32 endIndex)
+{
+	// the signatures are matched for the whole range first, only the admitted exchanges evaluate their preconditions.
+	// preconditions that require an other can hold for any of the possible others, so they aren't prefiltered
+	TBitArray<> isAdmitted(true, endIndex - firstIndex);
+	if (!mIsReferenceEvaluation) {
+		const auto pair = FCiFPairSignature::make(this, initiator, responder);
+		for (int32 i = firstIndex; i < endIndex; i++) {
+			if (!mSocialExchangesLib->getDescriptor(i).hasFlag(ECiFSocialExchangeFlags::PRECONDITIONS_REQUIRE_OTHER)) {
+				isAdmitted[i - firstIndex] = mSocialExchangesLib->getPreconditionSignature(i).admits(pair);
+			}
+		}
+	}
+
+	// each (time, initiator, responder) draws from its own substreams, one per exchange, so however a time sliced pass
+	// splits the exchanges into chunks it draws the same numbers as a full one
+	const uint32 pairKey = HashCombine(GetTypeHash(mTime), (initiator->mNetworkId << 8) | responder->mNetworkId);
+	for (int32 i = firstIndex; i < endIndex; i++) {
+		const auto se = mSocialExchangesLib->getSocialExchange(i);
+		if (isAdmitted[i - firstIndex]) {
+			const FRandomStream substream = makeSubstream(pairKey, i);
+			TGuardValue<const FRandomStream*> streamGuard(mActiveRandomStream, &substream);
+			formIntentForSpecificSocialExchange(se, initiator, responder, possibleOthers);
+		}
+		else {
+			if (mDifferentialTester && mDifferentialTester->isActive()) {
+				mDifferentialTester->checkPreconditionFilter(se, initiator, responder, possibleOthers);
+			}
+			// the same score formIntentThirdParty gives when the preconditions don't hold
+			initiator->mProspectiveMemory->addSocialExchangeScore(se->mName, initiator->mObjectName, responder->mObjectName, "",
+			                                                      initiator->mProspectiveMemory->getDefaultIntentScore());
+		}
 	}
 }
 
@@ -301,7 +394,7 @@ void UCiFManager::formIntentThirdParty(UCiFSocialExchange* socialExchange,
 
 		// checks if already cached MTs for the current SG intent (some social exchanges has the same intent, e.g. flirt / give romantic gift)
 		// if not, score and cache
-		const auto intentType = socialExchange->getSocialExchangeIntentType();
+		const auto intentType = mSocialExchangesLib->getDescriptor(socialExchange).mIntentType;
 		const auto intentIndex = static_cast<uint8>(intentType);
 		if (initiator->mProspectiveMemory->mIntentScoreCache[responder->mNetworkId][intentIndex] ==
 			initiator->mProspectiveMemory->getDefaultIntentScore()) {
@@ -356,6 +449,9 @@ UCiFSocialExchangeContext* UCiFManager::playGame(UCiFSocialExchange* sg,
 	//will cause issues and heartbreak).
 	other = nullptr;
 
+	// the event is recorded after the play, along with its result
+	FCiFSessionCallScope sessionScope(mSessionRecorder);
+
 	if (levelCast.IsEmpty()) {
 		UE_LOG(LogTemp, Warning, TEXT("Level cast is empty, this is not allowed - but why?"));
 	}
@@ -414,7 +510,8 @@ UCiFSocialExchangeContext* UCiFManager::playGame(UCiFSocialExchange* sg,
 	}
 
 	// the other to use when all cases of other being passed in a third character being needed when one is not provided
-	UCiFGameObject* trueOther = (!other && sg->isThirdForSocialExchangePlay()) ? mostSalientOther : other;
+	const bool isThirdNeeded = mSocialExchangesLib->getDescriptor(sg).hasFlag(ECiFSocialExchangeFlags::THIRD_NEEDED_FOR_PLAY);
+	UCiFGameObject* trueOther = (!other && isThirdNeeded) ? mostSalientOther : other;
 
 	//TODO: sort of a hack. I want this in GameEngine... this is part of separating playGame and changeSocialState
 	mLastResponderOther = trueOther;
@@ -452,6 +549,21 @@ UCiFSocialExchangeContext* UCiFManager::playGame(UCiFSocialExchange* sg,
 	}
 	socialGameContext->mResponderScore = score;
 
+	if (sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::PLAY_GAME;
+		event.mTime = mTime;
+		event.mExchange = sg->mName;
+		event.mInitiator = initiator->mObjectName;
+		event.mResponder = responder->mObjectName;
+		UCiFSessionRecorder::namesOf(otherCast, event.mOtherCast);
+		UCiFSessionRecorder::namesOf(levelCast, event.mLevelCast);
+		event.mEffectId = chosenEffect ? chosenEffect->mId : CIF_INVALID_ID;
+		event.mResultEffectId = socialGameContext->mEffectId;
+		event.mResultOther = socialGameContext->mOtherName;
+		mSessionRecorder->recordEvent(event);
+	}
+
 	return socialGameContext;
 }
 
@@ -471,10 +583,9 @@ float UCiFManager::getResponderScore(UCiFSocialExchange* sg,
 	// score MT - look up responder's intent to play social game with initiator
 	if (responder->mGameObjectType == ECiFGameObjectType::CHARACTER) {
 		const auto r = static_cast<UCiFCharacter*>(responder);
-		if (r->mProspectiveMemory->mIntentScoreCache[initiator->mNetworkId][static_cast<uint8>(sg->mIntents[0]->mPredicates[0]->
-			getIntentType())] != r->mProspectiveMemory->getDefaultIntentScore()) {
-			score += r->mProspectiveMemory->mIntentScoreCache[initiator->mNetworkId][static_cast<uint8>(sg->mIntents[0]->mPredicates[0]->
-				getIntentType())];
+		const auto intentType = static_cast<uint8>(mSocialExchangesLib->getDescriptor(sg).mIntentType);
+		if (r->mProspectiveMemory->mIntentScoreCache[initiator->mNetworkId][intentType] != r->mProspectiveMemory->getDefaultIntentScore()) {
+			score += r->mProspectiveMemory->mIntentScoreCache[initiator->mNetworkId][intentType];
 		}
 	}
 
@@ -629,6 +740,17 @@ void UCiFManager::changeSocialState(UCiFSocialExchangeContext* sgContext, TArray
 		return;
 	}
 
+	FCiFJournalScope journalScope;
+	FCiFSessionCallScope sessionScope(mSessionRecorder);
+	if (sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::CHANGE_SOCIAL_STATE;
+		event.mTime = mTime;
+		UCiFSessionRecorder::recordContext(sgContext, event);
+		UCiFSessionRecorder::namesOf(otherCast, event.mOtherCast);
+		mSessionRecorder->recordEvent(event);
+	}
+
 	auto possibleOthers = otherCast;
 	if (possibleOthers.IsEmpty()) {
 		sg->getPossibleOthers(possibleOthers, initiator->mObjectName, responder->mObjectName);
@@ -639,7 +761,14 @@ void UCiFManager::changeSocialState(UCiFSocialExchangeContext* sgContext, TArray
 	const auto other = getGameObjectByName(sgContext->mOtherName);
 	highestSaliencyEffect->mChange->valuation(initiator, responder, other);
 
+	const int32 lastSeenTime = highestSaliencyEffect->mLastSeenTime;
 	highestSaliencyEffect->mLastSeenTime = mTime;
+	if (const auto journal = UCiFJournal::getActiveJournal()) {
+		journal->logEffectSeen(sg->mName, highestSaliencyEffect->mId, mTime);
+	}
+	if (const auto diff = FCiFSocialStateDiff::getActiveDiff()) {
+		diff->recordEffectSeen(sg->mName, highestSaliencyEffect->mId, lastSeenTime, mTime);
+	}
 
 	mSFDB->addContext(sgContext);
 
@@ -661,15 +790,10 @@ void UCiFManager::changeSocialState(UCiFSocialExchangeContext* sgContext, TArray
 					const auto directedToward = getGameObjectByName(status->mDirectedTowards);
 					pred->valuation(c, directedToward);
 
-					// make trigger context for this change in state
-					const auto trigger = NewObject<UCiFTrigger>(mWorldContextObject);
-					trigger->mId = UCiFTrigger::mStatusTimeoutTriggerID;
+					// record a trigger for this change in state
 					const auto changeRule = NewObject<UCiFRule>(mWorldContextObject);
 					changeRule->mPredicates.Add(pred);
-
-					UCiFTriggerContext* triggerContext = trigger->makeTriggerContext(mTime, c, directedToward);
-					triggerContext->mStatusTimeoutChange = changeRule;
-					mSFDB->addContext(triggerContext);
+					mSFDB->addTriggerRecord(UCiFTrigger::mStatusTimeoutTriggerID, changeRule, mTime, c, directedToward);
 				}
 			}
 		}
@@ -694,6 +818,395 @@ void UCiFManager::changeSocialState(UCiFSocialExchangeContext* sgContext, TArray
 	
 	//increment system time after the context has been added
 	mTime++;
+	if (const auto journal = UCiFJournal::getActiveJournal()) {
+		journal->logTime(mTime);
+	}
+	// no diff is active while tracking is suspended (lookahead rollouts), those turns aren't undo steps
+	if (mUndoTracking.isTracking() && FCiFSocialStateDiff::getActiveDiff()) {
+		pushUndoStep();
+	}
+
+	mSFDB->compactHistory(getEarliestRestorableTime());
+}
+
+void UCiFManager::queueSocialStateChange(UCiFSocialExchangeContext* sgContext, TArray<UCiFGameObject*> otherCast)
+{
+	if (!sgContext) {
+		UE_LOG(LogTemp, Warning, TEXT("Trying to queue an empty social exchange context"));
+		return;
+	}
+	FPendingSocialStateChange change;
+	change.mContext = sgContext;
+	change.mOtherCast = otherCast;
+	mPendingStateChanges.Add(change);
+}
+
+void UCiFManager::syncSocialState()
+{
+	checkf(IsInGameThread(), TEXT("CiF social state can only be changed on the game thread"));
+
+	// changeSocialState could be queuing more changes through delegates, so don't iterate the live array
+	const auto pendingChanges = MoveTemp(mPendingStateChanges);
+	mPendingStateChanges.Reset();
+	for (const auto& change : pendingChanges) {
+		changeSocialState(change.mContext, change.mOtherCast);
+	}
+
+	commitState();
+	if (mIsNotifyingChanges) {
+		OnSocialStateCommitted.Broadcast(mTime);
+	}
+}
+
+uint8 UCiFManager::getCommittedNetworkWeight(const ESocialNetworkType netType, const uint8 id1, const uint8 id2) const
+{
+	return mCommittedState.getWeight(netType, id1, id2);
+}
+
+bool UCiFManager::hasCommittedStatus(const FName objectName, const EStatus statusType, const FName towards) const
+{
+	return mCommittedState.hasStatus(objectName, statusType, towards);
+}
+
+void UCiFManager::commitState()
+{
+	mCommittedState.capture(this);
+	mCommittedState.captureStatuses(this);
+}
+
+void UCiFManager::setRandomSeed(const int32 seed)
+{
+	mRandomSeed = seed;
+	mRandomStream.Initialize(seed);
+}
+
+FRandomStream UCiFManager::makeSubstream(const uint32 key1, const uint32 key2) const
+{
+	return FRandomStream(static_cast<int32>(HashCombine(HashCombine(GetTypeHash(mRandomSeed), key1), key2)));
+}
+
+FCiFFastForwardStats UCiFManager::fastForward(const int32 numTurns, const int32 seed, const FName excludedCharacter)
+{
+	FCiFFastForwardStats stats;
+
+	FCiFSessionCallScope sessionScope(mSessionRecorder);
+	if (sessionScope.shouldRecord()) {
+		FCiFSessionEvent event;
+		event.mType = ECiFSessionEventType::FAST_FORWARD;
+		event.mTime = mTime;
+		event.mInitiator = excludedCharacter;
+		event.mValue = numTurns;
+		event.mSeed = seed;
+		mSessionRecorder->recordEvent(event);
+	}
+
+	TArray<UCiFCharacter*> initiators = mCast->mCharacters.FilterByPredicate([=](const UCiFCharacter* c) {
+		return c->mObjectName != excludedCharacter;
+	});
+	if (initiators.Num() < 2) {
+		UE_LOG(LogTemp, Warning, TEXT("Fast forward needs at least 2 characters, got %d"), initiators.Num());
+		return stats;
+	}
+	const TArray<UCiFGameObject*> castObjects = static_cast<TArray<UCiFGameObject*>>(initiators);
+
+	const bool wasNotifying = mIsNotifyingChanges;
+	const auto randomStream = mRandomStream;
+	const auto randomSeed = mRandomSeed;
+	mIsNotifyingChanges = false;
+	TGuardValue<bool> traceLoggingGuard(mIsTraceLogging, false);
+	setRandomSeed(seed);
+
+	const double startTime = FPlatformTime::Seconds();
+	for (int32 turn = 0; turn < numTurns; turn++) {
+		const auto initiator = initiators[turn % initiators.Num()];
+
+		initiator->resetProspectiveMemory();
+		for (const auto responder : initiators) {
+			if (responder != initiator) {
+				formIntentForSocialGames(initiator, responder, castObjects);
+			}
+		}
+
+		const auto bestScores = initiator->mProspectiveMemory->getNHighestGameScores(1);
+		if (bestScores.IsEmpty() || bestScores[0].mScore <= 0) {
+			stats.mTurnsSkipped++;
+			continue;
+		}
+
+		const auto sg = mSocialExchangesLib->getSocialExchangeByName(bestScores[0].mName);
+		const auto responder = getGameObjectByName(bestScores[0].mResponder);
+		// the cast is passed as the others too, so the excluded character isn't taken as an other either
+		const auto context = playGame(sg, initiator, responder, nullptr, castObjects, castObjects);
+		if (!context) {
+			stats.mTurnsSkipped++;
+			continue;
+		}
+
+		changeSocialState(context, castObjects);
+		stats.mTurnsPlayed++;
+	}
+	stats.mSeconds = FPlatformTime::Seconds() - startTime;
+
+	mIsNotifyingChanges = wasNotifying;
+	mRandomSeed = randomSeed;
+	mRandomStream = randomStream;
+
+	if (stats.mSeconds > 0) {
+		stats.mTurnsPerSecond = numTurns / stats.mSeconds;
+	}
+	UE_LOG(LogTemp, Log, TEXT("Fast forwarded %d turns (%d played) in %.3f seconds, %.1f turns/sec"),
+	       numTurns, stats.mTurnsPlayed, stats.mSeconds, stats.mTurnsPerSecond);
+
+	return stats;
+}
+
+TSharedRef<FCiFSocialStateSnapshot> UCiFManager::fork() const
+{
+	auto forkedState = MakeShared<FCiFSocialStateSnapshot>();
+	forkedState->capture(this);
+	forkedState->captureStatuses(this);
+	mLiveForks.Add(forkedState);
+	return forkedState;
+}
+
+void UCiFManager::restoreFork(const FCiFSocialStateSnapshot& forkedState)
+{
+	forkedState.restore(this);
+	// the restore isn't journaled change by change, so the journal starts over from the state of the next commit
+	mJournal->requestCheckpoint();
+}
+
+bool UCiFManager::saveState(const FString& filePath)
+{
+	const double startTime = FPlatformTime::Seconds();
+
+	TArray<uint8> data;
+	FMemoryWriter writer(data);
+	uint32 magic = STATE_MAGIC;
+	writer << magic;
+	serializeState(writer);
+
+	if (!FFileHelper::SaveArrayToFile(data, *filePath)) {
+		UE_LOG(LogTemp, Error, TEXT("Couldn't save the CiF state to %s"), *filePath);
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Saved the CiF state at time %d to %s (%d bytes) in %.2f ms"),
+	       mTime, *filePath, data.Num(), (FPlatformTime::Seconds() - startTime) * 1000.0);
+	return true;
+}
+
+bool UCiFManager::loadState(const FString& filePath)
+{
+	const double startTime = FPlatformTime::Seconds();
+
+	TArray<uint8> data;
+	if (!FFileHelper::LoadFileToArray(data, *filePath)) {
+		UE_LOG(LogTemp, Error, TEXT("Couldn't read the CiF state from %s"), *filePath);
+		return false;
+	}
+
+	FMemoryReader reader(data);
+	uint32 magic = 0;
+	reader << magic;
+	if (magic != STATE_MAGIC) {
+		UE_LOG(LogTemp, Error, TEXT("%s isn't a saved CiF state"), *filePath);
+		return false;
+	}
+	if (!serializeState(reader)) {
+		return false;
+	}
+
+	// the changes were queued against the state that was replaced
+	mPendingStateChanges.Reset();
+	commitState();
+	mJournal->requestCheckpoint();
+
+	UE_LOG(LogTemp, Log, TEXT("Loaded the CiF state at time %d from %s in %.2f ms"),
+	       mTime, *filePath, (FPlatformTime::Seconds() - startTime) * 1000.0);
+	return true;
+}
+
+void UCiFManager::setUndoDepth(const int32 numTurns)
+{
+	mUndoDepth = FMath::Max(numTurns, 0);
+	if (mUndoDepth == 0) {
+		mUndoTracking.endTracking(this);
+		mUndoSteps.Empty();
+		return;
+	}
+
+	if (!mUndoTracking.isTracking()) {
+		mUndoTracking.beginTracking(this);
+	}
+	while (mUndoSteps.Num() > mUndoDepth) {
+		mUndoSteps.RemoveAt(0);
+	}
+}
+
+bool UCiFManager::rollbackTo(const int32 time)
+{
+	if (!mUndoTracking.isTracking()) {
+		UE_LOG(LogTemp, Error, TEXT("Can't roll back, no turns are kept for undo (see setUndoDepth)"));
+		return false;
+	}
+	const int32 oldestTime = mUndoSteps.IsEmpty() ? mUndoTracking.mFromTime : mUndoSteps[0].mFromTime;
+	if (time < oldestTime || time > mTime) {
+		UE_LOG(LogTemp, Error, TEXT("Can only roll back to a time between %d and %d, not %d"), oldestTime, mTime, time);
+		return false;
+	}
+
+	// the changes made since the last turn ended, then whole turns from the newest
+	mUndoTracking.cut(this).revert(this);
+	while (!mUndoSteps.IsEmpty() && mUndoSteps.Last().mFromTime >= time) {
+		mUndoSteps.Pop().revert(this);
+	}
+	// the reverts aren't tracked, the current turn starts over at the time rolled back to
+	mUndoTracking.cut(this);
+
+	mPendingStateChanges.Reset();
+	commitState();
+	mJournal->requestCheckpoint();
+	return true;
+}
+
+int32 UCiFManager::getEarliestRestorableTime() const
+{
+	int32 time = FCiFSocialStateDiff::getEarliestTrackedTime();
+	if (!mUndoSteps.IsEmpty()) {
+		time = FMath::Min(time, mUndoSteps[0].mFromTime);
+	}
+
+	mLiveForks.RemoveAll([](const TWeakPtr<FCiFSocialStateSnapshot>& fork) { return !fork.IsValid(); });
+	for (const auto& fork : mLiveForks) {
+		time = FMath::Min(time, fork.Pin()->mTime);
+	}
+	return time;
+}
+
+void UCiFManager::notifyNetworkWrite(const FCiFSessionCallScope& sessionScope, FCiFSessionEvent& event, const ESocialNetworkType type,
+                                     const uint8 c1, const uint8 c2, const uint8 oldWeight, const uint8 newWeight)
+{
+	if (sessionScope.shouldRecord()) {
+		event.mEnumValue = static_cast<uint8>(type);
+		event.mId1 = c1;
+		event.mId2 = c2;
+		UCiFSessionRecorder::mActiveRecorder->recordEvent(event);
+	}
+	if (const auto journal = UCiFJournal::getActiveJournal()) {
+		journal->logNetworkWeight(type, c1, c2, newWeight);
+	}
+	if (const auto diff = FCiFSocialStateDiff::getActiveDiff()) {
+		diff->recordWeight(type, c1, c2, oldWeight, newWeight);
+	}
+}
+
+void UCiFManager::pushUndoStep()
+{
+	mUndoSteps.Add(mUndoTracking.cut(this));
+	if (mUndoSteps.Num() > mUndoDepth) {
+		mUndoSteps.RemoveAt(0);
+	}
+}
+
+void UCiFManager::clearUndo()
+{
+	mUndoSteps.Empty();
+	if (mUndoTracking.isTracking()) {
+		mUndoTracking.cut(this);
+	}
+}
+
+bool UCiFManager::serializeState(FArchive& ar)
+{
+	uint32 version = STATE_VERSION;
+	ar << version;
+	if (version != STATE_VERSION) {
+		UE_LOG(LogTemp, Error, TEXT("CiF state version %u isn't supported, expected version %u"), version, STATE_VERSION);
+		return false;
+	}
+
+	// game objects are kept by name, all of them must exist before anything is loaded
+	TArray<UCiFGameObject*> gameObjects(getGameObjectRegistry().getObjects());
+	TArray<FName> gameObjectNames;
+	for (const auto go : gameObjects) {
+		gameObjectNames.Add(go->mObjectName);
+	}
+	ar << gameObjectNames;
+	if (ar.IsLoading()) {
+		gameObjects.Reset();
+		for (const auto name : gameObjectNames) {
+			const auto go = getGameObjectByName(name);
+			if (!go) {
+				UE_LOG(LogTemp, Error, TEXT("Game object '%s' of the CiF state doesn't exist - the state must be loaded on the same cast"), *name.ToString());
+				return false;
+			}
+			gameObjects.Add(go);
+		}
+	}
+
+	// a read state is applied only once all of it was read, a truncated or corrupt one leaves the current state as it is
+	FCiFSocialStateSnapshot snapshot;
+	if (ar.IsSaving()) {
+		snapshot.capture(this);
+		snapshot.captureStatuses(this);
+	}
+	snapshot.serialize(ar);
+
+	TArray<TSet<ETrait>> loadedTraits;
+	TArray<UCiFProspectiveMemory*> loadedMemories; // null for the objects that aren't characters
+	for (const auto go : gameObjects) {
+		const auto character = Cast<UCiFCharacter>(go);
+		if (ar.IsSaving()) {
+			ar << go->mTraits;
+			if (character) {
+				character->mProspectiveMemory->serializeSummary(ar);
+			}
+		}
+		else {
+			ar << loadedTraits.AddDefaulted_GetRef();
+			const auto memory = character ? NewObject<UCiFProspectiveMemory>(this) : nullptr;
+			if (memory) {
+				memory->serializeSummary(ar);
+			}
+			loadedMemories.Add(memory);
+		}
+	}
+
+	TArray<TTuple<FName, IdType, int32>> effectSeenTimes;
+	if (ar.IsSaving()) {
+		for (const auto sg : mSocialExchangesLib->mSocialExchanges) {
+			for (const auto effect : sg->mEffects) {
+				effectSeenTimes.Emplace(sg->mName, effect->mId, effect->mLastSeenTime);
+			}
+		}
+	}
+	ar << effectSeenTimes;
+
+	// the history is the last part of the state, it replaces the current one only if it was read whole
+	if (ar.IsError() || !mSFDB->serializeHistory(ar)) {
+		UE_LOG(LogTemp, Error, TEXT("The CiF state is truncated or corrupt"));
+		return false;
+	}
+
+	if (ar.IsLoading()) {
+		// the history was just replaced with the loaded one, which is the history of the snapshot already
+		snapshot.restore(this, false);
+		for (int32 i = 0; i < gameObjects.Num(); i++) {
+			gameObjects[i]->mTraits = MoveTemp(loadedTraits[i]);
+			if (loadedMemories[i]) {
+				static_cast<UCiFCharacter*>(gameObjects[i])->mProspectiveMemory->copySummary(*loadedMemories[i]);
+			}
+		}
+		for (const auto& [socialExchange, effectId, lastSeenTime] : effectSeenTimes) {
+			const auto sg = mSocialExchangesLib->getSocialExchangeByName(socialExchange);
+			if (const auto effect = sg ? sg->getEffectById(effectId) : nullptr) {
+				effect->mLastSeenTime = lastSeenTime;
+			}
+		}
+		clearUndo();
+	}
+	return true;
 }
 
 TArray<UCiFRuleRecord*> UCiFManager::getPredicateRelevance(UCiFSocialExchange* sg,
@@ -752,13 +1265,14 @@ TArray<UCiFRuleRecord*> UCiFManager::getPredicateRelevance(UCiFSocialExchange* s
 					}
 					else {
 						auto rrIntentType = rr->mInfluenceRule->mPredicates[rrIntentIndex]->getIntentType();
-						if (sg->mIntents[0]->mPredicates[0]->getIntentType() == rrIntentType) {
+						if (sg->getSocialExchangeIntentType() == rrIntentType) {
 							auto mt = getMicrotheoryByName(rr->mName);
 							auto newRR = NewObject<UCiFRuleRecord>();
 							newRR->init(rr->mName, rr->mInitiator, rr->mResponder, rr->mOther, rr->mType, rr->mInfluenceRule);
 							for (const auto p : mt->mDefinition->mPredicates) {
 								newRR->mInfluenceRule->mPredicates.Add(p);
 							}
+							newRR->mInfluenceRule->updateMetadata();
 
 							auto rrWeight = newRR->mInfluenceRule->mWeight;
 							if (rrWeight < 0) {
@@ -877,33 +1391,19 @@ UCiFMicrotheory* UCiFManager::getMicrotheoryByName(const FName mtName)
 
 void UCiFManager::getAllGameObjects(TArray<UCiFGameObject*>& outGameObjs) const
 {
-	// TODO - optimizations, maybe after the first call for this, store all these game objects
-	// in a member and return it, instead of every time running over all the objects
-	for (const auto x : mCast->mCharacters) outGameObjs.Add(x);
-	for (const auto x : mItemArray) outGameObjs.Add(x);
-	for (const auto x : mKnowledgeArray) outGameObjs.Add(x);
+	outGameObjs.Append(getGameObjectRegistry().getObjects());
 }
 
 void UCiFManager::getAllGameObjectsNames(TArray<FName>& outObjNames) const
 {
-	for (auto x : mCast->mCharacters) outObjNames.Add(x->mObjectName);
-	for (auto x : mItemArray) outObjNames.Add(x->mObjectName);
-	for (auto x : mKnowledgeArray) outObjNames.Add(x->mObjectName);
+	const auto gameObjects = getGameObjectRegistry().getObjects();
+	outObjNames.Reserve(outObjNames.Num() + gameObjects.Num());
+	for (const auto go : gameObjects) outObjNames.Add(go->mObjectName);
 }
 
 void UCiFManager::getAllGameObjectsOfType(TArray<UCiFGameObject*>& outGameObjs, const ECiFGameObjectType type) const
 {
-	switch (type) {
-		case ECiFGameObjectType::CHARACTER:
-			for (const auto c : mCast->mCharacters) outGameObjs.Add(c);
-			break;
-		case ECiFGameObjectType::ITEM:
-			for (const auto i : mItemArray) outGameObjs.Add(i);
-			break;
-		case ECiFGameObjectType::KNOWLEDGE:
-			for (const auto k : mKnowledgeArray) outGameObjs.Add(k);
-			break;
-	}
+	outGameObjs.Append(getGameObjectRegistry().getObjectsOfType(type));
 }
 
 int8 UCiFManager::getNetworkWeightByType(const ESocialNetworkType netType, const uint8 id1, const uint8 id2) const
@@ -919,6 +1419,10 @@ int8 UCiFManager::getNetworkWeightByType(const ESocialNetworkType netType, const
 
 void UCiFManager::notifySocialStateChange(const UCiFEffect* effect)
 {
+	if (!mIsNotifyingChanges) {
+		return;
+	}
+
 	for (const auto p : effect->mChange->mPredicates) {
 		switch (p->mType) {
 			case EPredicateType::NETWORK:
@@ -939,41 +1443,50 @@ FName UCiFManager::pickAGoodCKBObject(const UCiFGameObject* initiator,
 {
 	TArray<FName> potentialCKBObjects;
 	ckbPredicate->evalCKBEntryForObjects(initiator, responder, potentialCKBObjects);
+	if (potentialCKBObjects.IsEmpty()) {
+		return NAME_None;
+	}
 
 	// pick random one for now
-	const auto randIndex = FMath::RandRange(0, potentialCKBObjects.Num() - 1);
+	const auto randIndex = getRandomStream().RandRange(0, potentialCKBObjects.Num() - 1);
 	return potentialCKBObjects[randIndex];
 }
 
 UCiFGameObject* UCiFManager::getGameObjectByName(const FName name) const
 {
-	UCiFGameObject* gameObject = nullptr;
+	return getGameObjectRegistry().findObject(name);
+}
 
-	gameObject = mCast->getCharByName(name);
-	if (!gameObject) {
-		gameObject = getItemByName(name);
-	}
-	if (!gameObject) {
-		gameObject = getKnowledgeByName(name);
-	}
+int32 UCiFManager::getGameObjectHandle(const FName name) const
+{
+	return getGameObjectRegistry().getHandle(name);
+}
 
-	return gameObject;
+UCiFGameObject* UCiFManager::getGameObjectByHandle(const int32 handle) const
+{
+	return getGameObjectRegistry().getObject(handle);
+}
+
+const FCiFGameObjectRegistry& UCiFManager::getGameObjectRegistry() const
+{
+	// the cast is open to the game, characters can be added to or replaced in it after init. The items and knowledge
+	// are only loaded by the manager
+	if (!mGameObjectRegistry.isBuiltFrom(mCast->mCharacters, mItemArray, mKnowledgeArray, mCast->getVersion())) {
+		mGameObjectRegistry.update(mCast->mCharacters, mItemArray, mKnowledgeArray, mCast->getVersion());
+	}
+	return mGameObjectRegistry;
 }
 
 UCiFItem* UCiFManager::getItemByName(const FName name) const
 {
-	auto item = mItemArray.FindByPredicate([=](const UCiFItem* i) { return i->mObjectName == name; });
-	if (item) return *item;
-	return nullptr;
+	const auto go = getGameObjectByName(name);
+	return go && go->mGameObjectType == ECiFGameObjectType::ITEM ? Cast<UCiFItem>(go) : nullptr;
 }
 
 UCiFKnowledge* UCiFManager::getKnowledgeByName(const FName name) const
 {
-	auto knowledge = mKnowledgeArray.FindByPredicate([=](const UCiFKnowledge* k) {
-		return k->mObjectName == name;
-	});
-	if (knowledge) return *knowledge;
-	return nullptr;
+	const auto go = getGameObjectByName(name);
+	return go && go->mGameObjectType == ECiFGameObjectType::KNOWLEDGE ? Cast<UCiFKnowledge>(go) : nullptr;
 }
 
 UCiFSocialNetwork* UCiFManager::getSocialNetworkByType(const ESocialNetworkType type) const
@@ -26,7 +26,7 @@ float UCiFMicrotheory::score(UCiFCharacter* initiator,
 	const TArray<UCiFGameObject*> possibleOthers = others.Num() > 0 ? others : static_cast<TArray<UCiFGameObject*>>(cifManager->mCast->mCharacters);
 	float totalScore = 0;
 
-	if (mDefinition->isRoleRequired("other")) {
+	if (mDefinition->isOtherRequired()) {
 		// TODO: there is no micro-theory definition that requires other or any IR inside a MT that requires it... can be deleted
 		// if the definition is about an other, if it is true for even one other, run the micro-theory
 		for (const auto other : possibleOthers) {
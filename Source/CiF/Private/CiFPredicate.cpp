@@ -4,6 +4,7 @@
 #include "CiFPredicate.h"
 
 #include "CiFCast.h"
+#include "CiFDifferentialTester.h"
 #include "CiFManager.h"
 #include "CiFRule.h"
 #include "CiFSocialExchange.h"
@@ -24,18 +25,30 @@ bool UCiFPredicate::evaluate(const UCiFGameObject* c1, const UCiFGameObject* c2,
 {
 	const UCiFManager* cifManager = GetWorld()->GetGameInstance()->GetSubsystem<UCiFSubsystem>()->getInstance();
 
+	const bool result = evaluateInternal(cifManager, c1, c2, c3, se);
+	if (cifManager->mDifferentialTester && cifManager->mDifferentialTester->isActive()) {
+		cifManager->mDifferentialTester->checkPredicate(this, c1, c2, c3, se, result);
+	}
+	return result;
+}
+
+bool UCiFPredicate::evaluateInternal(const UCiFManager* cifManager,
+                                     const UCiFGameObject* c1,
+                                     const UCiFGameObject* c2,
+                                     const UCiFGameObject* c3,
+                                     const UCiFSocialExchange* se)
+{
 	/**
 	 * Need to determine if the predicate's predicate variables reference
 	 * roles (initiator,responder), generic variables (x,y,z), or 
 	 * characters (edward, karen).
 	 */
 
-	// if Primary is not a reference to a game object, determine if it
-	// is either a role or a generic variable
-	UCiFGameObject* first = cifManager->getGameObjectByName(mPrimary);
-	UCiFGameObject* second = cifManager->getGameObjectByName(mSecondary);
-	UCiFGameObject* third = cifManager->getGameObjectByName(mTertiary);
-	determinePredicatesVars(first, second, third, const_cast<UCiFGameObject*>(c1), const_cast<UCiFGameObject*>(c2), const_cast<UCiFGameObject*>(c3));
+	// the slots were resolved at load to either a game object, a role or a generic variable
+	UCiFGameObject* first = nullptr;
+	UCiFGameObject* second = nullptr;
+	UCiFGameObject* third = nullptr;
+	determinePredicatesVars(cifManager, first, second, third, const_cast<UCiFGameObject*>(c1), const_cast<UCiFGameObject*>(c2), const_cast<UCiFGameObject*>(c3));
 
 	/*
 	 * At this point only first has to be set. Any other bindings might
@@ -141,13 +154,12 @@ void UCiFPredicate::valuation(UCiFGameObject* x, UCiFGameObject* y, UCiFGameObje
 	 * characters (edward, karen).
 	 */
 
-	//if primary is not a reference to a character, determine if 
-	//it is either a role or a generic variable
+	// the slots were resolved at load to either a game object, a role or a generic variable
+	UCiFGameObject* first = nullptr;
+	UCiFGameObject* second = nullptr;
+	UCiFGameObject* third = nullptr;
 	const auto cifManager = GetWorld()->GetGameInstance()->GetSubsystem<UCiFSubsystem>()->getInstance();
-	auto first = cifManager->getGameObjectByName(mPrimary);
-	auto second = cifManager->getGameObjectByName(mSecondary);
-	auto third = cifManager->getGameObjectByName(mTertiary);
-	determinePredicatesVars(first, second, third, x, y, z);
+	determinePredicatesVars(cifManager, first, second, third, x, y, z);
 
 	/*
 	 * At this point only first has to be set. Any other bindings might
@@ -182,7 +194,8 @@ void UCiFPredicate::valuation(UCiFGameObject* x, UCiFGameObject* y, UCiFGameObje
 	}
 }
 
-void UCiFPredicate::determinePredicatesVars(UCiFGameObject*& first,
+void UCiFPredicate::determinePredicatesVars(const UCiFManager* cifManager,
+                                            UCiFGameObject*& first,
                                             UCiFGameObject*& second,
                                             UCiFGameObject*& third,
                                             UCiFGameObject* x,
@@ -190,46 +203,96 @@ void UCiFPredicate::determinePredicatesVars(UCiFGameObject*& first,
                                             UCiFGameObject* z) const
 {
 	if (!first) {
-		const auto val = getRoleValue(mPrimary);
-		if (val == "initiator" || val == "x") {
-			first = x;
-		}
-		else if (val == "responder" || val == "y") {
-			first = y;
-		}
-		else if (val == "other" || val == "z") {
-			first = z;
-		}
-		else {
+		first = bindSlot(cifManager, mPrimaryBinding, x, y, z);
+		if (!first) {
 			UE_LOG(LogTemp, Warning, TEXT("first variable was not bound to a character"));
 		}
 	}
 
 	if (!second) {
-		const auto val = getRoleValue(mSecondary);
-		if (val == "initiator" || val == "x") {
-			second = x;
-		}
-		else if (val == "responder" || val == "y") {
-			second = y;
-		}
-		else if (val == "other" || val == "z") {
-			second = z;
-		}
+		second = bindSlot(cifManager, mSecondaryBinding, x, y, z);
 	}
 
 	if (!third) {
-		const auto val = getRoleValue(mTertiary);
-		if (val == "initiator" || val == "x") {
-			third = x;
-		}
-		else if (val == "responder" || val == "y") {
-			third = y;
-		}
-		else if (val == "other" || val == "z") {
-			third = z;
-		}
+		third = bindSlot(cifManager, mTertiaryBinding, x, y, z);
+	}
+}
+
+UCiFGameObject* UCiFPredicate::bindSlot(const UCiFManager* cifManager, const FCiFSlotBinding& slot, UCiFGameObject* x, UCiFGameObject* y, UCiFGameObject* z) const
+{
+	if (cifManager->mIsReferenceEvaluation) {
+		return bindSlotByName(cifManager, slot.mName, x, y, z);
+	}
+
+	switch (slot.mKind) {
+		case FCiFSlotBinding::EKind::ROLE:
+		case FCiFSlotBinding::EKind::VARIABLE:
+			return slot.mIndex == 0 ? x : (slot.mIndex == 1 ? y : z);
+		case FCiFSlotBinding::EKind::OBJECT:
+			if (const auto go = cifManager->getGameObjectByHandle(slot.mObjectHandle)) {
+				return go;
+			}
+			slot.mObjectHandle = cifManager->getGameObjectHandle(slot.mName);
+			return cifManager->getGameObjectByHandle(slot.mObjectHandle);
+		default:
+			return nullptr;
+	}
+}
+
+UCiFGameObject* UCiFPredicate::bindSlotByName(const UCiFManager* cifManager, const FName slotName, UCiFGameObject* x, UCiFGameObject* y, UCiFGameObject* z) const
+{
+	if (slotName.IsNone()) {
+		return nullptr;
+	}
+
+	const auto val = getRoleValue(slotName);
+	if (val == "initiator" || val == "x") {
+		return x;
+	}
+	if (val == "responder" || val == "y") {
+		return y;
+	}
+	if (val == "other" || val == "z") {
+		return z;
+	}
+	return cifManager->getGameObjectByName(val);
+}
+
+void UCiFPredicate::updateBindings()
+{
+	mPrimaryBinding = resolveSlotBinding(mPrimary);
+	mSecondaryBinding = resolveSlotBinding(mSecondary);
+	mTertiaryBinding = resolveSlotBinding(mTertiary);
+}
+
+FCiFSlotBinding UCiFPredicate::resolveSlotBinding(const FName slotName)
+{
+	FCiFSlotBinding binding;
+	binding.mName = slotName;
+	if (slotName.IsNone()) {
+		return binding;
+	}
+
+	if (slotName == "init" || slotName == "initiator" || slotName == "i") {
+		binding.mKind = FCiFSlotBinding::EKind::ROLE;
+		binding.mIndex = 0;
+	}
+	else if (slotName == "res" || slotName == "responder" || slotName == "r") {
+		binding.mKind = FCiFSlotBinding::EKind::ROLE;
+		binding.mIndex = 1;
+	}
+	else if (slotName == "o" || slotName == "oth" || slotName == "other") {
+		binding.mKind = FCiFSlotBinding::EKind::ROLE;
+		binding.mIndex = 2;
 	}
+	else if (slotName == "x" || slotName == "y" || slotName == "z") {
+		binding.mKind = FCiFSlotBinding::EKind::VARIABLE;
+		binding.mIndex = slotName == "x" ? 0 : (slotName == "y" ? 1 : 2);
+	}
+	else {
+		binding.mKind = FCiFSlotBinding::EKind::OBJECT;
+	}
+	return binding;
 }
 
 bool UCiFPredicate::evalForNumberUniquelyTrue(const UCiFGameObject* c1,
@@ -269,22 +332,12 @@ bool UCiFPredicate::evalForNumberUniquelyTrue(const UCiFGameObject* c1,
 		switch (mType) {
 			case EPredicateType::CKBENTRY:
 				{
-					TArray<FName> outArray;
-					evalCKBEntryForObjects(primaryCharacterOfConsideration, secondaryCharacterOfConsideration, outArray);
-					numTriesTrue = outArray.Num();
+					numTriesTrue = countCKBEntryForObjects(primaryCharacterOfConsideration, secondaryCharacterOfConsideration);
 					break;
 				}
 			case EPredicateType::SFDB_LABEL:
 				{
-					TArray<int> out{};
-					cifManager->mSFDB->findLabelFromValues(out,
-					                                       mSFDBLabel.type,
-					                                       primaryCharacterOfConsideration,
-					                                       secondaryCharacterOfConsideration,
-					                                       c3,
-					                                       mWindowSize,
-					                                       this);
-					numTriesTrue = out.Num();
+					numTriesTrue = countSFDBLabelUniquelyTrue(cifManager, primaryCharacterOfConsideration, secondaryCharacterOfConsideration);
 				}
 				break;
 			default:
@@ -320,26 +373,10 @@ bool UCiFPredicate::evalForNumberUniquelyTrue(const UCiFGameObject* c1,
 						break;
 					case EPredicateType::SFDB_LABEL:
 						if (mNumTimesRoleSlot == ENumTimesRoleSlot::SECOND) {
-							TArray<int> out;
-							cifManager->mSFDB->findLabelFromValues(out,
-							                                       mSFDBLabel.type,
-							                                       c,
-							                                       primaryCharacterOfConsideration,
-							                                       nullptr,
-							                                       mWindowSize,
-							                                       this);
-							numTriesTrue += out.Num();
+							numTriesTrue += countSFDBLabelUniquelyTrue(cifManager, c, primaryCharacterOfConsideration);
 						}
 						else {
-							TArray<int> out;
-							cifManager->mSFDB->findLabelFromValues(out,
-							                                       mSFDBLabel.type,
-							                                       primaryCharacterOfConsideration,
-							                                       c,
-							                                       nullptr,
-							                                       mWindowSize,
-							                                       this);
-							numTriesTrue += out.Num();
+							numTriesTrue += countSFDBLabelUniquelyTrue(cifManager, primaryCharacterOfConsideration, c);
 						}
 						break;
 					case EPredicateType::RELATIONSHIP:
@@ -356,29 +393,48 @@ bool UCiFPredicate::evalForNumberUniquelyTrue(const UCiFGameObject* c1,
 	// This is a special case for where we want to count numTimesTrue for contexts labels that don't have the nonPrimary role specified 
 	if (mType == EPredicateType::SFDB_LABEL && mIsNumTimesUniquelyTruePred) {
 		if (mNumTimesRoleSlot == ENumTimesRoleSlot::FIRST) {
-			TArray<int> out;
-			cifManager->mSFDB->findLabelFromValues(out,
-			                                       mSFDBLabel.type,
-			                                       primaryCharacterOfConsideration,
-			                                       nullptr,
-			                                       nullptr,
-			                                       mWindowSize,
-			                                       this);
-			numTriesTrue += out.Num();
+			numTriesTrue += countSFDBLabelUniquelyTrue(cifManager, primaryCharacterOfConsideration, nullptr);
 		}
 	}
 
 	return numTriesTrue >= mNumTimesUniquelyTrue;
 }
 
+int32 UCiFPredicate::countSFDBLabelUniquelyTrue(const UCiFManager* cifManager, const UCiFGameObject* first, const UCiFGameObject* second) const
+{
+	if (cifManager->mIsReferenceEvaluation) {
+		TArray<int> out;
+		cifManager->mSFDB->findLabelFromValues(out, mSFDBLabel.type, first, second, nullptr, mWindowSize, this);
+		return out.Num();
+	}
+	return cifManager->mSFDB->countLabelsInWindow(mSFDBLabel.type, first, second, mWindowSize);
+}
+
 void UCiFPredicate::evalCKBEntryForObjects(const UCiFGameObject* first, const UCiFGameObject* second, TArray<FName>& outArray) const
 {
 	const UCiFManager* cifManager = UGameplayStatics::GetGameInstance(GetWorld())->GetSubsystem<UCiFSubsystem>()->getInstance();
 	auto ckb = cifManager->mCKB;
 
+	if (!cifManager->mIsReferenceEvaluation) {
+		const auto& firstBits = ckb->getItemBits(first->mObjectName, mFirstSubjectiveLink, mTruthLabel);
+		if (second && mSecondSubjectiveLink != ESubjectiveLabel::INVALID) {
+			const auto& secondBits = ckb->getItemBits(second->mObjectName, mSecondSubjectiveLink, mTruthLabel);
+			const auto commonBits = TBitArray<>::BitwiseAND(firstBits, secondBits, EBitwiseOperatorFlags::MinSize);
+			for (TConstSetBitIterator<> it(commonBits); it; ++it) {
+				outArray.Add(ckb->getItemName(it.GetIndex()));
+			}
+		}
+		else {
+			for (TConstSetBitIterator<> it(firstBits); it; ++it) {
+				outArray.Add(ckb->getItemName(it.GetIndex()));
+			}
+		}
+		return;
+	}
+
 	if (!second) {
 		//determine if the single character constraints results in a match
-		ckb->findItems(first->mObjectName, outArray, mFirstSubjectiveLink, mTruthLabel);
+		ckb->findItemsByScan(first->mObjectName, outArray, mFirstSubjectiveLink, mTruthLabel);
 	}
 	else {
 		TArray<FName> firstResults;
@@ -386,7 +442,7 @@ void UCiFPredicate::evalCKBEntryForObjects(const UCiFGameObject* first, const UC
 
 		//determine if the two character constraints result in a match
 		//1. find first matches
-		ckb->findItems(first->mObjectName, firstResults, mFirstSubjectiveLink, mTruthLabel);
+		ckb->findItemsByScan(first->mObjectName, firstResults, mFirstSubjectiveLink, mTruthLabel);
 
 		if (mSecondSubjectiveLink == ESubjectiveLabel::INVALID) {
 			outArray = firstResults;
@@ -394,7 +450,7 @@ void UCiFPredicate::evalCKBEntryForObjects(const UCiFGameObject* first, const UC
 		}
 
 		//2. find second matches
-		ckb->findItems(second->mObjectName, secondResults, mSecondSubjectiveLink, mTruthLabel);
+		ckb->findItemsByScan(second->mObjectName, secondResults, mSecondSubjectiveLink, mTruthLabel);
 		//3. see if any of first's matches intersect second's matches.
 		for (int32 i = 0; i < firstResults.Num(); ++i) {
 			for (int32 j = 0; j < secondResults.Num(); ++j) {
@@ -406,6 +462,23 @@ void UCiFPredicate::evalCKBEntryForObjects(const UCiFGameObject* first, const UC
 	}
 }
 
+int32 UCiFPredicate::countCKBEntryForObjects(const UCiFGameObject* first, const UCiFGameObject* second) const
+{
+	const UCiFManager* cifManager = UGameplayStatics::GetGameInstance(GetWorld())->GetSubsystem<UCiFSubsystem>()->getInstance();
+	if (cifManager->mIsReferenceEvaluation) {
+		TArray<FName> outArray;
+		evalCKBEntryForObjects(first, second, outArray);
+		return outArray.Num();
+	}
+
+	const auto ckb = cifManager->mCKB;
+	const auto& firstBits = ckb->getItemBits(first->mObjectName, mFirstSubjectiveLink, mTruthLabel);
+	if (second && mSecondSubjectiveLink != ESubjectiveLabel::INVALID) {
+		return UCiFCulturalKnowledgeBase::countCommonItems(firstBits, ckb->getItemBits(second->mObjectName, mSecondSubjectiveLink, mTruthLabel));
+	}
+	return firstBits.CountSetBits();
+}
+
 bool UCiFPredicate::evalTrait(const UCiFGameObject* first) const
 {
 	return first->hasTrait(mTrait);
@@ -493,18 +566,28 @@ bool UCiFPredicate::evalCKBEntry(const UCiFGameObject* first, const UCiFGameObje
 {
 	const UCiFManager* cifManager = UGameplayStatics::GetGameInstance(GetWorld())->GetSubsystem<UCiFSubsystem>()->getInstance();
 
+	if (!cifManager->mIsReferenceEvaluation) {
+		const auto& firstBits = cifManager->mCKB->getItemBits(first->mObjectName, mFirstSubjectiveLink, mTruthLabel);
+		if (!second) {
+			return firstBits.Find(true) != INDEX_NONE;
+		}
+		// the second character is matched with the first link as well, like the reference below
+		const auto& secondBits = cifManager->mCKB->getItemBits(second->mObjectName, mFirstSubjectiveLink, mTruthLabel);
+		return UCiFCulturalKnowledgeBase::countCommonItems(firstBits, secondBits) > 0;
+	}
+
 	if (!second) {
 		// determine if the single character constraints result in a match
 		TArray<FName> outputItems;
-		cifManager->mCKB->findItems(first->mObjectName, outputItems, mFirstSubjectiveLink, mTruthLabel);
+		cifManager->mCKB->findItemsByScan(first->mObjectName, outputItems, mFirstSubjectiveLink, mTruthLabel);
 		return outputItems.Num() > 0;
 	}
 
 	// determine if the two character constraints result in a match
 	TArray<FName> firstItems;
-	cifManager->mCKB->findItems(first->mObjectName, firstItems, mFirstSubjectiveLink, mTruthLabel);
+	cifManager->mCKB->findItemsByScan(first->mObjectName, firstItems, mFirstSubjectiveLink, mTruthLabel);
 	TArray<FName> secondItems;
-	cifManager->mCKB->findItems(second->mObjectName, secondItems, mFirstSubjectiveLink, mTruthLabel);
+	cifManager->mCKB->findItemsByScan(second->mObjectName, secondItems, mFirstSubjectiveLink, mTruthLabel);
 
 	// see if first's matches intersect with second's
 	for (const auto item1 : firstItems) {
@@ -658,13 +741,10 @@ FName UCiFPredicate::getSecondaryCharacterNameFromVariables(const UCiFGameObject
                                                             const UCiFGameObject* responder,
                                                             const UCiFGameObject* other) const
 {
-	const auto roleVal = getRoleValue(mSecondary);
-
-	if (roleVal == "initiator") return initiator->mObjectName;
-	if (roleVal == "responder") return responder->mObjectName;
-	if (roleVal == "other") return other->mObjectName;
-	if (roleVal == "") return "";
-
+	if (mSecondaryBinding.mKind == FCiFSlotBinding::EKind::ROLE) {
+		const auto bound = mSecondaryBinding.mIndex == 0 ? initiator : (mSecondaryBinding.mIndex == 1 ? responder : other);
+		return bound->mObjectName;
+	}
 	return mSecondary;
 }
 
@@ -672,13 +752,10 @@ FName UCiFPredicate::getPrimaryCharacterNameFromVariables(const UCiFGameObject*
                                                           const UCiFGameObject* responder,
                                                           const UCiFGameObject* other) const
 {
-	const auto roleVal = getRoleValue(mPrimary);
-
-	if (roleVal == "initiator") return initiator->mObjectName;
-	if (roleVal == "responder") return responder->mObjectName;
-	if (roleVal == "other") return other->mObjectName;
-	if (roleVal == "") return "";
-
+	if (mPrimaryBinding.mKind == FCiFSlotBinding::EKind::ROLE) {
+		const auto bound = mPrimaryBinding.mIndex == 0 ? initiator : (mPrimaryBinding.mIndex == 1 ? responder : other);
+		return bound->mObjectName;
+	}
 	return mPrimary;
 }
 
@@ -689,6 +766,7 @@ void UCiFPredicate::setTraitPredicate(const FName first, const ETrait trait, con
 	mPrimary = first;
 	mIsNegated = isNegated;
 	mIsSFDB = isSFDB;
+	updateBindings();
 }
 
 void UCiFPredicate::setNetworkPredicate(const FName first,
@@ -707,6 +785,7 @@ void UCiFPredicate::setNetworkPredicate(const FName first,
 	mNetworkType = networkType;
 	mIsNegated = isNegated;
 	mIsSFDB = isSFDB;
+	updateBindings();
 }
 
 void UCiFPredicate::setStatusPredicate(const FName first,
@@ -723,6 +802,7 @@ void UCiFPredicate::setStatusPredicate(const FName first,
 	mStatusDuration = duration;
 	mIsNegated = isNegated;
 	mIsSFDB = isSFDB;
+	updateBindings();
 }
 
 void UCiFPredicate::setCKBPredicate(const FName first,
@@ -739,6 +819,7 @@ void UCiFPredicate::setCKBPredicate(const FName first,
 	mSecondSubjectiveLink = secondSub;
 	mTruthLabel = truth;
 	mIsNegated = isNegated;
+	updateBindings();
 }
 
 void UCiFPredicate::setSFDBLabelPredicate(const FName first,
@@ -756,6 +837,7 @@ void UCiFPredicate::setSFDBLabelPredicate(const FName first,
 	mSFDBLabel.from = first;
 	mSFDBLabel.to = second;
 	mWindowSize = window;
+	updateBindings();
 }
 
 void UCiFPredicate::setRelationshipPredicate(const FName first,
@@ -770,6 +852,7 @@ void UCiFPredicate::setRelationshipPredicate(const FName first,
 	mRelationshipType = relType;
 	mIsNegated = isNegated;
 	mIsSFDB = isSFDB;
+	updateBindings();
 }
 
 void UCiFPredicate::updateNetwork(UCiFGameObject* first, UCiFGameObject* second)
@@ -1472,6 +1555,7 @@ void UCiFPredicate::clear()
 	mSFDBOrder = 0;
 	mIsNumTimesUniquelyTruePred = false; // Flag that specifies if this is a "number of times this pred is uniquely true" type pred
 	mNumTimesRoleSlot = ENumTimesRoleSlot::INVALID;
+	updateBindings();
 }
 
 UCiFPredicate* UCiFPredicate::loadFromJson(TSharedPtr<FJsonObject> predJson, const UObject* worldContextObject)
@@ -1601,5 +1685,7 @@ UCiFPredicate* UCiFPredicate::loadFromJson(TSharedPtr<FJsonObject> predJson, con
 	p->mSFDBOrder = 0;
 	predJson->TryGetNumberField("_sfdbOrder", p->mSFDBOrder);
 
+	p->updateBindings();
+
 	return p;
 }
@@ -129,7 +129,9 @@ void UCiFProspectiveMemory::printGameScores(const TArray<FGameScore>& scores)
 void UCiFProspectiveMemory::clear()
 {
 	if (mIsCleared) {
-		UE_LOG(LogTemp, Log, TEXT("Prospective memory is already cleared"))
+		if (UCiFManager::mIsTraceLogging) {
+			UE_LOG(LogTemp, Log, TEXT("Prospective memory is already cleared"))
+		}
 		return;
 	}
 	
@@ -154,3 +156,19 @@ void UCiFProspectiveMemory::clear()
 
 	mIsCleared = true;
 }
+
+void UCiFProspectiveMemory::serializeSummary(FArchive& ar)
+{
+	ar << mIsCleared;
+	ar << mScores;
+	ar << mIntentScoreCache << mIntentPosScoreCache << mIntentNegScoreCache;
+}
+
+void UCiFProspectiveMemory::copySummary(const UCiFProspectiveMemory& other)
+{
+	mIsCleared = other.mIsCleared;
+	mScores = other.mScores;
+	mIntentScoreCache = other.mIntentScoreCache;
+	mIntentPosScoreCache = other.mIntentPosScoreCache;
+	mIntentNegScoreCache = other.mIntentNegScoreCache;
+}
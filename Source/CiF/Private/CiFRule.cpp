@@ -17,6 +17,43 @@ UCiFRule::UCiFRule()
 }
 
 bool UCiFRule::isRoleRequired(const FName role) const
+{
+	static const FName initiatorRole = "initiator";
+	static const FName responderRole = "responder";
+	static const FName otherRole = "other";
+
+	if (role == initiatorRole) return isInitiatorRequired();
+	if (role == responderRole) return isResponderRequired();
+	if (role == otherRole) return isOtherRequired();
+	return computeIsRoleRequired(role);
+}
+
+void UCiFRule::updateMetadata() const
+{
+	mRoleFlags = 0;
+	if (computeIsRoleRequired("initiator")) mRoleFlags |= ROLE_INITIATOR;
+	if (computeIsRoleRequired("responder")) mRoleFlags |= ROLE_RESPONDER;
+	if (computeIsRoleRequired("other")) mRoleFlags |= ROLE_OTHER;
+
+	mHighestSFDBOrder = 0;
+	for (const auto pred : mPredicates) {
+		if (pred->mSFDBOrder > mHighestSFDBOrder) {
+			mHighestSFDBOrder = pred->mSFDBOrder;
+		}
+	}
+
+	mIsMetadataValid = true;
+}
+
+uint8 UCiFRule::getRoleFlags() const
+{
+	if (!mIsMetadataValid) {
+		updateMetadata();
+	}
+	return mRoleFlags;
+}
+
+bool UCiFRule::computeIsRoleRequired(const FName role) const
 {
 	bool isThirdCharRequired = false;
 
@@ -110,15 +147,12 @@ void UCiFRule::toString(FString& outStr)
 	}
 }
 
-int32 UCiFRule::getHighestSFDBOrder()
+int32 UCiFRule::getHighestSFDBOrder() const
 {
-	int32 order = 0;
-	for (const auto pred : mPredicates) {
-		if (pred->mSFDBOrder > order) {
-			order = pred->mSFDBOrder;
-		}
+	if (!mIsMetadataValid) {
+		updateMetadata();
 	}
-	return order;
+	return mHighestSFDBOrder;
 }
 
 bool UCiFRule::evaluateTimeOrderedRule(UCiFGameObject* primary, UCiFGameObject* secondary, UCiFGameObject* tertiary)
@@ -204,5 +238,7 @@ UCiFRule* UCiFRule::loadFromJson(TSharedPtr<FJsonObject> ruleJson, const UObject
 		localRule->mPredicates.Add(predicate);
 	}
 
+	localRule->updateMetadata();
+
 	return localRule;
 }
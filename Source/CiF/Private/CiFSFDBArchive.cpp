@@ -0,0 +1,340 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CiFSFDBArchive.h"
+
+#include "CiFSocialFactsDataBase.h"
+#include "ReadWriteFiles.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFileManager.h"
+
+namespace
+{
+	/* Header of a segment in the archive file, followed by the columns of its records and then of their labels */
+	struct FSegmentHeader
+	{
+		uint32 mMagic;
+		uint32 mVersion;
+		int32 mNumRecords;
+		int32 mNumLabels;
+		int32 mMinTime;
+		int32 mMaxTime;
+		uint32 mLabelMask;
+		uint32 mReserved;
+	};
+
+	enum ERecordFlags : uint8
+	{
+		IS_BACKSTORY = 1 << 0,
+		IS_NEGATED = 1 << 1,
+		HAS_OBJECT = 1 << 2, // the record referred to an object (a change rule or a predicate), which isn't archived
+	};
+
+	/* @return The size of a segment in the file with its header, the columns padded as writeColumn pads them */
+	int64 getSegmentSize(const FSegmentHeader& header)
+	{
+		const auto columnSize = [](const int32 num, const int32 elementSize) { return Align(static_cast<int64>(num) * elementSize, 4); };
+		const int32 numRecords = header.mNumRecords;
+		const int32 numLabels = header.mNumLabels;
+		return sizeof(FSegmentHeader) +
+			columnSize(numRecords, sizeof(int32)) * 4 +   // times, label masks, first labels and numbers of labels
+			columnSize(numRecords, sizeof(IdType)) +
+			columnSize(numRecords, sizeof(uint16)) * 3 +  // initiators, responders and others
+			columnSize(numRecords, sizeof(uint8)) * 2 +   // types and flags
+			columnSize(numLabels, sizeof(uint16)) * 2 +   // label from and to
+			columnSize(numLabels, sizeof(uint8));
+	}
+
+	/* Appends a column to the segment data, padded so the next column is 4 byte aligned */
+	template <typename T>
+	void writeColumn(TArray<uint8>& data, const TArray<T>& column)
+	{
+		data.Append(reinterpret_cast<const uint8*>(column.GetData()), column.Num() * sizeof(T));
+		data.SetNumZeroed(Align(data.Num(), 4));
+	}
+
+	/* Views of the columns of a segment in the mapped file, in the order writeColumn wrote them */
+	struct FSegmentColumns
+	{
+		explicit FSegmentColumns(const uint8* segmentData)
+		{
+			const auto header = reinterpret_cast<const FSegmentHeader*>(segmentData);
+			const int32 numRecords = header->mNumRecords;
+			const int32 numLabels = header->mNumLabels;
+
+			const uint8* cursor = segmentData + sizeof(FSegmentHeader);
+			readColumn(cursor, mTimes, numRecords);
+			readColumn(cursor, mIds, numRecords);
+			readColumn(cursor, mLabelMasks, numRecords);
+			readColumn(cursor, mFirstLabels, numRecords);
+			readColumn(cursor, mNumLabels, numRecords);
+			readColumn(cursor, mInitiators, numRecords);
+			readColumn(cursor, mResponders, numRecords);
+			readColumn(cursor, mOthers, numRecords);
+			readColumn(cursor, mTypes, numRecords);
+			readColumn(cursor, mFlags, numRecords);
+			readColumn(cursor, mLabelFrom, numLabels);
+			readColumn(cursor, mLabelTo, numLabels);
+			readColumn(cursor, mLabelTypes, numLabels);
+		}
+
+		template <typename T>
+		static void readColumn(const uint8*& cursor, const T*& outColumn, const int32 num)
+		{
+			outColumn = reinterpret_cast<const T*>(cursor);
+			cursor += Align(num * sizeof(T), 4);
+		}
+
+		const int32* mTimes;
+		const IdType* mIds;
+		const uint32* mLabelMasks;
+		const int32* mFirstLabels;
+		const int32* mNumLabels;
+		const uint16* mInitiators;
+		const uint16* mResponders;
+		const uint16* mOthers;
+		const uint8* mTypes;
+		const uint8* mFlags;
+		const uint16* mLabelFrom;
+		const uint16* mLabelTo;
+		const uint8* mLabelTypes;
+	};
+}
+
+FCiFSFDBArchive::FCiFSFDBArchive() = default;
+
+// defined here, where the mapped file types are complete
+FCiFSFDBArchive::~FCiFSFDBArchive()
+{
+	unmap();
+}
+
+bool FCiFSFDBArchive::open(const FString& filePath)
+{
+	unmap();
+	mFilePath.Empty();
+	mFileSize = 0;
+	mNumRecords = 0;
+	mSegments.Empty();
+
+	if (!FFileHelper::SaveArrayToFile(TArray<uint8>(), *filePath)) {
+		UE_LOG(LogTemp, Error, TEXT("Couldn't create the SFDB archive at %s"), *filePath);
+		return false;
+	}
+
+	mFilePath = filePath;
+	return true;
+}
+
+bool FCiFSFDBArchive::reopen(const FString& filePath, const int32 numRecords)
+{
+	unmap();
+	mFilePath.Empty();
+	mFileSize = 0;
+	mNumRecords = 0;
+	mSegments.Empty();
+
+	auto& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	TUniquePtr<IFileHandle> file(platformFile.OpenRead(*filePath));
+	if (!file) {
+		UE_LOG(LogTemp, Error, TEXT("Couldn't open the SFDB archive at %s"), *filePath);
+		return false;
+	}
+
+	const int64 fileSize = file->Size();
+	int64 offset = 0;
+	int32 numIndexed = 0;
+	TArray<FCiFSFDBArchiveSegment> segments;
+	while (numIndexed < numRecords) {
+		FSegmentHeader header;
+		if (offset + static_cast<int64>(sizeof(header)) > fileSize || !file->Seek(offset) ||
+			!file->Read(reinterpret_cast<uint8*>(&header), sizeof(header)) ||
+			header.mMagic != SEGMENT_MAGIC || header.mVersion != SEGMENT_VERSION || header.mNumRecords <= 0) {
+			break;
+		}
+
+		FCiFSFDBArchiveSegment& segment = segments.AddDefaulted_GetRef();
+		segment.mOffset = offset;
+		segment.mNumRecords = header.mNumRecords;
+		segment.mNumLabels = header.mNumLabels;
+		segment.mMinTime = header.mMinTime;
+		segment.mMaxTime = header.mMaxTime;
+		segment.mLabelMask = header.mLabelMask;
+
+		offset += getSegmentSize(header);
+		numIndexed += header.mNumRecords;
+	}
+	file.Reset();
+
+	if (numIndexed != numRecords || offset > fileSize) {
+		UE_LOG(LogTemp, Error, TEXT("The SFDB archive at %s doesn't hold the %d records it should"), *filePath, numRecords);
+		return false;
+	}
+
+	// the records archived after the state was saved aren't part of its history
+	if (offset < fileSize) {
+		TUniquePtr<IFileHandle> writeFile(platformFile.OpenWrite(*filePath, true, true));
+		if (!writeFile || !writeFile->Truncate(offset)) {
+			UE_LOG(LogTemp, Error, TEXT("Couldn't cut the SFDB archive at %s back to %d records"), *filePath, numRecords);
+			return false;
+		}
+	}
+
+	mFilePath = filePath;
+	mFileSize = offset;
+	mNumRecords = numIndexed;
+	mSegments = MoveTemp(segments);
+	return true;
+}
+
+bool FCiFSFDBArchive::append(TArrayView<const FCiFSFDBRecord> records, const TArray<FCiFSFDBRecordLabel>& labels)
+{
+	if (!isOpen()) {
+		UE_LOG(LogTemp, Error, TEXT("Appending to an SFDB archive that isn't open"));
+		return false;
+	}
+	if (records.IsEmpty()) {
+		return true;
+	}
+
+	FCiFSFDBArchiveSegment segment;
+	segment.mOffset = mFileSize;
+	segment.mNumRecords = records.Num();
+	segment.mMinTime = records[0].mTime;
+	segment.mMaxTime = records.Last().mTime;
+
+	TArray<int32> times, firstLabels, numLabels;
+	TArray<IdType> ids;
+	TArray<uint32> labelMasks;
+	TArray<uint16> initiators, responders, others, labelFrom, labelTo;
+	TArray<uint8> types, flags, labelTypes;
+	for (const auto& record : records) {
+		times.Add(record.mTime);
+		ids.Add(record.mId);
+		labelMasks.Add(record.mLabelMask);
+		firstLabels.Add(labelFrom.Num());
+		numLabels.Add(record.mNumLabels);
+		initiators.Add(record.mInitiator);
+		responders.Add(record.mResponder);
+		others.Add(record.mOther);
+		types.Add(static_cast<uint8>(record.mType));
+		flags.Add((record.mIsBackstory ? IS_BACKSTORY : 0) |
+			(record.mIsNegated ? IS_NEGATED : 0) |
+			(record.mObjectIndex != INDEX_NONE ? HAS_OBJECT : 0));
+
+		for (int32 i = record.mFirstLabel; i < record.mFirstLabel + record.mNumLabels; i++) {
+			labelFrom.Add(labels[i].mFrom);
+			labelTo.Add(labels[i].mTo);
+			labelTypes.Add(static_cast<uint8>(labels[i].mType));
+		}
+		segment.mLabelMask |= record.mLabelMask;
+	}
+	segment.mNumLabels = labelFrom.Num();
+
+	const FSegmentHeader header{
+		SEGMENT_MAGIC, SEGMENT_VERSION, segment.mNumRecords, segment.mNumLabels, segment.mMinTime, segment.mMaxTime, segment.mLabelMask, 0
+	};
+	TArray<uint8> data;
+	data.Append(reinterpret_cast<const uint8*>(&header), sizeof(header));
+	writeColumn(data, times);
+	writeColumn(data, ids);
+	writeColumn(data, labelMasks);
+	writeColumn(data, firstLabels);
+	writeColumn(data, numLabels);
+	writeColumn(data, initiators);
+	writeColumn(data, responders);
+	writeColumn(data, others);
+	writeColumn(data, types);
+	writeColumn(data, flags);
+	writeColumn(data, labelFrom);
+	writeColumn(data, labelTo);
+	writeColumn(data, labelTypes);
+
+	// the mapping only covers the file as it was, the next query maps it again
+	unmap();
+	if (!UReadWriteFiles::appendBytesToFile(mFilePath, data)) {
+		return false;
+	}
+
+	mFileSize += data.Num();
+	mNumRecords += records.Num();
+	mSegments.Add(segment);
+	return true;
+}
+
+void FCiFSFDBArchive::forEachRecord(const uint32 labelMask,
+                                    const bool isNewestFirst,
+                                    TFunctionRef<bool(const FCiFSFDBRecord&, TArrayView<const FCiFSFDBRecordLabel>)> visitor) const
+{
+	if (mSegments.IsEmpty()) {
+		return;
+	}
+	const uint8* fileData = map();
+	if (!fileData) {
+		return;
+	}
+
+	// records without labels (statuses) are only visited when all the records are
+	const bool isAllRecords = labelMask == ~0u;
+	TArray<FCiFSFDBRecordLabel, TInlineAllocator<8>> labels;
+
+	for (int32 s = 0; s < mSegments.Num(); s++) {
+		const auto& segment = mSegments[isNewestFirst ? mSegments.Num() - 1 - s : s];
+		if (!isAllRecords && (segment.mLabelMask & labelMask) == 0) {
+			continue;
+		}
+
+		const FSegmentColumns columns(fileData + segment.mOffset);
+		for (int32 r = 0; r < segment.mNumRecords; r++) {
+			const int32 i = isNewestFirst ? segment.mNumRecords - 1 - r : r;
+			if (!isAllRecords && (columns.mLabelMasks[i] & labelMask) == 0) {
+				continue;
+			}
+
+			FCiFSFDBRecord record;
+			record.mTime = columns.mTimes[i];
+			record.mType = static_cast<ESFDBContextType>(columns.mTypes[i]);
+			record.mIsBackstory = (columns.mFlags[i] & IS_BACKSTORY) != 0;
+			record.mIsNegated = (columns.mFlags[i] & IS_NEGATED) != 0;
+			record.mInitiator = columns.mInitiators[i];
+			record.mResponder = columns.mResponders[i];
+			record.mOther = columns.mOthers[i];
+			record.mId = columns.mIds[i];
+			record.mObjectIndex = (columns.mFlags[i] & HAS_OBJECT) != 0 ? UNARCHIVED_OBJECT_INDEX : INDEX_NONE;
+			record.mLabelMask = columns.mLabelMasks[i];
+			record.mNumLabels = columns.mNumLabels[i];
+
+			labels.Reset();
+			for (int32 l = columns.mFirstLabels[i]; l < columns.mFirstLabels[i] + record.mNumLabels; l++) {
+				labels.Add({columns.mLabelFrom[l], columns.mLabelTo[l], static_cast<ESFDBLabelType>(columns.mLabelTypes[l])});
+			}
+
+			if (!visitor(record, labels)) {
+				return;
+			}
+		}
+	}
+}
+
+const uint8* FCiFSFDBArchive::map() const
+{
+	if (!mMappedRegion) {
+		mMappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*mFilePath));
+		if (mMappedFile) {
+			mMappedRegion.Reset(mMappedFile->MapRegion(0, mFileSize));
+		}
+		if (!mMappedRegion) {
+			UE_LOG(LogTemp, Error, TEXT("Couldn't map the SFDB archive at %s"), *mFilePath);
+			mMappedFile.Reset();
+			return nullptr;
+		}
+	}
+	return mMappedRegion->GetMappedPtr();
+}
+
+void FCiFSFDBArchive::unmap() const
+{
+	// the region has to be released before the file handle
+	mMappedRegion.Reset();
+	mMappedFile.Reset();
+}
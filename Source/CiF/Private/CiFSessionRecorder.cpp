@@ -0,0 +1,389 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CiFSessionRecorder.h"
+
+#include "CiFCharacter.h"
+#include "CiFEffect.h"
+#include "CiFGameObject.h"
+#include "CiFGameObjectStatus.h"
+#include "CiFIntentScheduler.h"
+#include "CiFManager.h"
+#include "CiFRelationshipNetwork.h"
+#include "CiFSocialExchange.h"
+#include "CiFSocialExchangeContext.h"
+#include "CiFSocialExchangesLibrary.h"
+#include "CiFSocialNetwork.h"
+#include "ReadWriteFiles.h"
+
+void UCiFSessionRecorder::init(UCiFManager* cifManager)
+{
+	mCifManager = cifManager;
+}
+
+void UCiFSessionRecorder::startRecording(const int32 seed)
+{
+	checkf(mCifManager != nullptr, TEXT("Session recorder wasn't initialized with a CiF manager"));
+	if (mActiveRecorder && mActiveRecorder != this) {
+		UE_LOG(LogTemp, Warning, TEXT("Another session recorder is already recording, stopping it"));
+		mActiveRecorder->stopRecording();
+	}
+
+	mEvents.Reset();
+	mSeed = seed;
+	mStartTime = mCifManager->mTime;
+	mCifManager->setRandomSeed(seed);
+
+	mIsRecording = true;
+	mActiveRecorder = this;
+}
+
+void UCiFSessionRecorder::stopRecording()
+{
+	mIsRecording = false;
+	if (mActiveRecorder == this) {
+		mActiveRecorder = nullptr;
+	}
+}
+
+bool UCiFSessionRecorder::beginCall()
+{
+	return mCallDepth++ == 0;
+}
+
+void UCiFSessionRecorder::recordEvent(const FCiFSessionEvent& event)
+{
+	if (mIsRecording) {
+		mEvents.Add(event);
+	}
+}
+
+void UCiFSessionRecorder::namesOf(const TArray<UCiFGameObject*>& objects, TArray<FName>& outNames)
+{
+	outNames.Reserve(objects.Num());
+	for (const auto o : objects) {
+		outNames.Add(o ? o->mObjectName : NAME_None);
+	}
+}
+
+void UCiFSessionRecorder::recordContext(const UCiFSocialExchangeContext* context, FCiFSessionEvent& outEvent)
+{
+	outEvent.mExchange = context->mGameName;
+	outEvent.mInitiator = context->mInitiatorName;
+	outEvent.mResponder = context->mResponderName;
+	outEvent.mOther = context->mOtherName;
+	outEvent.mEffectId = context->mEffectId;
+	outEvent.mContextTime = context->mTime;
+	outEvent.mChosenItemCKB = context->mChosenItemCKB;
+	outEvent.mPerformanceRealization = context->mPerformanceRealization;
+	outEvent.mInitiatorScore = context->mInitiatorScore;
+	outEvent.mResponderScore = context->mResponderScore;
+	outEvent.mIsBackstory = context->mIsBackstory;
+	outEvent.mSFDBLabel = context->mSFDBLabel;
+	outEvent.mSFDBLabels = context->mSFDBLabels;
+}
+
+UCiFSocialExchangeContext* UCiFSessionRecorder::makeContext(const FCiFSessionEvent& event)
+{
+	const auto context = NewObject<UCiFSocialExchangeContext>(this);
+	context->mGameName = event.mExchange;
+	context->mInitiatorName = event.mInitiator;
+	context->mResponderName = event.mResponder;
+	context->mOtherName = event.mOther;
+	context->mEffectId = event.mEffectId;
+	context->mTime = event.mContextTime;
+	context->mChosenItemCKB = event.mChosenItemCKB;
+	context->mPerformanceRealization = event.mPerformanceRealization;
+	context->mInitiatorScore = event.mInitiatorScore;
+	context->mResponderScore = event.mResponderScore;
+	context->mIsBackstory = event.mIsBackstory;
+	context->mSFDBLabel = event.mSFDBLabel;
+	context->mSFDBLabels = event.mSFDBLabels;
+	return context;
+}
+
+void UCiFSessionRecorder::objectsOf(const TArray<FName>& names, TArray<UCiFGameObject*>& outObjects) const
+{
+	outObjects.Reserve(names.Num());
+	for (const auto& name : names) {
+		if (const auto o = mCifManager->getGameObjectByName(name)) {
+			outObjects.Add(o);
+		}
+	}
+}
+
+void UCiFSessionRecorder::BeginDestroy()
+{
+	stopRecording();
+	Super::BeginDestroy();
+}
+
+/******************************** Serialization ********************************/
+
+namespace
+{
+	TArray<TSharedPtr<FJsonValue>> namesToJson(const TArray<FName>& names)
+	{
+		TArray<TSharedPtr<FJsonValue>> out;
+		for (const auto& name : names) {
+			out.Add(MakeShared<FJsonValueString>(name.ToString()));
+		}
+		return out;
+	}
+
+	TSharedPtr<FJsonValue> labelToJson(const FSFDBLabel& label)
+	{
+		const auto json = MakeShared<FJsonObject>();
+		json->SetStringField("f", label.from.ToString());
+		json->SetStringField("t", label.to.ToString());
+		json->SetNumberField("k", static_cast<uint8>(label.type));
+		return MakeShared<FJsonValueObject>(json);
+	}
+
+	FSFDBLabel labelFromJson(const TSharedPtr<FJsonValue>& value)
+	{
+		const auto json = value->AsObject();
+		FSFDBLabel label;
+		label.from = FName(json->GetStringField("f"));
+		label.to = FName(json->GetStringField("t"));
+		label.type = static_cast<ESFDBLabelType>(json->GetIntegerField("k"));
+		return label;
+	}
+
+	void namesFromJson(const TSharedPtr<FJsonObject>& json, const FString& field, TArray<FName>& outNames)
+	{
+		const TArray<TSharedPtr<FJsonValue>>* namesJson;
+		if (json->TryGetArrayField(field, namesJson)) {
+			for (const auto& nameJson : *namesJson) {
+				outNames.Add(FName(nameJson->AsString()));
+			}
+		}
+	}
+}
+
+bool UCiFSessionRecorder::saveToFile(const FString& filePath) const
+{
+	const auto json = MakeShared<FJsonObject>();
+	json->SetNumberField("_seed", mSeed);
+	json->SetNumberField("_startTime", mStartTime);
+
+	// short keys keep the log compact - sessions can hold thousands of events
+	TArray<TSharedPtr<FJsonValue>> eventsJson;
+	for (const auto& e : mEvents) {
+		const auto eJson = MakeShared<FJsonObject>();
+		eJson->SetNumberField("t", static_cast<uint8>(e.mType));
+		eJson->SetNumberField("time", e.mTime);
+		if (!e.mExchange.IsNone()) eJson->SetStringField("se", e.mExchange.ToString());
+		if (!e.mInitiator.IsNone()) eJson->SetStringField("i", e.mInitiator.ToString());
+		if (!e.mResponder.IsNone()) eJson->SetStringField("r", e.mResponder.ToString());
+		if (!e.mOther.IsNone()) eJson->SetStringField("o", e.mOther.ToString());
+		if (!e.mOtherCast.IsEmpty()) eJson->SetArrayField("oc", namesToJson(e.mOtherCast));
+		if (!e.mLevelCast.IsEmpty()) eJson->SetArrayField("lc", namesToJson(e.mLevelCast));
+		eJson->SetNumberField("e", e.mEffectId);
+		eJson->SetNumberField("re", e.mResultEffectId);
+		if (!e.mResultOther.IsNone()) eJson->SetStringField("ro", e.mResultOther.ToString());
+		eJson->SetNumberField("k", e.mEnumValue);
+		eJson->SetNumberField("a", e.mId1);
+		eJson->SetNumberField("b", e.mId2);
+		eJson->SetNumberField("v", e.mValue);
+		eJson->SetNumberField("f", e.mFloatValue);
+		eJson->SetNumberField("s", e.mSeed);
+		if (e.mType == ECiFSessionEventType::CHANGE_SOCIAL_STATE) {
+			eJson->SetNumberField("ct", e.mContextTime);
+			if (!e.mChosenItemCKB.IsNone()) eJson->SetStringField("ck", e.mChosenItemCKB.ToString());
+			if (!e.mPerformanceRealization.IsNone()) eJson->SetStringField("pr", e.mPerformanceRealization.ToString());
+			eJson->SetNumberField("is", e.mInitiatorScore);
+			eJson->SetNumberField("rs", e.mResponderScore);
+			eJson->SetBoolField("bs", e.mIsBackstory);
+			eJson->SetField("l", labelToJson(e.mSFDBLabel));
+			TArray<TSharedPtr<FJsonValue>> labelsJson;
+			for (const auto& label : e.mSFDBLabels) {
+				labelsJson.Add(labelToJson(label));
+			}
+			eJson->SetArrayField("ls", labelsJson);
+		}
+		eventsJson.Add(MakeShared<FJsonValueObject>(eJson));
+	}
+	json->SetArrayField("Events", eventsJson);
+
+	return UReadWriteFiles::writeJson(filePath, json);
+}
+
+bool UCiFSessionRecorder::loadFromFile(const FString& filePath)
+{
+	TSharedPtr<FJsonObject> json;
+	if (!UReadWriteFiles::readJson(filePath, json)) {
+		return false;
+	}
+
+	stopRecording();
+	mEvents.Reset();
+	mSeed = json->GetIntegerField("_seed");
+	mStartTime = json->GetIntegerField("_startTime");
+
+	for (const auto& eValue : json->GetArrayField("Events")) {
+		const auto eJson = eValue->AsObject();
+		FCiFSessionEvent e;
+		e.mType = static_cast<ECiFSessionEventType>(eJson->GetIntegerField("t"));
+		e.mTime = eJson->GetIntegerField("time");
+		FString str;
+		if (eJson->TryGetStringField("se", str)) e.mExchange = FName(str);
+		if (eJson->TryGetStringField("i", str)) e.mInitiator = FName(str);
+		if (eJson->TryGetStringField("r", str)) e.mResponder = FName(str);
+		if (eJson->TryGetStringField("o", str)) e.mOther = FName(str);
+		if (eJson->TryGetStringField("ro", str)) e.mResultOther = FName(str);
+		namesFromJson(eJson, "oc", e.mOtherCast);
+		namesFromJson(eJson, "lc", e.mLevelCast);
+		e.mEffectId = eJson->GetIntegerField("e");
+		e.mResultEffectId = eJson->GetIntegerField("re");
+		e.mEnumValue = eJson->GetIntegerField("k");
+		e.mId1 = eJson->GetIntegerField("a");
+		e.mId2 = eJson->GetIntegerField("b");
+		e.mValue = eJson->GetIntegerField("v");
+		e.mFloatValue = eJson->GetNumberField("f");
+		e.mSeed = eJson->GetIntegerField("s");
+		if (e.mType == ECiFSessionEventType::CHANGE_SOCIAL_STATE) {
+			e.mContextTime = eJson->GetIntegerField("ct");
+			if (eJson->TryGetStringField("ck", str)) e.mChosenItemCKB = FName(str);
+			if (eJson->TryGetStringField("pr", str)) e.mPerformanceRealization = FName(str);
+			e.mInitiatorScore = eJson->GetIntegerField("is");
+			e.mResponderScore = eJson->GetIntegerField("rs");
+			e.mIsBackstory = eJson->GetBoolField("bs");
+			e.mSFDBLabel = labelFromJson(eJson->GetField<EJson::Object>("l"));
+			for (const auto& labelJson : eJson->GetArrayField("ls")) {
+				e.mSFDBLabels.Add(labelFromJson(labelJson));
+			}
+		}
+		mEvents.Add(e);
+	}
+
+	return true;
+}
+
+/******************************** Replay ********************************/
+
+FCiFReplayStats UCiFSessionRecorder::replay()
+{
+	checkf(mCifManager != nullptr, TEXT("Session recorder wasn't initialized with a CiF manager"));
+	FCiFReplayStats stats;
+
+	if (mIsRecording) {
+		UE_LOG(LogTemp, Error, TEXT("Can't replay a session while recording it"));
+		return stats;
+	}
+	if (mCifManager->mTime != mStartTime) {
+		UE_LOG(LogTemp, Warning, TEXT("Replaying a session recorded at time %d on a state at time %d"), mStartTime, mCifManager->mTime);
+	}
+
+	{
+		// the replay is silent and draws from the recorded seed, the game's notifications, logs and stream come back after it
+		TGuardValue<bool> notifyingGuard(mCifManager->mIsNotifyingChanges, false);
+		TGuardValue<bool> traceLoggingGuard(UCiFManager::mIsTraceLogging, false);
+		TGuardValue<int32> seedGuard(mCifManager->mRandomSeed, mCifManager->mRandomSeed);
+		TGuardValue<FRandomStream> streamGuard(mCifManager->mRandomStream, mCifManager->mRandomStream);
+		mCifManager->setRandomSeed(mSeed);
+
+		const double startTime = FPlatformTime::Seconds();
+		for (const auto& event : mEvents) {
+			replayEvent(event, stats);
+			stats.mEvents++;
+		}
+		stats.mSeconds = FPlatformTime::Seconds() - startTime;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Replayed %d events in %.3f seconds with %d divergences"), stats.mEvents, stats.mSeconds, stats.mDivergences);
+	return stats;
+}
+
+void UCiFSessionRecorder::replayEvent(const FCiFSessionEvent& event, FCiFReplayStats& stats)
+{
+	const auto initiator = mCifManager->getGameObjectByName(event.mInitiator);
+	const auto responder = mCifManager->getGameObjectByName(event.mResponder);
+	TArray<UCiFGameObject*> otherCast;
+	objectsOf(event.mOtherCast, otherCast);
+
+	switch (event.mType) {
+		case ECiFSessionEventType::FORM_INTENT_ALL:
+			mCifManager->formIntentForAll();
+			break;
+		case ECiFSessionEventType::INTENT_PASS_START:
+			mCifManager->mIntentScheduler->mExchangesPerWorkItem = event.mValue;
+			mCifManager->mIntentScheduler->startPass();
+			break;
+		case ECiFSessionEventType::INTENT_PASS_SLICE:
+			// the slices are replayed by work items, so they interleave with the other calls as they did when recorded
+			mCifManager->mIntentScheduler->runWorkItems(event.mValue);
+			break;
+		case ECiFSessionEventType::INTENT_PASS_CANCEL:
+			mCifManager->mIntentScheduler->cancelPass();
+			break;
+		case ECiFSessionEventType::FORM_INTENT:
+			mCifManager->formIntent(static_cast<UCiFCharacter*>(initiator));
+			break;
+		case ECiFSessionEventType::FORM_INTENT_SOCIAL_GAMES:
+			mCifManager->formIntentForSocialGames(static_cast<UCiFCharacter*>(initiator), responder, otherCast);
+			break;
+		case ECiFSessionEventType::PLAY_GAME: {
+			const auto sg = mCifManager->mSocialExchangesLib->getSocialExchangeByName(event.mExchange);
+			TArray<UCiFGameObject*> levelCast;
+			objectsOf(event.mLevelCast, levelCast);
+			const auto chosenEffect = event.mEffectId != CIF_INVALID_ID ? sg->getEffectById(event.mEffectId) : nullptr;
+			const auto context = mCifManager->playGame(sg, initiator, responder, nullptr, otherCast, levelCast, chosenEffect);
+			const IdType effectId = context ? context->mEffectId : CIF_INVALID_ID;
+			const FName other = context ? context->mOtherName : NAME_None;
+			if (effectId != event.mResultEffectId || other != event.mResultOther) {
+				if (stats.mDivergences == 0) {
+					UE_LOG(LogTemp, Error, TEXT("Replay diverged at time %d: %s played by %s on %s chose effect %d with %s instead of %d with %s"),
+					       event.mTime, *event.mExchange.ToString(), *event.mInitiator.ToString(), *event.mResponder.ToString(),
+					       effectId, *other.ToString(), event.mResultEffectId, *event.mResultOther.ToString());
+				}
+				stats.mDivergences++;
+			}
+			break;
+		}
+		case ECiFSessionEventType::CHANGE_SOCIAL_STATE: {
+			// the context is added to the SFDB as it is, so all of it is rebuilt from the recording
+			mCifManager->changeSocialState(makeContext(event), otherCast);
+			break;
+		}
+		case ECiFSessionEventType::FAST_FORWARD:
+			mCifManager->fastForward(event.mValue, event.mSeed, event.mInitiator);
+			break;
+		case ECiFSessionEventType::SET_NETWORK_WEIGHT:
+		case ECiFSessionEventType::ADD_NETWORK_WEIGHT:
+		case ECiFSessionEventType::MULTIPLY_NETWORK_WEIGHT: {
+			const auto type = static_cast<ESocialNetworkType>(event.mEnumValue);
+			UCiFSocialNetwork* network = type == ESocialNetworkType::RELATIONSHIP ?
+				                             mCifManager->mRelationshipNetworks :
+				                             mCifManager->getSocialNetworkByType(type);
+			if (!network) {
+				break;
+			}
+			if (event.mType == ECiFSessionEventType::SET_NETWORK_WEIGHT) {
+				network->setWeight(event.mId1, event.mId2, event.mValue);
+			}
+			else if (event.mType == ECiFSessionEventType::ADD_NETWORK_WEIGHT) {
+				network->addWeight(event.mId1, event.mId2, event.mValue);
+			}
+			else {
+				network->multiplyWeight(event.mId1, event.mId2, event.mFloatValue);
+			}
+			break;
+		}
+		case ECiFSessionEventType::ADD_STATUS:
+			if (initiator) {
+				initiator->addStatus(static_cast<EStatus>(event.mEnumValue), event.mValue, event.mResponder);
+			}
+			break;
+		case ECiFSessionEventType::REMOVE_STATUS:
+			if (initiator) {
+				initiator->removeStatus(static_cast<EStatus>(event.mEnumValue), event.mResponder);
+			}
+			break;
+		case ECiFSessionEventType::UPDATE_STATUS_DURATIONS:
+			if (initiator) {
+				initiator->updateStatusDurations(event.mValue);
+			}
+			break;
+	}
+}
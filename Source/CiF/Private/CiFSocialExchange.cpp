@@ -12,8 +12,72 @@
 #include "CiFManager.h"
 #include "CiFSubsystem.h"
 #include "CiFItem.h"
+#include "CiFRelationshipNetwork.h"
 #include "CiFRule.h"
 
+static_assert(static_cast<int32>(ETrait::PLOT_POINT) < 64, "Traits don't fit the trait masks of the precondition signatures");
+static_assert(static_cast<int32>(ERelationshipType::SIZE) <= 8, "Relationships don't fit the relationship masks of the precondition signatures");
+
+namespace
+{
+	/* @return 0 or 1 if the slot is bound to the initiator or the responder, INDEX_NONE otherwise */
+	int32 getPairIndex(const FCiFSlotBinding& slot)
+	{
+		const bool isPairSlot = (slot.mKind == FCiFSlotBinding::EKind::ROLE || slot.mKind == FCiFSlotBinding::EKind::VARIABLE) && slot.mIndex < 2;
+		return isPairSlot ? slot.mIndex : INDEX_NONE;
+	}
+}
+
+FCiFPairSignature FCiFPairSignature::make(const UCiFManager* cifManager, const UCiFGameObject* initiator, const UCiFGameObject* responder)
+{
+	FCiFPairSignature pair;
+	for (const auto trait : initiator->mTraits) {
+		pair.mTraits[0] |= 1ull << static_cast<uint8>(trait);
+	}
+	for (const auto trait : responder->mTraits) {
+		pair.mTraits[1] |= 1ull << static_cast<uint8>(trait);
+	}
+	// relationship predicates are false between anything that isn't a character
+	if (initiator->mGameObjectType == ECiFGameObjectType::CHARACTER && responder->mGameObjectType == ECiFGameObjectType::CHARACTER) {
+		pair.mRelationships[0] = cifManager->mRelationshipNetworks->getWeight(initiator->mNetworkId, responder->mNetworkId);
+		pair.mRelationships[1] = cifManager->mRelationshipNetworks->getWeight(responder->mNetworkId, initiator->mNetworkId);
+	}
+	return pair;
+}
+
+void FCiFPreconditionSignature::addRule(const UCiFRule* rule)
+{
+	// time ordered rules are evaluated against the history only
+	if (rule->getHighestSFDBOrder() > 0) {
+		return;
+	}
+
+	for (const auto pred : rule->mPredicates) {
+		if (pred->mIsSFDB || pred->mIsIntent || pred->mIsNumTimesUniquelyTruePred) {
+			continue;
+		}
+
+		const int32 first = getPairIndex(pred->mPrimaryBinding);
+		if (first == INDEX_NONE) {
+			continue;
+		}
+
+		if (pred->mType == EPredicateType::TRAIT) {
+			const uint64 trait = 1ull << static_cast<uint8>(pred->mTrait);
+			(pred->mIsNegated ? mForbiddenTraits : mRequiredTraits)[first] |= trait;
+		}
+		else if (pred->mType == EPredicateType::RELATIONSHIP) {
+			// the relationship bits of the pair are kept in both directions, the first slot picks which one
+			const int32 second = getPairIndex(pred->mSecondaryBinding);
+			if (second == INDEX_NONE || second == first) {
+				continue;
+			}
+			const uint8 relationship = 1u << static_cast<uint8>(pred->mRelationshipType);
+			(pred->mIsNegated ? mForbiddenRelationships : mRequiredRelationships)[first] |= relationship;
+		}
+	}
+}
+
 void UCiFSocialExchange::addEffect(UCiFEffect* effect)
 {
 	// todo - in PW they implemented it by cloning the effect, why can't i use the one sent here?
@@ -88,7 +152,7 @@ float UCiFSocialExchange::scoreSocialExchange(UCiFCharacter* initiator,
 						// if the score is the same, just randomly pick between the 2 so the
 						// behavior will be more dynamic
 						if (localScore == totalScore) {
-							bestOther = FMath::RandRange(0, 1) == 1 ? other : bestOther;
+							bestOther = cifManager->getRandomStream().RandRange(0, 1) == 1 ? other : bestOther;
 						}
 						else {
 							bestOther = other;
@@ -125,14 +189,7 @@ bool UCiFSocialExchange::checkPreconditionsVariableOther(UCiFCharacter* initiato
 	auto cifManager = GetWorld()->GetGameInstance()->GetSubsystem<UCiFSubsystem>()->getInstance();
 	auto possibleOthers = activeOtherCast.IsEmpty() ? TArray<UCiFGameObject*>(cifManager->mCast->mCharacters) : activeOtherCast;
 
-	bool requiresOther = false;
-	for (const auto precond : mPreconditions) {
-		if (precond->isRoleRequired("other")) {
-			requiresOther = true;
-		}
-	}
-
-	if (requiresOther) {
+	if (mIsOtherRequiredByPreconditions) {
 		for (const auto other : possibleOthers) {
 			bool isOtherSuitable = true;
 
@@ -185,43 +242,56 @@ bool UCiFSocialExchange::checkIntents(UCiFCharacter* initiator, UCiFGameObject*
 	return true;
 }
 
-bool UCiFSocialExchange::isThirdNeededForIntentFormation()
+bool UCiFSocialExchange::isThirdNeededForIntentFormation() const
 {
-	// checks in any of the members that can contain a third party if it is required
-	
-	for (const auto precond : mPreconditions) {
-		if (precond->isRoleRequired("other")) return true;
-	}
+	return mIsThirdNeededForIntentFormation;
+}
 
-	for (const auto ir : mInitiatorIR->mInfluenceRules) {
-		if (ir->isRoleRequired("other")) return true;
-	}
+bool UCiFSocialExchange::isThirdForSocialExchangePlay() const
+{
+	return mIsThirdForPlay;
+}
 
-	for (const auto ir : mResponderIR->mInfluenceRules) {
-		if (ir->isRoleRequired("other")) return true;
-	}
+void UCiFSocialExchange::updateMetadata()
+{
+	updateRequiresOther();
+
+	// for now, intents of a SG have 1 rule in them with 1 predicate, so accessing it like this is ok.
+	mIntentType = (!mIntents.IsEmpty() && !mIntents[0]->mPredicates.IsEmpty()) ?
+		              mIntents[0]->mPredicates[0]->getIntentType() :
+		              EIntentType::INVALID;
 
+	mIsThirdForPlay = false;
 	for (const auto e : mEffects) {
-		if (e->mCondition->isRoleRequired("other")) return true;
-		if (e->mChange->isRoleRequired("other")) return true;
+		mIsThirdForPlay = mIsThirdForPlay || e->isOtherRequired();
 	}
 
-	return false;
-}
+	mIsOtherRequiredByPreconditions = false;
+	for (const auto precond : mPreconditions) {
+		mIsOtherRequiredByPreconditions = mIsOtherRequiredByPreconditions || precond->isOtherRequired();
+	}
 
-bool UCiFSocialExchange::isThirdForSocialExchangePlay()
-{
-	for (const auto e : mEffects) {
-		if (e->mCondition->isRoleRequired("other") || e->mChange->isRoleRequired("other"))
-			return true;
+	mPreconditionSignature = FCiFPreconditionSignature();
+	if (!mIsOtherRequiredByPreconditions) {
+		for (const auto precond : mPreconditions) {
+			mPreconditionSignature.addRule(precond);
+		}
+	}
+
+	// checks in any of the members that can contain a third party if it is required
+	mIsThirdNeededForIntentFormation = mIsThirdForPlay || mIsOtherRequiredByPreconditions;
+	for (const auto ir : mInitiatorIR->mInfluenceRules) {
+		mIsThirdNeededForIntentFormation = mIsThirdNeededForIntentFormation || ir->isOtherRequired();
+	}
+	for (const auto ir : mResponderIR->mInfluenceRules) {
+		mIsThirdNeededForIntentFormation = mIsThirdNeededForIntentFormation || ir->isOtherRequired();
 	}
-	return false;
 }
 
 void UCiFSocialExchange::updateRequiresOther()
 {
 	for (const auto precond : mPreconditions) {
-		mIsRequiresOther = mIsRequiresOther || precond->isRoleRequired("other");
+		mIsRequiresOther = mIsRequiresOther || precond->isOtherRequired();
 	}
 }
 
@@ -258,6 +328,9 @@ void UCiFSocialExchange::getPossibleOthers(TArray<UCiFGameObject*>& outOthers, c
 			}
 		}
 	}
+	if (!UCiFManager::mIsTraceLogging) {
+		return;
+	}
 	if (outOthers.IsEmpty()) {
 		UE_LOG(LogTemp, Log, TEXT("Didn't find any others for %s"), *(mName.ToString()));
 	}
@@ -268,8 +341,7 @@ void UCiFSocialExchange::getPossibleOthers(TArray<UCiFGameObject*>& outOthers, c
 
 EIntentType UCiFSocialExchange::getSocialExchangeIntentType() const
 {
-	// for now, intents of a SG have 1 rule in them with 1 predicate, so accessing it like this is ok.
-	return mIntents[0]->mPredicates[0]->getIntentType(); 
+	return mIntentType;
 }
 
 UCiFSocialExchange* UCiFSocialExchange::loadFromJson(const TSharedPtr<FJsonObject> sgJson, const UObject* worldContextObject)
@@ -321,7 +393,7 @@ UCiFSocialExchange* UCiFSocialExchange::loadFromJson(const TSharedPtr<FJsonObjec
 
 	// TODO - before saving, sort all the predicates in all rules - for optimizations i assume
 
-	sg->updateRequiresOther();
+	sg->updateMetadata();
 
 	return sg;
 }
@@ -13,24 +13,76 @@
 
 void UCiFSocialExchangesLibrary::addSocialExchange(UCiFSocialExchange* se)
 {
-	mSocialExchanges[se->mName] = se;
+	if (const auto index = mIndicesByName.Find(se->mName)) {
+		mSocialExchanges[*index] = se;
+		se->mIndex = *index;
+		mDescriptors[*index] = makeDescriptor(se);
+		mPreconditionSignatures[*index] = se->getPreconditionSignature();
+		return;
+	}
+
+	se->mIndex = mSocialExchanges.Add(se);
+	mDescriptors.Add(makeDescriptor(se));
+	mPreconditionSignatures.Add(se->getPreconditionSignature());
+	mIndicesByName.Add(se->mName, se->mIndex);
 }
 
 void UCiFSocialExchangesLibrary::removeSocialExchange(UCiFSocialExchange* se)
 {
-	mSocialExchanges.Remove(se->mName);
+	int32 index;
+	if (!mIndicesByName.RemoveAndCopyValue(se->mName, index)) {
+		return;
+	}
+
+	mSocialExchanges.RemoveAt(index);
+	mDescriptors.RemoveAt(index);
+	mPreconditionSignatures.RemoveAt(index);
+	updateIndices(index);
+	se->mIndex = INDEX_NONE;
 }
 
 UCiFSocialExchange* UCiFSocialExchangesLibrary::getSocialExchangeByName(const FName name)
 {
-	auto se = mSocialExchanges.Find(name);
-	if (se)
+	auto index = mIndicesByName.Find(name);
+	if (index)
 	{
-		return *se;
+		return mSocialExchanges[*index];
 	}
 	return nullptr;
 }
 
+void UCiFSocialExchangesLibrary::updateIndices(const int32 firstIndex)
+{
+	for (int32 i = firstIndex; i < mSocialExchanges.Num(); i++) {
+		const auto se = mSocialExchanges[i];
+		se->mIndex = i;
+		mDescriptors[i] = makeDescriptor(se);
+		mIndicesByName[se->mName] = i;
+	}
+}
+
+FCiFSocialExchangeDescriptor UCiFSocialExchangesLibrary::makeDescriptor(const UCiFSocialExchange* se)
+{
+	FCiFSocialExchangeDescriptor descriptor;
+	descriptor.mIntentType = se->getSocialExchangeIntentType();
+	descriptor.mResponderType = se->mResponderType;
+	descriptor.mFlags = ECiFSocialExchangeFlags::NONE;
+	if (se->isOtherRequiredByPreconditions()) {
+		descriptor.mFlags |= ECiFSocialExchangeFlags::PRECONDITIONS_REQUIRE_OTHER;
+	}
+	if (se->isThirdForSocialExchangePlay()) {
+		descriptor.mFlags |= ECiFSocialExchangeFlags::THIRD_NEEDED_FOR_PLAY;
+	}
+	return descriptor;
+}
+
+const FCiFSocialExchangeDescriptor& UCiFSocialExchangesLibrary::getDescriptor(const UCiFSocialExchange* se) const
+{
+	checkf(mSocialExchanges.IsValidIndex(se->mIndex) && mSocialExchanges[se->mIndex] == se,
+	       TEXT("Social exchange %s isn't in the social exchanges library"), *se->mName.ToString());
+	return mDescriptors[se->mIndex];
+}
+
 void UCiFSocialExchangesLibrary::loadSocialGamesLibFromJson(const FString& jsonPath, const UObject* worldContextObject)
 {
 	TSharedPtr<FJsonObject> jsonObject;
@@ -52,7 +104,7 @@ void UCiFSocialExchangesLibrary::loadSocialGamesLibFromJson(const FString& jsonP
 				t->mReferenceAsNLG = e->mReferenceAsNLG;
 				t->mCondition = e->mCondition;
 				t->mChange = e->mChange;
-				cifManager->mSFDB->mTriggers.Add(t);
+				cifManager->mSFDB->addTrigger(t);
 			}
 		}
 		else if (sg->mName == "StoryTriggerGame") {
@@ -65,7 +117,7 @@ void UCiFSocialExchangesLibrary::loadSocialGamesLibFromJson(const FString& jsonP
 			}
 		}
 		else {
-			mSocialExchanges.Add(sg->mName, sg);
+			addSocialExchange(sg);
 		}
 	}
 }
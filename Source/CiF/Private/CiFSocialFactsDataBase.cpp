@@ -3,25 +3,116 @@
 
 #include "CiFSocialFactsDataBase.h"
 
+#include "CiFDifferentialTester.h"
+#include "CiFJournal.h"
 #include "CiFManager.h"
 #include "CiFPredicate.h"
 #include "CiFRule.h"
 #include "CiFSFDBContext.h"
 #include "CiFSocialExchangeContext.h"
+#include "CiFSocialStateDiff.h"
+#include "CiFStatusContext.h"
 #include "CiFSubsystem.h"
 #include "CiFTrigger.h"
 #include "CiFTriggerContext.h"
+#include "Algo/AllOf.h"
+#include "Algo/BinarySearch.h"
 
 TMap<ESFDBLabelType, FLabelCategoryArrayWrapper> UCiFSocialFactsDataBase::mSFDBLabelCategories = UCiFSocialFactsDataBase::initializeCategoriesMap(); 
+// must be defined after mSFDBLabelCategories, it is compiled from it
+TArray<uint32> UCiFSocialFactsDataBase::mSFDBLabelMatchMasks = UCiFSocialFactsDataBase::initializeLabelMatchMasks();
+
+namespace
+{
+	/* The objects records refer to that can be written - status predicates, and change rules of status predicates */
+	enum class ERecordObjectKind : uint8
+	{
+		NONE,
+		STATUS_PREDICATE,
+		STATUS_CHANGE
+	};
+
+	/* Writes or reads a status predicate by the arguments of setStatusPredicate */
+	void serializeStatusPredicate(FArchive& ar, UCiFPredicate*& pred, UObject* outer)
+	{
+		FName primary, secondary;
+		EStatus status = {};
+		int32 duration = 0;
+		bool isSFDB = false, isNegated = false;
+		if (ar.IsSaving()) {
+			primary = pred->mPrimary;
+			secondary = pred->mSecondary;
+			status = pred->mStatusType;
+			duration = pred->mStatusDuration;
+			isSFDB = pred->mIsSFDB;
+			isNegated = pred->mIsNegated;
+		}
+		ar << primary << secondary << status << duration << isSFDB << isNegated;
+		if (ar.IsLoading()) {
+			pred = NewObject<UCiFPredicate>(outer);
+			pred->setStatusPredicate(primary, secondary, status, duration, isSFDB, isNegated);
+		}
+	}
+
+	/* Writes or reads the object of a record, objects that can't be written are read back as null */
+	void serializeRecordObject(FArchive& ar, UObject*& object, UObject* outer)
+	{
+		const auto isStatus = [](const UCiFPredicate* pred) { return pred->mType == EPredicateType::STATUS; };
+
+		auto kind = ERecordObjectKind::NONE;
+		if (ar.IsSaving()) {
+			const auto pred = Cast<UCiFPredicate>(object);
+			const auto rule = Cast<UCiFRule>(object);
+			if (pred && isStatus(pred)) {
+				kind = ERecordObjectKind::STATUS_PREDICATE;
+			}
+			else if (rule && Algo::AllOf(rule->mPredicates, isStatus)) {
+				kind = ERecordObjectKind::STATUS_CHANGE;
+			}
+			else if (object) {
+				UE_LOG(LogTemp, Warning, TEXT("SFDB record object %s isn't a status predicate or change, it isn't written"), *object->GetName());
+			}
+		}
+		ar << kind;
+
+		switch (kind) {
+			case ERecordObjectKind::STATUS_PREDICATE:
+				{
+					auto pred = Cast<UCiFPredicate>(object);
+					serializeStatusPredicate(ar, pred, outer);
+					object = pred;
+					break;
+				}
+			case ERecordObjectKind::STATUS_CHANGE:
+				{
+					const auto rule = ar.IsLoading() ? NewObject<UCiFRule>(outer) : Cast<UCiFRule>(object);
+					int32 numPredicates = rule->mPredicates.Num();
+					ar << numPredicates;
+					if (ar.IsLoading()) {
+						rule->mPredicates.SetNumZeroed(numPredicates);
+					}
+					for (auto& pred : rule->mPredicates) {
+						serializeStatusPredicate(ar, pred, outer);
+					}
+					object = rule;
+					break;
+				}
+			default:
+				if (ar.IsLoading()) {
+					object = nullptr;
+				}
+		}
+	}
+}
 
 int32 UCiFSocialFactsDataBase::getLowestContextTime() const
 {
-	return mContexts[0]->mTime;
+	return mNumFoldedRecords > 0 ? mOldestFoldedTime : mRecords[0].mTime;
 }
 
 int32 UCiFSocialFactsDataBase::getLatestContextTime() const
 {
-	return mContexts.Last()->mTime;
+	return mRecords.IsEmpty() ? mNewestFoldedTime : mRecords.Last().mTime;
 }
 
 int UCiFSocialFactsDataBase::timeOfPredicateInHistory(const UCiFPredicate* pred,
@@ -30,19 +121,38 @@ int UCiFSocialFactsDataBase::timeOfPredicateInHistory(const UCiFPredicate* pred,
                                                       const UCiFGameObject* z) const
 {
 	int latestTimeInSFDB = getLatestContextTime();
-	const int window = (pred->mIsSFDB && pred->mWindowSize > 0 && pred->mSFDBOrder < 1)
-		                   ? pred->mWindowSize
-		                   : latestTimeInSFDB + 1;
+	const bool isUnbounded = !(pred->mIsSFDB && pred->mWindowSize > 0 && pred->mSFDBOrder < 1);
+	const int window = isUnbounded ? latestTimeInSFDB + 1 : pred->mWindowSize;
+	const int32 timeToStopSearch = latestTimeInSFDB - window;
 
-	int32 i = mContexts.Num() - 1;
-	while ((i >= 0) && mContexts[i]->mTime > latestTimeInSFDB - window) {
-		if (mContexts[i]->isPredicateInChange(pred, x, y, z)) {
-			return mContexts[i]->mTime;
+	int32 i = mRecords.Num() - 1;
+	while ((i >= 0) && mRecords[i].mTime > timeToStopSearch) {
+		if (isPredicateInRecordChange(mRecords[i], pred, x, y, z)) {
+			return mRecords[i].mTime;
 		}
 		i--;
 	}
 
-	return INVALID_TIME;
+	// only predicates over the entire history fall through to the archive, the archived records are older than the hot ones
+	int32 archivedTime = INVALID_TIME;
+	if (isUnbounded && mArchive) {
+		mArchive->forEachRecord(~0u, true, [&](const FCiFSFDBRecord& record, TArrayView<const FCiFSFDBRecordLabel>) {
+			if (record.mTime <= timeToStopSearch) {
+				return false;
+			}
+			// change rules that aren't those of a registered trigger (status timeouts) aren't archived
+			if (record.mType == ESFDBContextType::TRIGGER && record.mObjectIndex != INDEX_NONE) {
+				return true;
+			}
+			if (isPredicateInRecordChange(record, pred, x, y, z)) {
+				archivedTime = record.mTime;
+				return false;
+			}
+			return true;
+		});
+	}
+
+	return archivedTime;
 }
 
 bool UCiFSocialFactsDataBase::isPredicateInHistory(const UCiFPredicate* pred,
@@ -61,65 +171,218 @@ void UCiFSocialFactsDataBase::findLabelFromValues(TArray<int32>& outMatchingIndi
                                                   int window,
                                                   const UCiFPredicate* pred) const
 {
-	if (mContexts.IsEmpty()) {
+	if (!hasHistory()) {
 		UE_LOG(LogTemp, Warning, TEXT("Contexts is empty"));
 		return;
 	}
 
 	const int32 timeToStopSearch = (window <= 0) ? getLowestContextTime() - 1 : getLatestContextTime() - window;
+	// the reference evaluation doesn't skip records by their label masks
+	const bool isReference = isReferenceEvaluation();
+	const uint32 searchMask = isReference ? ~0u : getLabelSearchMask(label);
+
+	//Call a strict version of this for numTimesUniquelyTrue. Which requires a from because it is numTimesUniquelyTrue
+	const bool isStrict = pred && pred->mIsNumTimesUniquelyTruePred;
+	const auto first = findCharacterHandle(c1);
+	const auto second = findCharacterHandle(c2);
+	const auto doesMatch = [&](const FCiFSFDBRecord& record, TArrayView<const FCiFSFDBRecordLabel> labels) {
+		return isReference ?
+			       doesRecordLabelMatchByName(record, labels, label, c1, c2, isStrict) :
+			       doesRecordLabelMatch(record, labels, label, first, second, isStrict);
+	};
+
+	// the folded history is older than all the records. Over the entire history the archive has the exact times of the
+	// folded matches, otherwise they are reported with the latest time they were true
+	if (window <= 0 && mArchive) {
+		mArchive->forEachRecord(searchMask, false, [&](const FCiFSFDBRecord& record, TArrayView<const FCiFSFDBRecordLabel> labels) {
+			if (doesMatch(record, labels)) {
+				outMatchingIndices.Add(record.mTime);
+			}
+			return true;
+		});
+	}
+	else if (const auto folded = findFoldedLabelCount(label, first, second, isStrict)) {
+		if (folded->mLatestTime > timeToStopSearch) {
+			outMatchingIndices.Reserve(outMatchingIndices.Num() + folded->mCount);
+			for (int32 i = 0; i < folded->mCount; i++) {
+				outMatchingIndices.Add(folded->mLatestTime);
+			}
+		}
+	}
 
 	//NOTE: this assumes that all entries are in order such that the most recent action is last in contexts
-	for (int i = 0; i < mContexts.Num(); i++) {
-		if ((mContexts[i]->getType() == ESFDBContextType::SOCIAL_GAME) || (mContexts[i]->getType() == ESFDBContextType::TRIGGER) &&
-			(mContexts[i]->mTime > timeToStopSearch)) {
-
-			if (mContexts[i]->getType() == ESFDBContextType::SOCIAL_GAME) {
-				const auto sgc = static_cast<UCiFSocialExchangeContext*>(mContexts[i]);
-				if (pred && pred->mIsNumTimesUniquelyTruePred) {
-					//Call a strict version of this. Which requires a from because it is numTimesUniquelyTrue
-					if (sgc->doesSFDBLabelMatchStrict(label, c1, c2, c3, pred)) {
-						outMatchingIndices.Add(sgc->mTime);
-					}
-				}
-				else {
-					if (sgc->doesSFDBLabelMatch(label, c1, c2, c3, pred)) {
-						outMatchingIndices.Add(sgc->mTime);
-					}
-				}	
+	// the reference evaluation goes through the whole history instead of searching for the start of the window
+	for (int32 i = isReference ? 0 : Algo::UpperBoundBy(mRecords, timeToStopSearch, &FCiFSFDBRecord::mTime); i < mRecords.Num(); i++) {
+		// records without a label that could match (this includes the statuses) are skipped with a single AND
+		if ((mRecords[i].mLabelMask & searchMask) == 0 || mRecords[i].mTime <= timeToStopSearch) {
+			continue;
+		}
+		if (doesMatch(mRecords[i], getRecordLabels(mRecords[i]))) {
+			outMatchingIndices.Add(mRecords[i].mTime);
+		}
+	}
+}
+
+bool UCiFSocialFactsDataBase::doesRecordLabelMatch(const FCiFSFDBRecord& record,
+                                                   TArrayView<const FCiFSFDBRecordLabel> labels,
+                                                   const ESFDBLabelType label,
+                                                   const TOptional<uint16> first,
+                                                   const TOptional<uint16> second,
+                                                   const bool isStrict) const
+{
+	if (record.mType != ESFDBContextType::SOCIAL_GAME && record.mType != ESFDBContextType::TRIGGER) {
+		return false;
+	}
+
+	if (record.mIsBackstory) {
+		// if this context is a backstory context, the first and second character
+		// parameters must match the context's initiator and responder respectively
+		if (label != ESFDBLabelType::WILDCARD && labels[0].mType != label) {
+			return false;
+		}
+		// if first or second are null treat them as a wildcard
+		return (!first || *first == record.mInitiator) && (!second || *second == record.mResponder);
+	}
+
+	for (const auto& sfdbLabel : labels) {
+		if (label != ESFDBLabelType::WILDCARD && !doesMatchLabelOrCategory(sfdbLabel.mType, label)) {
+			continue;
+		}
+
+		if (isStrict) {
+			// the strict version requires a from, and a label without a "to" only matches when there's no second character
+			if (first && sfdbLabel.mFrom == *first && sfdbLabel.mTo == second.Get(0)) {
+				return true;
 			}
-			else if (mContexts[i]->getType() == ESFDBContextType::TRIGGER) {
-				const auto tc = static_cast<UCiFTriggerContext*>(mContexts[i]);
-				if (pred && pred->mIsNumTimesUniquelyTruePred) {
-					if (tc->doesSFDBLabelMatchStrict(label, c1, c2, c3, pred)) {
-						outMatchingIndices.Add(tc->mTime);
-					}
-				}
-				else {
-					if (tc->doesSFDBLabelMatch(label, c1, c2, c3, pred)) {
-						outMatchingIndices.Add(tc->mTime);
-					}
-				}
+		}
+		else if ((!first || sfdbLabel.mFrom == *first) && (!second || sfdbLabel.mTo == *second)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool UCiFSocialFactsDataBase::doesRecordLabelMatchByName(const FCiFSFDBRecord& record,
+                                                         TArrayView<const FCiFSFDBRecordLabel> labels,
+                                                         const ESFDBLabelType label,
+                                                         const UCiFGameObject* first,
+                                                         const UCiFGameObject* second,
+                                                         const bool isStrict) const
+{
+	if (record.mType != ESFDBContextType::SOCIAL_GAME && record.mType != ESFDBContextType::TRIGGER) {
+		return false;
+	}
+
+	if (record.mIsBackstory) {
+		if (label != ESFDBLabelType::WILDCARD && labels[0].mType != label) {
+			return false;
+		}
+		return (!first || first->mObjectName == getName(record.mInitiator)) && (!second || second->mObjectName == getName(record.mResponder));
+	}
+
+	for (const auto& sfdbLabel : labels) {
+		if (label != ESFDBLabelType::WILDCARD && !doesMatchLabelOrCategoryByScan(sfdbLabel.mType, label)) {
+			continue;
+		}
+
+		const FName from = getName(sfdbLabel.mFrom);
+		const FName to = getName(sfdbLabel.mTo);
+		if (isStrict) {
+			if (first && from == first->mObjectName && to == (second ? second->mObjectName : NAME_None)) {
+				return true;
 			}
 		}
+		else if ((!first || from == first->mObjectName) && (!second || to == second->mObjectName)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool UCiFSocialFactsDataBase::isPredicateInRecordChange(const FCiFSFDBRecord& record,
+                                                        const UCiFPredicate* pred,
+                                                        const UCiFGameObject* x,
+                                                        const UCiFGameObject* y,
+                                                        const UCiFGameObject* z) const
+{
+	switch (record.mType) {
+		case ESFDBContextType::TRIGGER:
+			return UCiFTriggerContext::isPredicateInChangeRule(getRecordChange(record), pred, x, y, z);
+		case ESFDBContextType::STATUS:
+			return UCiFStatusContext::isStatusPredicateInChange(record.mIsNegated, pred, x, y, z);
+		default:
+			// social exchange contexts don't look into their change
+			return false;
+	}
+}
+
+UCiFRule* UCiFSocialFactsDataBase::getRecordChange(const FCiFSFDBRecord& record) const
+{
+	if (record.mObjectIndex != INDEX_NONE) {
+		return Cast<UCiFRule>(mRecordObjects[record.mObjectIndex]);
 	}
+	const auto trigger = getTriggerByID(record.mId);
+	return trigger ? trigger->mChange : nullptr;
+}
+
+TOptional<uint16> UCiFSocialFactsDataBase::findCharacterHandle(const UCiFGameObject* character) const
+{
+	return character ? TOptional<uint16>(findNameHandle(character->mObjectName)) : TOptional<uint16>();
+}
+
+uint16 UCiFSocialFactsDataBase::getNameHandle(const FName name)
+{
+	if (name.IsNone()) {
+		return 0;
+	}
+	if (const auto handle = mNameHandles.Find(name)) {
+		return *handle;
+	}
+	if (mNames.IsEmpty()) {
+		mNames.Add(NAME_None);
+	}
+	checkf(mNames.Num() < ANY_NAME_HANDLE, TEXT("SFDB name table is full"));
+	const uint16 handle = mNames.Add(name);
+	mNameHandles.Add(name, handle);
+	return handle;
+}
+
+uint16 UCiFSocialFactsDataBase::findNameHandle(const FName name) const
+{
+	if (name.IsNone()) {
+		return 0;
+	}
+	const auto handle = mNameHandles.Find(name);
+	return handle ? *handle : INVALID_NAME_HANDLE;
 }
 
 UCiFTrigger* UCiFSocialFactsDataBase::getTriggerByID(uint64_t id) const
 {
-	auto trigger = mTriggers.FindByPredicate([=](const UCiFTrigger* t) { return t->mId == id; });
-	if (trigger) {
-		return *trigger;
+	return id < static_cast<uint64_t>(mTriggersById.Num()) ? mTriggersById[id] : nullptr;
+}
+
+void UCiFSocialFactsDataBase::addTrigger(UCiFTrigger* trigger)
+{
+	mTriggers.Add(trigger);
+
+	// effect and trigger ids come from one sequential generator, so the table stays dense
+	if (trigger->mId >= 0) {
+		if (trigger->mId >= mTriggersById.Num()) {
+			mTriggersById.SetNumZeroed(trigger->mId + 1);
+		}
+		mTriggersById[trigger->mId] = trigger;
 	}
-	return nullptr;
 }
 
-bool UCiFSocialFactsDataBase::doesMatchLabelOrCategory(const ESFDBLabelType contextLabel, const ESFDBLabelType predicateLabel) noexcept
+bool UCiFSocialFactsDataBase::doesMatchLabelOrCategoryByScan(const ESFDBLabelType contextLabel, const ESFDBLabelType predicateLabel)
 {
 	if (predicateLabel <= ESFDBLabelType::CAT_LAST) {
 		// the predicate label is category, see if any of the labels in the category matches @contextLabel
-		for (const auto catLabel : mSFDBLabelCategories[predicateLabel].mCategoryLabels) {
-			if (catLabel == contextLabel) {
-				return true;
+		if (const auto category = mSFDBLabelCategories.Find(predicateLabel)) {
+			for (const auto catLabel : category->mCategoryLabels) {
+				if (catLabel == contextLabel) {
+					return true;
+				}
 			}
 		}
 		return false;
@@ -128,6 +391,42 @@ bool UCiFSocialFactsDataBase::doesMatchLabelOrCategory(const ESFDBLabelType cont
 	return contextLabel == predicateLabel;
 }
 
+bool UCiFSocialFactsDataBase::isReferenceEvaluation() const
+{
+	const auto cifManager = GetWorld()->GetGameInstance()->GetSubsystem<UCiFSubsystem>()->getInstance();
+	return cifManager && cifManager->mIsReferenceEvaluation;
+}
+
+uint32 UCiFSocialFactsDataBase::getLabelSearchMask(const ESFDBLabelType label) noexcept
+{
+	if (label == ESFDBLabelType::WILDCARD) {
+		return ~0u;
+	}
+	return mSFDBLabelMatchMasks[static_cast<uint8>(label)] | labelBit(label);
+}
+
+TArray<uint32> UCiFSocialFactsDataBase::initializeLabelMatchMasks()
+{
+	TArray<uint32> outMasks;
+	outMasks.SetNumZeroed(static_cast<uint8>(ESFDBLabelType::SIZE));
+
+	for (uint8 i = 0; i < outMasks.Num(); i++) {
+		const auto label = static_cast<ESFDBLabelType>(i);
+		if (label <= ESFDBLabelType::CAT_LAST) {
+			// the label is category, it matches the labels in the category
+			if (const auto category = mSFDBLabelCategories.Find(label)) {
+				for (const auto catLabel : category->mCategoryLabels) {
+					outMasks[i] |= labelBit(catLabel);
+				}
+			}
+		}
+		else {
+			outMasks[i] = labelBit(label);
+		}
+	}
+	return outMasks;
+}
+
 TMap<ESFDBLabelType, FLabelCategoryArrayWrapper> UCiFSocialFactsDataBase::initializeCategoriesMap()
 {
 	TMap<ESFDBLabelType, FLabelCategoryArrayWrapper> outMap;
@@ -155,10 +454,423 @@ TMap<ESFDBLabelType, FLabelCategoryArrayWrapper> UCiFSocialFactsDataBase::initia
 
 void UCiFSocialFactsDataBase::addContext(UCiFSFDBContext* context)
 {
-	// todo - this is for now not optimized because we sort it on every addition. (i think this can be done with heapsort and heappush methods of array)
-	// it would better be to store the context in a heap to be able to insert in O(logn) instead of O(nlogn)
-	mContexts.Add(context);
-	mContexts.Sort([](UCiFSFDBContext& c1, UCiFSFDBContext& c2) { return c1.mTime <= c2.mTime; });
+	FCiFSFDBRecord record;
+	record.mTime = context->mTime;
+	record.mType = context->getType();
+
+	TArray<FSFDBLabel> labels;
+	switch (record.mType) {
+		case ESFDBContextType::SOCIAL_GAME:
+			{
+				const auto sgc = static_cast<UCiFSocialExchangeContext*>(context);
+				record.mIsBackstory = sgc->mIsBackstory;
+				record.mInitiatorScore = sgc->mInitiatorScore;
+				record.mResponderScore = sgc->mResponderScore;
+				record.mInitiator = getNameHandle(sgc->mInitiatorName);
+				record.mResponder = getNameHandle(sgc->mResponderName);
+				record.mOther = getNameHandle(sgc->mOtherName);
+				record.mGameName = getNameHandle(sgc->mGameName);
+				record.mChosenItemCKB = getNameHandle(sgc->mChosenItemCKB);
+				record.mPerformanceRealization = getNameHandle(sgc->mPerformanceRealization);
+				record.mId = sgc->mEffectId;
+				// a backstory context has a single label, its record keeps it as its only label
+				labels = sgc->mIsBackstory ? TArray<FSFDBLabel>{sgc->mSFDBLabel} : sgc->mSFDBLabels;
+				break;
+			}
+		case ESFDBContextType::TRIGGER:
+			{
+				const auto tc = static_cast<UCiFTriggerContext*>(context);
+				record.mInitiator = getNameHandle(tc->mInitiatorName);
+				record.mResponder = getNameHandle(tc->mResponderName);
+				record.mOther = getNameHandle(tc->mOtherName);
+				record.mId = tc->mId;
+				// only a change that isn't the change of the registered trigger (e.g. status timeout) has to be kept
+				const auto change = tc->mChange ? tc->mChange : tc->mStatusTimeoutChange;
+				const auto trigger = getTriggerByID(tc->mId);
+				if (change && (!trigger || trigger->mChange != change)) {
+					record.mObjectIndex = mRecordObjects.Add(change);
+				}
+				labels = tc->mSFDBLabels;
+				break;
+			}
+		case ESFDBContextType::STATUS:
+			{
+				const auto sc = static_cast<UCiFStatusContext*>(context);
+				record.mIsNegated = sc->mPredicate && sc->mPredicate->mIsNegated;
+				if (sc->mPredicate) {
+					record.mObjectIndex = mRecordObjects.Add(sc->mPredicate);
+				}
+				break;
+			}
+		default:
+			UE_LOG(LogTemp, Warning, TEXT("Adding SFDB context of unrecognized type %d"), uint8(record.mType));
+	}
+
+	addRecord(record, labels);
+}
+
+void UCiFSocialFactsDataBase::addTriggerRecord(const IdType triggerId,
+                                               UCiFRule* change,
+                                               const int32 time,
+                                               UCiFGameObject* x,
+                                               UCiFGameObject* y,
+                                               UCiFGameObject* z)
+{
+	FCiFSFDBRecord record;
+	record.mTime = time;
+	record.mType = ESFDBContextType::TRIGGER;
+	record.mInitiator = getNameHandle(x->mObjectName);
+	record.mResponder = getNameHandle(y ? y->mObjectName : NAME_None);
+	record.mOther = getNameHandle(z ? z->mObjectName : NAME_None);
+	record.mId = triggerId;
+
+	const auto trigger = getTriggerByID(triggerId);
+	if (!trigger || trigger->mChange != change) {
+		record.mObjectIndex = mRecordObjects.Add(change);
+	}
+
+	TArray<FSFDBLabel> labels;
+	UCiFTrigger::makeSFDBLabels(change, x, y, z, labels);
+	addRecord(record, labels);
+}
+
+void UCiFSocialFactsDataBase::addRecord(FCiFSFDBRecord& record, const TArray<FSFDBLabel>& labels)
+{
+	record.mFirstLabel = mRecordLabels.Num();
+	record.mNumLabels = labels.Num();
+	record.mLabelMask = 0;
+	for (const auto& sfdbLabel : labels) {
+		mRecordLabels.Add({getNameHandle(sfdbLabel.from), getNameHandle(sfdbLabel.to), sfdbLabel.type});
+		record.mLabelMask |= labelBit(sfdbLabel.type);
+	}
+
+	// insert after all the records with the same time (usually at the end), so the history stays sorted
+	const int32 index = Algo::UpperBoundBy(mRecords, record.mTime, &FCiFSFDBRecord::mTime);
+	mRecords.Insert(record, index);
+	addLabelCounts(record);
+
+	if (const auto journal = UCiFJournal::getActiveJournal()) {
+		journal->logSFDBRecord(this, record);
+	}
+	if (const auto diff = FCiFSocialStateDiff::getActiveDiff()) {
+		diff->recordSFDBRecord(this, record);
+	}
+}
+
+void UCiFSocialFactsDataBase::writeRecord(FArchive& ar, const FCiFSFDBRecord& record) const
+{
+	auto recordCopy = record;
+	ar << recordCopy;
+
+	// names are written instead of handles, the name table of the reader may differ
+	for (const uint16 handle : {record.mInitiator, record.mResponder, record.mOther, record.mGameName, record.mChosenItemCKB, record.mPerformanceRealization}) {
+		FName name = getName(handle);
+		ar << name;
+	}
+	for (const auto& label : getRecordLabels(record)) {
+		FName from = getName(label.mFrom);
+		FName to = getName(label.mTo);
+		auto type = label.mType;
+		ar << from << to << type;
+	}
+
+	UObject* object = record.mObjectIndex != INDEX_NONE ? mRecordObjects[record.mObjectIndex] : nullptr;
+	serializeRecordObject(ar, object, nullptr);
+}
+
+void UCiFSocialFactsDataBase::readRecord(FArchive& ar)
+{
+	FCiFSFDBRecord record;
+	ar << record;
+
+	for (uint16* handle : {&record.mInitiator, &record.mResponder, &record.mOther, &record.mGameName, &record.mChosenItemCKB, &record.mPerformanceRealization}) {
+		FName name;
+		ar << name;
+		*handle = getNameHandle(name);
+	}
+	TArray<FSFDBLabel> labels;
+	labels.SetNum(record.mNumLabels);
+	for (auto& label : labels) {
+		ar << label.from << label.to << label.type;
+	}
+
+	UObject* object = nullptr;
+	serializeRecordObject(ar, object, this);
+	record.mObjectIndex = object ? mRecordObjects.Add(object) : INDEX_NONE;
+
+	addRecord(record, labels);
+}
+
+bool UCiFSocialFactsDataBase::serializeHistory(FArchive& ar)
+{
+	// a history is read into its own containers, and replaces this one only if all of it was read
+	TArray<FName> loadedNames;
+	TArray<FCiFSFDBRecord> loadedRecords;
+	TArray<FCiFSFDBRecordLabel> loadedRecordLabels;
+	TArray<UObject*> loadedRecordObjects;
+	TMap<FCiFLabelCountKey, TArray<FCiFLabelCountBucket>> loadedLabelCounts;
+	TMap<FCiFLabelCountKey, FCiFFoldedLabelCount> loadedFoldedLabelCounts;
+	int32 loadedNumFoldedRecords = 0, loadedOldestFoldedTime = 0, loadedNewestFoldedTime = 0;
+
+	const bool isLoading = ar.IsLoading();
+	auto& names = isLoading ? loadedNames : mNames;
+	auto& records = isLoading ? loadedRecords : mRecords;
+	auto& recordLabels = isLoading ? loadedRecordLabels : mRecordLabels;
+	auto& recordObjects = isLoading ? loadedRecordObjects : mRecordObjects;
+	auto& labelCounts = isLoading ? loadedLabelCounts : mLabelCounts;
+	auto& foldedLabelCounts = isLoading ? loadedFoldedLabelCounts : mFoldedLabelCounts;
+	auto& numFoldedRecords = isLoading ? loadedNumFoldedRecords : mNumFoldedRecords;
+	auto& oldestFoldedTime = isLoading ? loadedOldestFoldedTime : mOldestFoldedTime;
+	auto& newestFoldedTime = isLoading ? loadedNewestFoldedTime : mNewestFoldedTime;
+
+	ar << names;
+	// field by field like writeRecord, so the format doesn't depend on the memory layout of the structs
+	ar << records;
+	ar << recordLabels;
+
+	int32 numObjects = recordObjects.Num();
+	ar << numObjects;
+	if (numObjects < 0 || ar.IsError()) {
+		ar.SetError();
+		return false;
+	}
+	if (isLoading) {
+		recordObjects.Init(nullptr, numObjects);
+	}
+	for (auto& object : recordObjects) {
+		serializeRecordObject(ar, object, this);
+	}
+
+	ar << labelCounts;
+	ar << foldedLabelCounts;
+	ar << numFoldedRecords << oldestFoldedTime << newestFoldedTime;
+
+	// the archive itself stays in its file, the state refers to the records it had
+	FString archivePath = mArchive ? mArchive->getFilePath() : FString();
+	int32 numArchivedRecords = mArchive ? mArchive->getNumRecords() : 0;
+	ar << archivePath << numArchivedRecords;
+
+	if (ar.IsError()) {
+		return false;
+	}
+
+	if (isLoading) {
+		mNames = MoveTemp(loadedNames);
+		mRecords = MoveTemp(loadedRecords);
+		mRecordLabels = MoveTemp(loadedRecordLabels);
+		mRecordObjects = MoveTemp(loadedRecordObjects);
+		mLabelCounts = MoveTemp(loadedLabelCounts);
+		mFoldedLabelCounts = MoveTemp(loadedFoldedLabelCounts);
+		mNumFoldedRecords = loadedNumFoldedRecords;
+		mOldestFoldedTime = loadedOldestFoldedTime;
+		mNewestFoldedTime = loadedNewestFoldedTime;
+
+		mNameHandles.Reset();
+		for (int32 i = 1; i < mNames.Num(); i++) {
+			mNameHandles.Add(mNames[i], i);
+		}
+		// the open archive may be the same file, it is released before the file is cut back to the loaded history
+		mArchive.Reset();
+		if (!archivePath.IsEmpty()) {
+			auto archive = MakeUnique<FCiFSFDBArchive>();
+			if (archive->reopen(archivePath, numArchivedRecords)) {
+				mArchive = MoveTemp(archive);
+			}
+			else {
+				UE_LOG(LogTemp, Error, TEXT("The SFDB archive at %s can't be reopened, the folded history is queried from its summaries"), *archivePath);
+			}
+		}
+	}
+	return true;
+}
+
+UCiFSFDBContext* UCiFSocialFactsDataBase::makeContext(const int32 index)
+{
+	if (!mRecords.IsValidIndex(index)) {
+		UE_LOG(LogTemp, Warning, TEXT("No SFDB context at index %d"), index);
+		return nullptr;
+	}
+	const auto& record = mRecords[index];
+
+	TArray<FSFDBLabel> labels;
+	for (int32 i = record.mFirstLabel; i < record.mFirstLabel + record.mNumLabels; i++) {
+		labels.Add({getName(mRecordLabels[i].mFrom), getName(mRecordLabels[i].mTo), mRecordLabels[i].mType});
+	}
+
+	UCiFSFDBContext* context = nullptr;
+	switch (record.mType) {
+		case ESFDBContextType::SOCIAL_GAME:
+			{
+				const auto sgc = NewObject<UCiFSocialExchangeContext>(this);
+				sgc->mIsBackstory = record.mIsBackstory;
+				sgc->mInitiatorScore = record.mInitiatorScore;
+				sgc->mResponderScore = record.mResponderScore;
+				sgc->mInitiatorName = getName(record.mInitiator);
+				sgc->mResponderName = getName(record.mResponder);
+				sgc->mOtherName = getName(record.mOther);
+				sgc->mGameName = getName(record.mGameName);
+				sgc->mChosenItemCKB = getName(record.mChosenItemCKB);
+				sgc->mPerformanceRealization = getName(record.mPerformanceRealization);
+				sgc->mEffectId = record.mId;
+				if (record.mIsBackstory) {
+					sgc->mSFDBLabel = labels[0];
+				}
+				else {
+					sgc->mSFDBLabels = labels;
+				}
+				context = sgc;
+				break;
+			}
+		case ESFDBContextType::TRIGGER:
+			{
+				const auto tc = NewObject<UCiFTriggerContext>(this);
+				tc->mInitiatorName = getName(record.mInitiator);
+				tc->mResponderName = getName(record.mResponder);
+				tc->mOtherName = getName(record.mOther);
+				tc->mId = record.mId;
+				tc->mChange = getRecordChange(record);
+				if (record.mObjectIndex != INDEX_NONE) {
+					tc->mStatusTimeoutChange = tc->mChange;
+				}
+				tc->mSFDBLabels = labels;
+				context = tc;
+				break;
+			}
+		case ESFDBContextType::STATUS:
+			{
+				const auto sc = NewObject<UCiFStatusContext>(this);
+				sc->mPredicate = record.mObjectIndex != INDEX_NONE ? Cast<UCiFPredicate>(mRecordObjects[record.mObjectIndex]) : nullptr;
+				context = sc;
+				break;
+			}
+		default:
+			return nullptr;
+	}
+
+	context->mTime = record.mTime;
+	return context;
+}
+
+void UCiFSocialFactsDataBase::truncateToLength(const int32 length)
+{
+	if (length < mNumFoldedRecords) {
+		UE_LOG(LogTemp, Warning, TEXT("Truncating the SFDB to %d records while %d were already folded, only the detailed history is removed"),
+		       length, mNumFoldedRecords);
+	}
+
+	const int32 numRecords = FMath::Max(length - mNumFoldedRecords, 0);
+	while (mRecords.Num() > numRecords) {
+		const auto& record = mRecords.Last();
+		removeLabelCounts(record);
+
+		// records are mostly removed in the reverse order they were added, so their labels and objects are at the end
+		if (record.mNumLabels > 0 && record.mFirstLabel + record.mNumLabels == mRecordLabels.Num()) {
+			mRecordLabels.SetNum(record.mFirstLabel);
+		}
+		if (record.mObjectIndex != INDEX_NONE && record.mObjectIndex == mRecordObjects.Num() - 1) {
+			mRecordObjects.Pop();
+		}
+		mRecords.Pop();
+	}
+}
+
+void UCiFSocialFactsDataBase::addLabelCounts(const FCiFSFDBRecord& record)
+{
+	TSet<FCiFLabelCountKey> keys;
+	collectLabelCountKeys(record, keys);
+
+	for (const auto& key : keys) {
+		auto& buckets = mLabelCounts.FindOrAdd(key);
+
+		// records are almost always added with the latest time, so usually only the last bucket is touched
+		int32 i = buckets.Num();
+		while (i > 0 && buckets[i - 1].mTime > record.mTime) {
+			buckets[i - 1].mCount++;
+			i--;
+		}
+		if (i > 0 && buckets[i - 1].mTime == record.mTime) {
+			buckets[i - 1].mCount++;
+		}
+		else {
+			buckets.Insert({record.mTime, (i > 0 ? buckets[i - 1].mCount : 0) + 1}, i);
+		}
+	}
+}
+
+void UCiFSocialFactsDataBase::removeLabelCounts(const FCiFSFDBRecord& record)
+{
+	TSet<FCiFLabelCountKey> keys;
+	collectLabelCountKeys(record, keys);
+
+	for (const auto& key : keys) {
+		auto& buckets = mLabelCounts.FindChecked(key);
+
+		int32 i = buckets.Num();
+		while (i > 0 && buckets[i - 1].mTime >= record.mTime) {
+			buckets[i - 1].mCount--;
+			i--;
+		}
+		// the bucket of the record's time is dropped if no other record is counted in it
+		if (i < buckets.Num() && buckets[i].mTime == record.mTime && buckets[i].mCount == (i > 0 ? buckets[i - 1].mCount : 0)) {
+			buckets.RemoveAt(i);
+		}
+		if (buckets.IsEmpty()) {
+			mLabelCounts.Remove(key);
+		}
+	}
+}
+
+void UCiFSocialFactsDataBase::collectLabelCountKeys(const FCiFSFDBRecord& record, TSet<FCiFLabelCountKey>& outKeys) const
+{
+	// mirrors the strict version of doesRecordLabelMatch
+	if (record.mType != ESFDBContextType::SOCIAL_GAME && record.mType != ESFDBContextType::TRIGGER) {
+		return;
+	}
+
+	if (record.mIsBackstory) {
+		// backstory labels match exactly or by wildcard, with or without a "to" character
+		for (const auto label : {mRecordLabels[record.mFirstLabel].mType, ESFDBLabelType::WILDCARD}) {
+			outKeys.Add({record.mInitiator, record.mResponder, label});
+			outKeys.Add({record.mInitiator, 0, label});
+		}
+		return;
+	}
+
+	for (int32 i = record.mFirstLabel; i < record.mFirstLabel + record.mNumLabels; i++) {
+		const auto& sfdbLabel = mRecordLabels[i];
+		// a label without a "to" has the none handle, which is what queries without a second character look for
+		outKeys.Add({sfdbLabel.mFrom, sfdbLabel.mTo, ESFDBLabelType::WILDCARD});
+		if (sfdbLabel.mType > ESFDBLabelType::CAT_LAST) {
+			outKeys.Add({sfdbLabel.mFrom, sfdbLabel.mTo, sfdbLabel.mType});
+		}
+		for (const auto& category : mSFDBLabelCategories) {
+			if (category.Value.mCategoryLabels.Contains(sfdbLabel.mType)) {
+				outKeys.Add({sfdbLabel.mFrom, sfdbLabel.mTo, category.Key});
+			}
+		}
+	}
+}
+
+int32 UCiFSocialFactsDataBase::countLabelsInWindow(const ESFDBLabelType label,
+                                                   const UCiFGameObject* first,
+                                                   const UCiFGameObject* second,
+                                                   int window) const
+{
+	if (!hasHistory()) {
+		return 0;
+	}
+
+	const auto buckets = mLabelCounts.Find({
+		first ? findNameHandle(first->mObjectName) : uint16(0), second ? findNameHandle(second->mObjectName) : uint16(0), label
+	});
+	if (!buckets) {
+		return 0;
+	}
+
+	// same window as findLabelFromValues: count the records later than timeToStopSearch
+	const int32 timeToStopSearch = (window <= 0) ? getLowestContextTime() - 1 : getLatestContextTime() - window;
+	const int32 firstInWindow = Algo::UpperBoundBy(*buckets, timeToStopSearch, &FCiFLabelCountBucket::mTime);
+	return buckets->Last().mCount - (firstInWindow > 0 ? (*buckets)[firstInWindow - 1].mCount : 0);
 }
 
 void UCiFSocialFactsDataBase::runTriggers(TArray<UCiFGameObject*> cast)
@@ -173,60 +885,17 @@ void UCiFSocialFactsDataBase::runTriggers(TArray<UCiFGameObject*> cast)
 		cifManager->getAllGameObjectsOfType(potentialChars, ECiFGameObjectType::CHARACTER);
 	}
 
+	TArray<FCiFTriggerMatch> matches;
+	collectTriggerMatches(potentialChars, matches);
 
-	TArray<UCiFTrigger*> triggersToApply;
-	TArray<UCiFGameObject*> firstRoles;
-	TArray<UCiFGameObject*> secondRoles;
-	TArray<UCiFGameObject*> thirdRoles;
-	
-	// run each trigger on every duple of characters or triple where needed by trigger (only characters for now because the current
-	// triggers involve only statuses between characters. later on items could also be added)
-
-	// TODO - why not run all triggers only on the characters that participated in the last social move that this method was called after?
-	//  => because some triggers like the one that check if character is lonely because didnt have interaction for X turns, aren't
-	//     dependent on the participating characters on this frames. so need to query every character each turn
-	
-	for (auto trigger : mTriggers) {
-		for (auto firstChar : potentialChars) {
-			if (trigger->isRoleRequired("responder")) {
-				for (auto secondChar : potentialChars) {
-					if (firstChar != secondChar) {
-						if (trigger->isRoleRequired("other")) {
-							for (auto thirdChar : potentialChars) {
-								if (thirdChar != firstChar && thirdChar != secondChar) {
-									if (trigger->evaluateCondition(firstChar, secondChar, thirdChar)) {
-										// valuate the trigger
-										triggersToApply.Add(trigger);
-										firstRoles.Add(firstChar);
-										secondRoles.Add(secondChar);
-										thirdRoles.Add(thirdChar);
-									}
-								}
-							}
-						}
-						else {
-							if (trigger->evaluateCondition(firstChar, secondChar)) {
-								triggersToApply.Add(trigger);
-								firstRoles.Add(firstChar);
-								secondRoles.Add(secondChar);
-								thirdRoles.Add(nullptr);
-							}
-						}
-					}
-				}
-			}
-			else {
-				// this fixes bug where status triggers that aren't directed applied NUM_CHARS-1 times because for every
-				// secondChar, we add to firstChar the same trigger to apply - for example leading to a trigger that applies lonely to
-				// firstChar NUM_CHARS-1 times
-				if (trigger->evaluateCondition(firstChar, nullptr)) {
-					triggersToApply.Add(trigger);
-					firstRoles.Add(firstChar);
-					secondRoles.Add(nullptr);
-					thirdRoles.Add(nullptr);
-				}
-			}
+	// the matches are collected before any of them is applied, so the reference pass sees the same state
+	if (cifManager->mDifferentialTester && cifManager->mDifferentialTester->isActive()) {
+		TArray<FCiFTriggerMatch> referenceMatches;
+		{
+			TGuardValue<bool> referenceGuard(cifManager->mIsReferenceEvaluation, true);
+			collectTriggerMatches(potentialChars, referenceMatches);
 		}
+		cifManager->mDifferentialTester->checkTriggerMatches(matches, referenceMatches);
 	}
 
 	//now that we have collected all the the triggers and characters involved, valuate them all
@@ -235,27 +904,18 @@ void UCiFSocialFactsDataBase::runTriggers(TArray<UCiFGameObject*> cast)
 	// because it may be the case that the status was already the case, and thus a trigger context should not be created
 
 	bool isPredHasValuated = false;
-	for (int i = 0; i < triggersToApply.Num(); i++) {
+	for (const auto& match : matches) {
 		isPredHasValuated = false;
 		// go through each change predicate and treat status that are already the case different than those that aren't
 		//this is all part of making sure that we don't contantly display "cheating" every turn while someone is dating two characters
-		for (auto changePred : triggersToApply[i]->mChange->mPredicates) {
+		for (auto changePred : match.mTrigger->mChange->mPredicates) {
 			//figure out who the predicate should be applied to
-			UCiFGameObject* fromChar = nullptr;
-			auto primaryVal = changePred->getRoleValue(changePred->mPrimary);
-			if (primaryVal == "initiator") fromChar = firstRoles[i];
-			if (primaryVal == "responder") fromChar = secondRoles[i];
-			if (primaryVal == "other") fromChar = thirdRoles[i];
-			else fromChar = cifManager->getGameObjectByName(primaryVal);
+			UCiFGameObject* fromChar = changePred->bindSlot(cifManager, changePred->mPrimaryBinding, match.mFirst, match.mSecond, match.mThird);
 
 			UCiFGameObject* towardChar = nullptr;
 			if (changePred->mType == EPredicateType::STATUS) {
 				if (changePred->mStatusType >= EStatus::FIRST_DIRECTED_STATUS) {
-					auto secondaryVal = changePred->getRoleValue(changePred->mSecondary);
-					if (secondaryVal == "initiator") towardChar = firstRoles[i];
-					if (secondaryVal == "responder") towardChar = secondRoles[i];
-					if (secondaryVal == "other") towardChar = thirdRoles[i];
-					else towardChar = cifManager->getGameObjectByName(secondaryVal);
+					towardChar = changePred->bindSlot(cifManager, changePred->mSecondaryBinding, match.mFirst, match.mSecond, match.mThird);
 				}
 
 				if (fromChar && fromChar->hasStatus(changePred->mStatusType, towardChar)) {
@@ -263,30 +923,83 @@ void UCiFSocialFactsDataBase::runTriggers(TArray<UCiFGameObject*> cast)
 					if (changePred->mIsNegated) {
 						//this deals with removing status, which warrants a new trigger context
 						isPredHasValuated = true;
-						changePred->valuation(firstRoles[i], secondRoles[i], thirdRoles[i]);
+						changePred->valuation(match.mFirst, match.mSecond, match.mThird);
 					}
 					else {
 						//this is the case where rather than apply the status, we only reset its remaining duration. This is the
 						//case that we do not want to create a new trigger context for.
-						fromChar->getStatus(changePred->mStatusType, towardChar->mObjectName)->mRemainingDuration = UCiFGameObjectStatus::DEFAULT_INITIAL_DURATION;
+						const FName towardName = towardChar ? towardChar->mObjectName : NAME_None;
+						if (const auto status = fromChar->getStatus(changePred->mStatusType, towardName)) {
+							const auto diff = FCiFSocialStateDiff::getActiveDiff();
+							const auto previous = diff ? FCiFStatusRecord::make(changePred->mStatusType, status) : FCiFStatusRecord();
+							status->mRemainingDuration = UCiFGameObjectStatus::DEFAULT_INITIAL_DURATION;
+							if (diff) {
+								diff->recordStatusUpdated(fromChar, previous, status);
+							}
+							if (const auto journal = UCiFJournal::getActiveJournal()) {
+								journal->logStatusDuration(fromChar->mObjectName, changePred->mStatusType, towardName, status->mRemainingDuration);
+							}
+						}
 					}
 				}
 				else if (!changePred->mIsNegated) {
 					//this is the "normal case" where we simple apply the change predicate
 					isPredHasValuated = true;
-					changePred->valuation(firstRoles[i], secondRoles[i], thirdRoles[i]);
+					changePred->valuation(match.mFirst, match.mSecond, match.mThird);
 				}
 			}
 			else {
 				//this is the normal, non-status case
 				isPredHasValuated = true;
-				changePred->valuation(firstRoles[i], secondRoles[i], thirdRoles[i]);
+				changePred->valuation(match.mFirst, match.mSecond, match.mThird);
 			}
 		}
 		// make trigger context
 		if (isPredHasValuated) {
-			auto tc = triggersToApply[i]->makeTriggerContext(cifManager->mTime, firstRoles[i], secondRoles[i], thirdRoles[i]);
-			addContext(tc);
+			addTriggerRecord(match.mTrigger->mId, match.mTrigger->mChange, cifManager->mTime, match.mFirst, match.mSecond, match.mThird);
+		}
+	}
+}
+
+void UCiFSocialFactsDataBase::collectTriggerMatches(const TArray<UCiFGameObject*>& potentialChars, TArray<FCiFTriggerMatch>& outMatches)
+{
+	// run each trigger on every duple of characters or triple where needed by trigger (only characters for now because the current
+	// triggers involve only statuses between characters. later on items could also be added)
+
+	// TODO - why not run all triggers only on the characters that participated in the last social move that this method was called after?
+	//  => because some triggers like the one that check if character is lonely because didnt have interaction for X turns, aren't
+	//     dependent on the participating characters on this frames. so need to query every character each turn
+	
+	for (auto trigger : mTriggers) {
+		for (auto firstChar : potentialChars) {
+			if (trigger->isResponderRequired()) {
+				for (auto secondChar : potentialChars) {
+					if (firstChar != secondChar) {
+						if (trigger->isOtherRequired()) {
+							for (auto thirdChar : potentialChars) {
+								if (thirdChar != firstChar && thirdChar != secondChar) {
+									if (trigger->evaluateCondition(firstChar, secondChar, thirdChar)) {
+										outMatches.Add({trigger, firstChar, secondChar, thirdChar});
+									}
+								}
+							}
+						}
+						else {
+							if (trigger->evaluateCondition(firstChar, secondChar)) {
+								outMatches.Add({trigger, firstChar, secondChar, nullptr});
+							}
+						}
+					}
+				}
+			}
+			else {
+				// this fixes bug where status triggers that aren't directed applied NUM_CHARS-1 times because for every
+				// secondChar, we add to firstChar the same trigger to apply - for example leading to a trigger that applies lonely to
+				// firstChar NUM_CHARS-1 times
+				if (trigger->evaluateCondition(firstChar, nullptr)) {
+					outMatches.Add({trigger, firstChar, nullptr, nullptr});
+				}
+			}
 		}
 	}
 }
@@ -300,3 +1013,136 @@ UCiFSocialFactsDataBase* UCiFSocialFactsDataBase::loadFromJson(const TSharedPtr<
 	
 	return sfdb;
 }
+
+void UCiFSocialFactsDataBase::compactHistory(const int32 keepFromTime)
+{
+	if (mRetentionWindow <= 0 || mIsCompactionSuspended || mRecords.IsEmpty()) {
+		return;
+	}
+
+	// compacting moves the whole history, so it waits until there's another full retention window to fold
+	const int32 horizon = FMath::Min(getLatestContextTime() - mRetentionWindow, keepFromTime - 1);
+	if (mRecords[0].mTime > horizon - mRetentionWindow) {
+		return;
+	}
+
+	const int32 numFolded = Algo::UpperBoundBy(mRecords, horizon, &FCiFSFDBRecord::mTime);
+	if (mArchive && !mArchive->append(MakeArrayView(mRecords.GetData(), numFolded), mRecordLabels)) {
+		// the folded counts summarize every folded record, archived or not, so the queries fall back to them
+		UE_LOG(LogTemp, Error, TEXT("Failed to append to the SFDB archive at %s, closing it"), *mArchive->getFilePath());
+		mArchive.Reset();
+	}
+	for (int32 i = 0; i < numFolded; i++) {
+		foldRecord(mRecords[i]);
+	}
+
+	// repack the labels and objects of the records that are kept
+	TArray<FCiFSFDBRecordLabel> labels;
+	TArray<UObject*> objects;
+	for (int32 i = numFolded; i < mRecords.Num(); i++) {
+		auto& record = mRecords[i];
+		const int32 firstLabel = labels.Num();
+		if (record.mNumLabels > 0) {
+			labels.Append(&mRecordLabels[record.mFirstLabel], record.mNumLabels);
+		}
+		record.mFirstLabel = firstLabel;
+		if (record.mObjectIndex != INDEX_NONE) {
+			record.mObjectIndex = objects.Add(mRecordObjects[record.mObjectIndex]);
+		}
+	}
+	mRecordLabels = MoveTemp(labels);
+	mRecordObjects = MoveTemp(objects);
+	mRecords.RemoveAt(0, numFolded);
+
+	// the buckets are prefix sums, so all the buckets up to the horizon are summarized by the last of them
+	for (auto& [key, buckets] : mLabelCounts) {
+		const int32 numOld = Algo::UpperBoundBy(buckets, horizon, &FCiFLabelCountBucket::mTime);
+		if (numOld > 1) {
+			buckets.RemoveAt(0, numOld - 1);
+		}
+	}
+}
+
+bool UCiFSocialFactsDataBase::openArchive(const FString& filePath)
+{
+	// the archive has to hold all the folded records for the queries over the entire history to read them from it
+	if (mNumFoldedRecords > 0) {
+		UE_LOG(LogTemp, Error, TEXT("Can't open an SFDB archive at %s, history was already folded without it"), *filePath);
+		return false;
+	}
+
+	auto archive = MakeUnique<FCiFSFDBArchive>();
+	if (!archive->open(filePath)) {
+		return false;
+	}
+	mArchive = MoveTemp(archive);
+	return true;
+}
+
+void UCiFSocialFactsDataBase::foldRecord(const FCiFSFDBRecord& record)
+{
+	mOldestFoldedTime = mNumFoldedRecords > 0 ? FMath::Min(mOldestFoldedTime, record.mTime) : record.mTime;
+	mNewestFoldedTime = mNumFoldedRecords > 0 ? FMath::Max(mNewestFoldedTime, record.mTime) : record.mTime;
+	mNumFoldedRecords++;
+
+	if (record.mType != ESFDBContextType::SOCIAL_GAME && record.mType != ESFDBContextType::TRIGGER) {
+		return;
+	}
+
+	// every (from, to, label) a query could match the record by, a record is counted once per key
+	TSet<FCiFLabelCountKey> keys;
+	const auto addKeys = [&keys](const uint16 from, const uint16 to, const ESFDBLabelType label) {
+		keys.Add({from, to, label});
+		keys.Add({from, ANY_NAME_HANDLE, label});
+		keys.Add({ANY_NAME_HANDLE, to, label});
+		keys.Add({ANY_NAME_HANDLE, ANY_NAME_HANDLE, label});
+	};
+
+	if (record.mIsBackstory) {
+		for (const auto label : {mRecordLabels[record.mFirstLabel].mType, ESFDBLabelType::WILDCARD}) {
+			addKeys(record.mInitiator, record.mResponder, label);
+			// a strict query without a second character matches any responder
+			keys.Add({record.mInitiator, 0, label});
+		}
+	}
+	else {
+		for (int32 i = record.mFirstLabel; i < record.mFirstLabel + record.mNumLabels; i++) {
+			const auto& sfdbLabel = mRecordLabels[i];
+			addKeys(sfdbLabel.mFrom, sfdbLabel.mTo, ESFDBLabelType::WILDCARD);
+			if (sfdbLabel.mType > ESFDBLabelType::CAT_LAST) {
+				addKeys(sfdbLabel.mFrom, sfdbLabel.mTo, sfdbLabel.mType);
+			}
+			for (const auto& category : mSFDBLabelCategories) {
+				if (category.Value.mCategoryLabels.Contains(sfdbLabel.mType)) {
+					addKeys(sfdbLabel.mFrom, sfdbLabel.mTo, category.Key);
+				}
+			}
+		}
+	}
+
+	for (const auto& key : keys) {
+		auto& folded = mFoldedLabelCounts.FindOrAdd(key);
+		folded.mLatestTime = folded.mCount > 0 ? FMath::Max(folded.mLatestTime, record.mTime) : record.mTime;
+		folded.mCount++;
+	}
+}
+
+const FCiFFoldedLabelCount* UCiFSocialFactsDataBase::findFoldedLabelCount(const ESFDBLabelType label,
+                                                                         const TOptional<uint16> first,
+                                                                         const TOptional<uint16> second,
+                                                                         const bool isStrict) const
+{
+	if (mFoldedLabelCounts.IsEmpty()) {
+		return nullptr;
+	}
+	// characters that no record refers to can't match anything
+	if ((first && *first == INVALID_NAME_HANDLE) || (second && *second == INVALID_NAME_HANDLE)) {
+		return nullptr;
+	}
+
+	if (isStrict) {
+		// the strict version requires a from, and without a second character only labels without a "to" match
+		return first ? mFoldedLabelCounts.Find({*first, second.Get(0), label}) : nullptr;
+	}
+	return mFoldedLabelCounts.Find({first.Get(ANY_NAME_HANDLE), second.Get(ANY_NAME_HANDLE), label});
+}
@@ -2,7 +2,9 @@
 
 
 #include "CiFSocialNetwork.h"
+#include "CiFJournal.h"
 #include "CiFManager.h"
+#include "CiFSessionRecorder.h"
 #include "CiFSubsystem.h"
 
 void UCiFSocialNetwork::init(const ESocialNetworkType networkType, const uint8 numOfCharacters, const uint8 maxVal)
@@ -10,17 +12,28 @@ void UCiFSocialNetwork::init(const ESocialNetworkType networkType, const uint8 n
 	mMaxVal = maxVal;
 	mType = networkType;
 
-	mNetwork.SetNum(numOfCharacters);
+	mNetwork.Reset(numOfCharacters);
 	for (int32 i = 0; i < numOfCharacters; i++) {
-		mNetwork[i].SetNum(numOfCharacters);
+		FNetworkRow row = MakeShared<TArray<uint8>>();
+		row->SetNum(numOfCharacters);
+		mNetwork.Add(row);
 	}
 	setAllArrayElements(maxVal / 2);
 }
 
 void UCiFSocialNetwork::setWeight(const uint8 c1, const uint8 c2, const uint8 w)
 {
+	FCiFJournalScope journalScope;
+	FCiFSessionCallScope sessionScope(UCiFSessionRecorder::mActiveRecorder);
+	FCiFSessionEvent event;
+	event.mType = ECiFSessionEventType::SET_NETWORK_WEIGHT;
+	event.mValue = w;
+
 	if (c1 < mNetwork.Num() && c2 < mNetwork.Num()) {
-		mNetwork[c1][c2] = w;
+		auto& element = getElementForWrite(c1, c2);
+		const uint8 oldWeight = element;
+		element = w;
+		UCiFManager::notifyNetworkWrite(sessionScope, event, mType, c1, c2, oldWeight, w);
 	}
 	else {
 		UE_LOG(LogTemp, Error, TEXT("Trying set weight to [%d][%d] while number of characters is %d"), c1, c2, mNetwork.Num());
@@ -29,17 +42,35 @@ void UCiFSocialNetwork::setWeight(const uint8 c1, const uint8 c2, const uint8 w)
 
 void UCiFSocialNetwork::addWeight(const uint8 c1, const uint8 c2, const int addition)
 {
-	mNetwork[c1][c2] = (mNetwork[c1][c2] + addition) <= mMaxVal ? mNetwork[c1][c2] + addition : mMaxVal;
+	FCiFJournalScope journalScope;
+	FCiFSessionCallScope sessionScope(UCiFSessionRecorder::mActiveRecorder);
+	FCiFSessionEvent event;
+	event.mType = ECiFSessionEventType::ADD_NETWORK_WEIGHT;
+	event.mValue = addition;
+
+	auto& element = getElementForWrite(c1, c2);
+	const uint8 oldWeight = element;
+	element = (element + addition) <= mMaxVal ? element + addition : mMaxVal;
+	UCiFManager::notifyNetworkWrite(sessionScope, event, mType, c1, c2, oldWeight, element);
 }
 
 void UCiFSocialNetwork::multiplyWeight(const uint8 c1, const uint8 c2, const float multiplier)
 {
-	mNetwork[c1][c2] = (mNetwork[c1][c2] * multiplier) <= mMaxVal ? mNetwork[c1][c2] * multiplier : mMaxVal;
+	FCiFJournalScope journalScope;
+	FCiFSessionCallScope sessionScope(UCiFSessionRecorder::mActiveRecorder);
+	FCiFSessionEvent event;
+	event.mType = ECiFSessionEventType::MULTIPLY_NETWORK_WEIGHT;
+	event.mFloatValue = multiplier;
+
+	auto& element = getElementForWrite(c1, c2);
+	const uint8 oldWeight = element;
+	element = (element * multiplier) <= mMaxVal ? element * multiplier : mMaxVal;
+	UCiFManager::notifyNetworkWrite(sessionScope, event, mType, c1, c2, oldWeight, element);
 }
 
 uint8 UCiFSocialNetwork::getWeight(const uint8 c1, const uint8 c2)
 {
-	return mNetwork[c1][c2];
+	return (*mNetwork[c1])[c2];
 }
 
 float UCiFSocialNetwork::getAverageOpinion(const uint8 c)
@@ -49,7 +80,7 @@ float UCiFSocialNetwork::getAverageOpinion(const uint8 c)
 	{
 		if (i != c)
 		{
-			total += mNetwork[i][c];
+			total += (*mNetwork[i])[c];
 		}
 	}
 	return total / (mNetwork.Num() - 1);
@@ -60,7 +91,7 @@ TArray<uint8> UCiFSocialNetwork::getRelationshipsAboveThreshold(const uint8 c, c
 	TArray<uint8> idsArr;
 	for (size_t i = 0; i < mNetwork.Num(); i++)
 	{
-		if ((c != i) && (mNetwork[c][i] > th))
+		if ((c != i) && ((*mNetwork[c])[i] > th))
 		{
 			idsArr.Add(i);
 		}
@@ -73,7 +104,7 @@ TArray<uint8> UCiFSocialNetwork::getReverseRelationshipsAboveThreshold(const uin
 	TArray<uint8> idsArr;
 	for (size_t i = 0; i < mNetwork.Num(); i++)
 	{
-		if ((c != i) && (mNetwork[i][c] > th))
+		if ((c != i) && ((*mNetwork[i])[c] > th))
 		{
 			idsArr.Add(i);
 		}
@@ -81,6 +112,11 @@ TArray<uint8> UCiFSocialNetwork::getReverseRelationshipsAboveThreshold(const uin
 	return idsArr;
 }
 
+void UCiFSocialNetwork::restore(const TArray<FNetworkRow>& rows)
+{
+	mNetwork = rows;
+}
+
 UCiFSocialNetwork* UCiFSocialNetwork::loadFromJson(const TSharedPtr<FJsonObject> json, const UObject* worldContextObject)
 {
 	const auto sn = NewObject<UCiFSocialNetwork>(const_cast<UObject*>(worldContextObject));
@@ -116,9 +152,23 @@ void UCiFSocialNetwork::setAllArrayElements(uint8 val)
 {
 	for (auto& row : mNetwork)
 	{
-		for (auto& e : row)
+		if (!row.IsUnique())
+		{
+			row = MakeShared<TArray<uint8>>(*row);
+		}
+		for (auto& e : *row)
 		{
 			e = val;
 		}
 	}
 }
+
+uint8& UCiFSocialNetwork::getElementForWrite(const uint8 c1, const uint8 c2)
+{
+	auto& row = mNetwork[c1];
+	if (!row.IsUnique()) {
+		// the row is shared with a fork, detach it before writing
+		row = MakeShared<TArray<uint8>>(*row);
+	}
+	return (*row)[c2];
+}
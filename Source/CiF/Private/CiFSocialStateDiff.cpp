@@ -0,0 +1,338 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CiFSocialStateDiff.h"
+
+#include "CiFEffect.h"
+#include "CiFGameObject.h"
+#include "CiFGameObjectStatus.h"
+#include "CiFJournal.h"
+#include "CiFManager.h"
+#include "CiFRelationshipNetwork.h"
+#include "CiFSessionRecorder.h"
+#include "CiFSocialExchange.h"
+#include "CiFSocialExchangesLibrary.h"
+#include "CiFSocialFactsDataBase.h"
+#include "CiFSocialNetwork.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace
+{
+	/* @return The status of @go that @record is a copy of */
+	UCiFGameObjectStatus* findStatus(const UCiFGameObject* go, const FCiFStatusRecord& record, int32* outIndex = nullptr)
+	{
+		const auto statusArrWrapper = go->mStatuses.Find(record.mKey);
+		if (!statusArrWrapper) {
+			return nullptr;
+		}
+		const int32 index = statusArrWrapper->statusArray.IndexOfByPredicate([&record](const UCiFGameObjectStatus* status) {
+			return status->mType == record.mType && status->mDirectedTowards == record.mDirectedTowards;
+		});
+		if (outIndex) {
+			*outIndex = index;
+		}
+		return index != INDEX_NONE ? statusArrWrapper->statusArray[index] : nullptr;
+	}
+
+	void addStatus(UCiFGameObject* go, const FCiFStatusRecord& record)
+	{
+		go->mStatuses.FindOrAdd(record.mKey).statusArray.Add(record.makeStatus());
+	}
+
+	void removeStatus(UCiFGameObject* go, const FCiFStatusRecord& record)
+	{
+		int32 index;
+		if (findStatus(go, record, &index)) {
+			auto& statusArray = go->mStatuses[record.mKey].statusArray;
+			statusArray.RemoveAt(index);
+			if (statusArray.IsEmpty()) {
+				go->mStatuses.Remove(record.mKey);
+			}
+		}
+	}
+
+	void updateStatus(const UCiFGameObject* go, const FCiFStatusRecord& record)
+	{
+		if (const auto status = findStatus(go, record)) {
+			status->mHasDuration = record.mHasDuration;
+			status->mRemainingDuration = record.mRemainingDuration;
+			status->mInitialDuration = record.mInitialDuration;
+		}
+	}
+
+	UCiFSocialNetwork* getNetwork(const UCiFManager* cifManager, const ESocialNetworkType type)
+	{
+		return type == ESocialNetworkType::RELATIONSHIP ? cifManager->mRelationshipNetworks : cifManager->getSocialNetworkByType(type);
+	}
+
+	void setEffectSeenTime(const UCiFManager* cifManager, const FCiFEffectSeenChange& change, const int32 time)
+	{
+		const auto sg = cifManager->mSocialExchangesLib->getSocialExchangeByName(change.mSocialExchange);
+		if (const auto effect = sg ? sg->getEffectById(change.mEffectId) : nullptr) {
+			effect->mLastSeenTime = time;
+		}
+	}
+}
+
+FCiFSocialStateDiff::FCiFSocialStateDiff(FCiFSocialStateDiff&& other)
+{
+	*this = MoveTemp(other);
+}
+
+FCiFSocialStateDiff& FCiFSocialStateDiff::operator=(FCiFSocialStateDiff&& other)
+{
+	// the diffs that are tracking point to each other, so they stay where they are
+	checkf(!mIsTracking && !other.mIsTracking, TEXT("A social state diff can't be moved while it is tracking"));
+	mFromTime = other.mFromTime;
+	mToTime = other.mToTime;
+	mCells = MoveTemp(other.mCells);
+	mStatuses = MoveTemp(other.mStatuses);
+	mEffects = MoveTemp(other.mEffects);
+	mSFDBRecords = MoveTemp(other.mSFDBRecords);
+	mNumSFDBRecords = other.mNumSFDBRecords;
+	other.reset();
+	return *this;
+}
+
+FCiFSocialStateDiff::~FCiFSocialStateDiff()
+{
+	unlink();
+}
+
+void FCiFSocialStateDiff::beginTracking(const UCiFManager* cifManager)
+{
+	if (mIsTracking) {
+		UE_LOG(LogTemp, Warning, TEXT("The social state diff is already tracking, starting over at time %d"), cifManager->mTime);
+		unlink();
+	}
+
+	reset();
+	mFromTime = cifManager->mTime;
+	mToTime = cifManager->mTime;
+	mOuterDiff = mActiveDiff;
+	mActiveDiff = this;
+	mIsTracking = true;
+}
+
+void FCiFSocialStateDiff::endTracking(const UCiFManager* cifManager)
+{
+	mToTime = cifManager->mTime;
+	mCellIndices.Reset();
+	mStatusUpdateIndices.Reset();
+	unlink();
+}
+
+FCiFSocialStateDiff FCiFSocialStateDiff::cut(const UCiFManager* cifManager)
+{
+	FCiFSocialStateDiff changes;
+	changes.mFromTime = mFromTime;
+	changes.mToTime = cifManager->mTime;
+	changes.mCells = MoveTemp(mCells);
+	changes.mStatuses = MoveTemp(mStatuses);
+	changes.mEffects = MoveTemp(mEffects);
+	changes.mSFDBRecords = MoveTemp(mSFDBRecords);
+	changes.mNumSFDBRecords = mNumSFDBRecords;
+
+	reset();
+	mFromTime = cifManager->mTime;
+	mToTime = cifManager->mTime;
+	return changes;
+}
+
+int32 FCiFSocialStateDiff::getEarliestTrackedTime()
+{
+	int32 time = MAX_int32;
+	for (const FCiFSocialStateDiff* diff = mActiveDiff; diff; diff = diff->mOuterDiff) {
+		time = FMath::Min(time, diff->mFromTime);
+	}
+	return time;
+}
+
+void FCiFSocialStateDiff::unlink()
+{
+	if (!mIsTracking) {
+		return;
+	}
+	// mostly the last diff that started tracking, otherwise it is cut out of the middle
+	for (FCiFSocialStateDiff** diff = &mActiveDiff; *diff; diff = &(*diff)->mOuterDiff) {
+		if (*diff == this) {
+			*diff = mOuterDiff;
+			break;
+		}
+	}
+	mOuterDiff = nullptr;
+	mIsTracking = false;
+}
+
+void FCiFSocialStateDiff::recordWeight(const ESocialNetworkType type, const uint8 c1, const uint8 c2, const uint8 oldWeight, const uint8 newWeight)
+{
+	// cells are kept once, so a cell written every turn still costs a single change
+	const uint32 key = getCellKey(type, c1, c2);
+	if (const auto index = mCellIndices.Find(key)) {
+		mCells[*index].mNewWeight = newWeight;
+	}
+	else {
+		mCellIndices.Add(key, mCells.Add({type, c1, c2, oldWeight, newWeight}));
+	}
+	if (mOuterDiff) {
+		mOuterDiff->recordWeight(type, c1, c2, oldWeight, newWeight);
+	}
+}
+
+void FCiFSocialStateDiff::recordStatusAdded(const UCiFGameObject* go, const EStatus key, const UCiFGameObjectStatus* status)
+{
+	const auto& change = mStatuses.Add_GetRef({ECiFStatusChangeType::ADDED, go->mObjectName, FCiFStatusRecord::make(key, status)});
+	// an update after an add or remove can't be merged into the updates before it
+	mStatusUpdateIndices.Remove({go->mObjectName, key, change.mStatus.mType, change.mStatus.mDirectedTowards});
+	if (mOuterDiff) {
+		mOuterDiff->recordStatusAdded(go, key, status);
+	}
+}
+
+void FCiFSocialStateDiff::recordStatusRemoved(const UCiFGameObject* go, const EStatus key, const UCiFGameObjectStatus* status)
+{
+	const auto& change = mStatuses.Add_GetRef({ECiFStatusChangeType::REMOVED, go->mObjectName, FCiFStatusRecord::make(key, status)});
+	mStatusUpdateIndices.Remove({go->mObjectName, key, change.mStatus.mType, change.mStatus.mDirectedTowards});
+	if (mOuterDiff) {
+		mOuterDiff->recordStatusRemoved(go, key, status);
+	}
+}
+
+void FCiFSocialStateDiff::recordStatusUpdated(const UCiFGameObject* go, const FCiFStatusRecord& previous, const UCiFGameObjectStatus* status)
+{
+	// like the cells, consecutive updates of a status are kept as one, from its first previous value to its last value
+	const FStatusKey statusKey(go->mObjectName, previous.mKey, previous.mType, previous.mDirectedTowards);
+	if (const auto index = mStatusUpdateIndices.Find(statusKey)) {
+		mStatuses[*index].mStatus = FCiFStatusRecord::make(previous.mKey, status);
+	}
+	else {
+		mStatusUpdateIndices.Add(statusKey, mStatuses.Add({ECiFStatusChangeType::UPDATED, go->mObjectName, FCiFStatusRecord::make(previous.mKey, status), previous}));
+	}
+	if (mOuterDiff) {
+		mOuterDiff->recordStatusUpdated(go, previous, status);
+	}
+}
+
+void FCiFSocialStateDiff::recordSFDBRecord(const UCiFSocialFactsDataBase* sfdb, const FCiFSFDBRecord& record)
+{
+	mNumSFDBRecords++;
+	FMemoryWriter writer(mSFDBRecords, false, true);
+	sfdb->writeRecord(writer, record);
+	if (mOuterDiff) {
+		mOuterDiff->recordSFDBRecord(sfdb, record);
+	}
+}
+
+void FCiFSocialStateDiff::recordEffectSeen(const FName socialExchange, const IdType effectId, const int32 oldTime, const int32 newTime)
+{
+	mEffects.Add({socialExchange, effectId, oldTime, newTime});
+	if (mOuterDiff) {
+		mOuterDiff->recordEffectSeen(socialExchange, effectId, oldTime, newTime);
+	}
+}
+
+void FCiFSocialStateDiff::apply(UCiFManager* cifManager) const
+{
+	// applying the diff isn't a change the game made, nothing should record it
+	FCiFSessionCallScope sessionScope(cifManager->mSessionRecorder);
+	TGuardValue<bool> journalGuard(cifManager->mJournal->mIsSuspended, true);
+	TGuardValue<FCiFSocialStateDiff*> diffGuard(mActiveDiff, nullptr);
+
+	for (const auto& cell : mCells) {
+		if (const auto network = getNetwork(cifManager, cell.mNetwork)) {
+			network->setWeight(cell.mFrom, cell.mTo, cell.mNewWeight);
+		}
+	}
+	applyStatuses(cifManager, false);
+	for (const auto& change : mEffects) {
+		setEffectSeenTime(cifManager, change, change.mNewTime);
+	}
+
+	FMemoryReader reader(mSFDBRecords);
+	for (int32 i = 0; i < mNumSFDBRecords && !reader.IsError(); i++) {
+		cifManager->mSFDB->readRecord(reader);
+	}
+
+	cifManager->mTime = mToTime;
+}
+
+void FCiFSocialStateDiff::revert(UCiFManager* cifManager) const
+{
+	FCiFSessionCallScope sessionScope(cifManager->mSessionRecorder);
+	TGuardValue<bool> journalGuard(cifManager->mJournal->mIsSuspended, true);
+	TGuardValue<FCiFSocialStateDiff*> diffGuard(mActiveDiff, nullptr);
+
+	for (const auto& cell : mCells) {
+		if (const auto network = getNetwork(cifManager, cell.mNetwork)) {
+			network->setWeight(cell.mFrom, cell.mTo, cell.mOldWeight);
+		}
+	}
+	applyStatuses(cifManager, true);
+	for (int32 i = mEffects.Num() - 1; i >= 0; i--) {
+		setEffectSeenTime(cifManager, mEffects[i], mEffects[i].mOldTime);
+	}
+
+	// the records of the diff are the last ones in the history, the ones that were there before with the same time stay
+	if (mNumSFDBRecords > 0) {
+		cifManager->mSFDB->truncateToLength(cifManager->mSFDB->getHistoryLength() - mNumSFDBRecords);
+	}
+
+	cifManager->mTime = mFromTime;
+}
+
+void FCiFSocialStateDiff::applyStatuses(UCiFManager* cifManager, const bool isReverting) const
+{
+	for (int32 i = 0; i < mStatuses.Num(); i++) {
+		// reverting undoes the changes from the last one
+		const auto& change = mStatuses[isReverting ? mStatuses.Num() - 1 - i : i];
+		const auto go = cifManager->getGameObjectByName(change.mObject);
+		if (!go) {
+			UE_LOG(LogTemp, Warning, TEXT("Game object '%s' of a social state diff doesn't exist"), *change.mObject.ToString());
+			continue;
+		}
+
+		switch (change.mType) {
+			case ECiFStatusChangeType::ADDED:
+				if (isReverting) {
+					removeStatus(go, change.mStatus);
+				}
+				else {
+					addStatus(go, change.mStatus);
+				}
+				break;
+			case ECiFStatusChangeType::REMOVED:
+				if (isReverting) {
+					addStatus(go, change.mStatus);
+				}
+				else {
+					removeStatus(go, change.mStatus);
+				}
+				break;
+			case ECiFStatusChangeType::UPDATED:
+				updateStatus(go, isReverting ? change.mPrevious : change.mStatus);
+				break;
+		}
+	}
+}
+
+void FCiFSocialStateDiff::serialize(FArchive& ar)
+{
+	ar << mFromTime << mToTime;
+	// cell changes are plain values, so they are written and read in bulk
+	mCells.BulkSerialize(ar);
+	ar << mStatuses;
+	ar << mEffects;
+	ar << mSFDBRecords << mNumSFDBRecords;
+}
+
+void FCiFSocialStateDiff::reset()
+{
+	mCells.Reset();
+	mCellIndices.Reset();
+	mStatuses.Reset();
+	mStatusUpdateIndices.Reset();
+	mEffects.Reset();
+	mSFDBRecords.Reset();
+	mNumSFDBRecords = 0;
+}
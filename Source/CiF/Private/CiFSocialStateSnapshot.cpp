@@ -0,0 +1,155 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CiFSocialStateSnapshot.h"
+
+#include "CiFGameObjectStatus.h"
+#include "CiFManager.h"
+#include "CiFRelationshipNetwork.h"
+#include "CiFSFDBContext.h"
+#include "CiFSocialFactsDataBase.h"
+#include "CiFSocialNetwork.h"
+
+FCiFStatusRecord FCiFStatusRecord::make(const EStatus key, const UCiFGameObjectStatus* status)
+{
+	FCiFStatusRecord record;
+	record.mKey = key;
+	record.mType = status->mType;
+	record.mDirectedTowards = status->mDirectedTowards;
+	record.mHasDuration = status->mHasDuration;
+	record.mRemainingDuration = status->mRemainingDuration;
+	record.mInitialDuration = status->mInitialDuration;
+	return record;
+}
+
+UCiFGameObjectStatus* FCiFStatusRecord::makeStatus() const
+{
+	const auto status = NewObject<UCiFGameObjectStatus>();
+	status->init(mType, mInitialDuration, mDirectedTowards);
+	status->mHasDuration = mHasDuration;
+	status->mRemainingDuration = mRemainingDuration;
+	return status;
+}
+
+void FCiFSocialStateSnapshot::capture(const UCiFManager* cifManager)
+{
+	mNetworks.Reset();
+	for (const auto [type, network] : cifManager->mSocialNetworks) {
+		mNetworks.Add(type, network->fork());
+	}
+	if (cifManager->mRelationshipNetworks) {
+		mNetworks.Add(ESocialNetworkType::RELATIONSHIP, cifManager->mRelationshipNetworks->fork());
+	}
+	mTime = cifManager->mTime;
+	mSFDBHistoryLength = cifManager->mSFDB ? cifManager->mSFDB->getHistoryLength() : 0;
+}
+
+void FCiFSocialStateSnapshot::captureStatuses(const UCiFManager* cifManager)
+{
+	mStatuses.Reset();
+
+	for (const auto go : cifManager->getGameObjectRegistry().getObjects()) {
+		if (go->mStatuses.IsEmpty()) {
+			continue;
+		}
+
+		auto& records = mStatuses.Add(go->mObjectName);
+		for (const auto& [key, statusArrWrapper] : go->mStatuses) {
+			for (const auto status : statusArrWrapper.statusArray) {
+				records.Add(FCiFStatusRecord::make(key, status));
+			}
+		}
+	}
+	mHasStatuses = true;
+}
+
+void FCiFSocialStateSnapshot::restore(UCiFManager* cifManager, const bool isRestoringHistory) const
+{
+	if (!isValid()) {
+		UE_LOG(LogTemp, Error, TEXT("Trying to restore a snapshot that was never captured"));
+		return;
+	}
+
+	for (const auto& [type, rows] : mNetworks) {
+		if (type == ESocialNetworkType::RELATIONSHIP) {
+			cifManager->mRelationshipNetworks->restore(rows);
+		}
+		else if (const auto network = cifManager->getSocialNetworkByType(type)) {
+			network->restore(rows);
+		}
+	}
+
+	if (mHasStatuses) {
+		for (const auto go : cifManager->getGameObjectRegistry().getObjects()) {
+			go->mStatuses.Reset();
+			const auto records = mStatuses.Find(go->mObjectName);
+			if (!records) {
+				continue;
+			}
+			for (const auto& record : *records) {
+				go->mStatuses.FindOrAdd(record.mKey).statusArray.Add(record.makeStatus());
+			}
+		}
+	}
+
+	// the contexts added after the snapshot was taken are the last ones, the ones added before with the same time
+	// (e.g. the authored history at time 0) stay
+	if (isRestoringHistory) {
+		cifManager->mSFDB->truncateToLength(mSFDBHistoryLength);
+	}
+
+	cifManager->mTime = mTime;
+}
+
+void FCiFSocialStateSnapshot::serialize(FArchive& ar)
+{
+	ar << mTime << mSFDBHistoryLength;
+
+	int32 numNetworks = mNetworks.Num();
+	ar << numNetworks;
+	if (ar.IsLoading()) {
+		mNetworks.Reset();
+		for (int32 i = 0; i < numNetworks; i++) {
+			ESocialNetworkType type;
+			int32 numRows;
+			ar << type << numRows;
+			auto& rows = mNetworks.Add(type);
+			for (int32 row = 0; row < numRows; row++) {
+				ar << rows.Add_GetRef(MakeShared<TArray<uint8>>()).Get();
+			}
+		}
+	}
+	else {
+		for (auto& [networkType, rows] : mNetworks) {
+			ESocialNetworkType type = networkType;
+			int32 numRows = rows.Num();
+			ar << type << numRows;
+			for (const auto& row : rows) {
+				ar << row.Get();
+			}
+		}
+	}
+
+	ar << mHasStatuses;
+	ar << mStatuses;
+}
+
+bool FCiFSocialStateSnapshot::hasStatus(const FName object, const EStatus statusType, const FName towards) const
+{
+	const auto records = mStatuses.Find(object);
+	if (!records) {
+		return false;
+	}
+	return records->ContainsByPredicate([=](const FCiFStatusRecord& record) {
+		return record.mKey == statusType && record.mType == statusType && (towards.IsNone() || record.mDirectedTowards == towards);
+	});
+}
+
+uint8 FCiFSocialStateSnapshot::getWeight(const ESocialNetworkType type, const uint8 id1, const uint8 id2) const
+{
+	const auto network = mNetworks.Find(type);
+	if (!network || id1 >= network->Num() || id2 >= (*network)[id1]->Num()) {
+		return 0;
+	}
+	return (*(*network)[id1])[id2];
+}
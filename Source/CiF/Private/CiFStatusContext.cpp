@@ -14,9 +14,18 @@ bool UCiFStatusContext::isPredicateInChange(const UCiFPredicate* pred,
                                             const UCiFGameObject* x,
                                             const UCiFGameObject* y,
                                             const UCiFGameObject* z)
+{
+	return isStatusPredicateInChange(mPredicate->mIsNegated, pred, x, y, z);
+}
+
+bool UCiFStatusContext::isStatusPredicateInChange(const bool isNegated,
+                                                  const UCiFPredicate* pred,
+                                                  const UCiFGameObject* x,
+                                                  const UCiFGameObject* y,
+                                                  const UCiFGameObject* z)
 {
 	if (pred->mType != EPredicateType::STATUS) return false;
-	if (pred->mIsNegated != mPredicate->mIsNegated) return false;
+	if (pred->mIsNegated != isNegated) return false;
 	if (x->mObjectName != pred->mPrimary) return false;
 	if (y)
 		if (y->mObjectName != pred->mSecondary) return false;
@@ -17,17 +17,26 @@ UCiFTriggerContext* UCiFTrigger::makeTriggerContext(const int32 time, UCiFGameOb
 	tc->mInitiatorName = x->mObjectName;
 	tc->mResponderName = (y) ? y->mObjectName : "";
 	tc->mOtherName = (z) ? z->mObjectName: "";
+	tc->mChange = mChange;
+	makeSFDBLabels(mChange, x, y, z, tc->mSFDBLabels);
+			
+	return tc;
+}
 
-	for (const auto p : mChange->mPredicates) {
+void UCiFTrigger::makeSFDBLabels(const UCiFRule* change,
+                                 const UCiFGameObject* x,
+                                 const UCiFGameObject* y,
+                                 const UCiFGameObject* z,
+                                 TArray<FSFDBLabel>& outLabels)
+{
+	for (const auto p : change->mPredicates) {
 		if (p->mType == EPredicateType::SFDB_LABEL) {
 			auto to = p->getPrimaryCharacterNameFromVariables(x, y, z);
 			auto from = p->getSecondaryCharacterNameFromVariables(x, y, z);
 			auto type =  p->mSFDBLabel.type ;
-			tc->mSFDBLabels.Emplace(from, to, type);
+			outLabels.Emplace(from, to, type);
 		}
 	}
-			
-	return tc;
 }
 
 UCiFTrigger* UCiFTrigger::loadFromJson(const TSharedPtr<FJsonObject> json, const UObject* worldContextObject)
@@ -29,8 +29,19 @@ bool UCiFTriggerContext::isPredicateInChange(const UCiFPredicate* pred,
                                              const UCiFGameObject* y,
                                              const UCiFGameObject* z)
 {
-	const auto changeRule = getChange(); // get ref to the social game this context is about
-	for (const auto predInChange : changeRule->mPredicates) {
+	return isPredicateInChangeRule(getChange(), pred, x, y, z);
+}
+
+bool UCiFTriggerContext::isPredicateInChangeRule(const UCiFRule* change,
+                                                 const UCiFPredicate* pred,
+                                                 const UCiFGameObject* x,
+                                                 const UCiFGameObject* y,
+                                                 const UCiFGameObject* z)
+{
+	if (!change) {
+		return false;
+	}
+	for (const auto predInChange : change->mPredicates) {
 		// see if the predicate matches 
 		if (UCiFPredicate::equalsValuationStructure(pred, predInChange)) {
 			// see if the roles of the characters match
@@ -99,19 +110,23 @@ bool UCiFTriggerContext::doesSFDBLabelMatch(const ESFDBLabelType labelType,
 
 UCiFRule* UCiFTriggerContext::getChange() const
 {
+	// resolved when the context is made or loaded, the lookup is only a fallback
+	if (mChange) {
+		return mChange;
+	}
 	if (mId == UCiFTrigger::mStatusTimeoutTriggerID) {
 		return mStatusTimeoutChange;
 	}
 	const auto cifManager = GetWorld()->GetGameInstance()->GetSubsystem<UCiFSubsystem>()->getInstance();
 	const auto trigger = cifManager->mSFDB->getTriggerByID(mId);
-	return trigger->mChange;
+	return trigger ? trigger->mChange : nullptr;
 }
 
 bool UCiFTriggerContext::doPredicateRoleMatchCharacterVariables(UCiFPredicate* predInChange,
                                                                 UCiFGameObject* c1,
                                                                 UCiFGameObject* c2,
                                                                 UCiFGameObject* c3,
-                                                                UCiFPredicate* predInEvalRule) const
+                                                                UCiFPredicate* predInEvalRule)
 {
 	/*The trick to this function is that the x,y, and z are in correspondence with the predicates primary
 	 * secondary, and tertiary character variables. This means we need to translate the predicates character
@@ -162,7 +177,7 @@ bool UCiFTriggerContext::doesPredicateRoleMatch(UCiFPredicate* predInEvalRule,
                                                 const FName roleInChange,
                                                 UCiFGameObject* x,
                                                 UCiFGameObject* y,
-                                                UCiFGameObject* z) const
+                                                UCiFGameObject* z)
 {
 	FName characterReferredToInEvalRule;
 	FName characterReferredToInPredInChange;
@@ -220,6 +235,10 @@ UCiFTriggerContext* UCiFTriggerContext::loadFromJson(const TSharedPtr<FJsonObjec
 
 	const auto ruleJson = json->GetObjectField("Rule");
 	tc->mStatusTimeoutChange = UCiFRule::loadFromJson(ruleJson, worldContextObject);
+	// the rule is only the change of status timeouts, the other triggers' changes are looked up by id
+	if (tc->mId == UCiFTrigger::mStatusTimeoutTriggerID) {
+		tc->mChange = tc->mStatusTimeoutChange;
+	}
 	
 	return tc;
 }
@@ -5,6 +5,7 @@
 
 #include "CiFCast.h"
 #include "CiFCharacter.h"
+#include "CiFIntentScheduler.h"
 #include "CiFManager.h"
 #include "CiFPredicate.h"
 #include "CiFProspectiveMemory.h"
@@ -18,6 +19,22 @@ UCiFCharacter* UDemoCifImplementation::chooseNPCInitiatorForSocialGame()
 {
 	checkf(mCifManager != nullptr, TEXT("CiF manager wasn't initialized in the implementation"));
 	const auto numOfChars = mCifManager->mCast->mCharacters.Num();
+
+	// while a time sliced intent pass is running, prefer the next characters that already finished
+	// forming their intents, so the chosen initiator acts upon a refreshed prospective memory
+	const auto scheduler = mCifManager->mIntentScheduler;
+	if (scheduler && scheduler->isRunning()) {
+		for (int i = 1; i <= numOfChars; i++) {
+			const auto index = (mCharacterIndexInCast + i) % numOfChars;
+			const auto c = mCifManager->mCast->mCharacters[index];
+			if (c->mObjectName != "Player" && scheduler->isIntentFormedFor(c)) {
+				mCharacterIndexInCast = index;
+				UE_LOG(LogTemp, Log, TEXT("Chosen initiator: %s"), *(c->mObjectName.ToString()));
+				return c;
+			}
+		}
+	}
+
 	mCharacterIndexInCast = (mCharacterIndexInCast + 1) % numOfChars;
 	auto initiator = mCifManager->mCast->mCharacters[mCharacterIndexInCast];
 	if (initiator->mObjectName == "Player") {
@@ -55,4 +55,5 @@ public:
 	FName mHead;         // can represent characters or nouns
 	FName mTail;         // can represent nouns (/items) or truth labels
 	ESubjectiveLabel mConnection;
+	ETruthLabel mTruthLabel = ETruthLabel::INVALID; // the tail of general truth entries as an enum, so it isn't looked up by name
 };
@@ -33,6 +33,16 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void addCharacter(UCiFCharacter* c);	
 
+	/**
+	 * Must be called after changing mCharacters directly (e.g. replacing a character), so the manager's game object
+	 * lookups see the change. addCharacter calls it.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void markCharactersChanged() { mVersion++; }
+
+	/* @return A number that changes whenever the characters change, see markCharactersChanged */
+	uint32 getVersion() const { return mVersion; }
+
 	static UCiFCast* loadFromJson(const TSharedPtr<FJsonObject> json, const UObject* worldContextObject);
 public:
 
@@ -42,5 +52,7 @@ public:
 	UPROPERTY(BlueprintReadOnly)
 	TMap<FName, UCiFCharacter*> mCharactersByName; // for fast lookup - represents the same characters in @mCharacters
 
+private:
+	uint32 mVersion = 0;
 	
 };
@@ -9,6 +9,38 @@
 
 class UCiFCKBEntry;
 
+/* A head of subjective entries with their connection, the key of the subjective index */
+struct FCiFCKBHeadKey
+{
+	FName mHead;
+	ESubjectiveLabel mConnection; // INVALID for any connection
+
+	bool operator==(const FCiFCKBHeadKey& other) const { return mHead == other.mHead && mConnection == other.mConnection; }
+
+	friend uint32 GetTypeHash(const FCiFCKBHeadKey& key)
+	{
+		return HashCombine(GetTypeHash(key.mHead), static_cast<uint32>(key.mConnection));
+	}
+};
+
+/* A findItems query, the key of the cached item bitsets */
+struct FCiFCKBQueryKey
+{
+	FName mHead;
+	ESubjectiveLabel mConnection;
+	ETruthLabel mLabel;
+
+	bool operator==(const FCiFCKBQueryKey& other) const
+	{
+		return mHead == other.mHead && mConnection == other.mConnection && mLabel == other.mLabel;
+	}
+
+	friend uint32 GetTypeHash(const FCiFCKBQueryKey& key)
+	{
+		return HashCombine(GetTypeHash(key.mHead), static_cast<uint32>(key.mConnection) << 8 | static_cast<uint32>(key.mLabel));
+	}
+};
+
 /**
  * Holds the subjective knowledge (e.g. "Adam likes ice creams") and the general truth in the world (e.g. "Stealing is bad").
  * While something considered to be bad, that doesnt mean characters won't do it or like it.
@@ -34,14 +66,69 @@ public:
 	               const ESubjectiveLabel connectionTyp = ESubjectiveLabel::INVALID,
 	               const ETruthLabel label = ETruthLabel::INVALID) const;
 
+	/**
+	 * Same as findItems, but returns the ids of the items sorted, so results can be intersected (see intersectItemIds).
+	 * Two index lookups and one merge, regardless of the number of entries.
+	 */
+	void findItemIds(const FName character,
+	                 TArray<int32>& outItemIds,
+	                 const ESubjectiveLabel connectionType = ESubjectiveLabel::INVALID,
+	                 const ETruthLabel label = ETruthLabel::INVALID) const;
+
+	/* Reference implementation of findItems that scans all the entries, used by reference evaluation. Each item is found once */
+	void findItemsByScan(const FName character,
+	                     TArray<FName>& outputItems,
+	                     const ESubjectiveLabel connectionType = ESubjectiveLabel::INVALID,
+	                     const ETruthLabel label = ETruthLabel::INVALID) const;
+
+	/**
+	 * The items findItems finds, as a bitset over the item ids. Computed once per query and cached until the index
+	 * is rebuilt, so intersecting the items of two characters is an AND over a few words.
+	 */
+	const TBitArray<>& getItemBits(const FName character,
+	                               const ESubjectiveLabel connectionType = ESubjectiveLabel::INVALID,
+	                               const ETruthLabel label = ETruthLabel::INVALID) const;
+
+	/* @return The number of items in both bitsets returned by getItemBits */
+	static int32 countCommonItems(const TBitArray<>& itemBits1, const TBitArray<>& itemBits2);
+
+	FName getItemName(const int32 itemId) const { return mItemNames[itemId]; }
+
+	/* Fills @outItemIds with the ids found in both sorted id arrays, sorted */
+	static void intersectItemIds(const TArray<int32>& itemIds1, const TArray<int32>& itemIds2, TArray<int32>& outItemIds);
+
+	/* Builds the indices of the entries, must be called whenever the entries change (addEntry and removeEntry call it) */
+	UFUNCTION(BlueprintCallable)
+	void buildIndex();
+
+	/* Adds the entry to the subjective or general truth entries by its type, and rebuilds the indices */
+	UFUNCTION(BlueprintCallable)
+	void addEntry(UCiFCKBEntry* entry);
+
+	/* Removes the entry and rebuilds the indices */
+	UFUNCTION(BlueprintCallable)
+	void removeEntry(UCiFCKBEntry* entry);
+
 
 	static UCiFCulturalKnowledgeBase* loadFromJson(const TSharedPtr<FJsonObject> json, const UObject* worldContextObject);
 
 protected:
-	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	// the entries are read only, the indices are built from them (see addEntry)
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	TArray<UCiFCKBEntry*> mSubjectiveEntries;
-	// example: john likes pizza //TODO: maybe think of a better structure for faster lookup of knowledge
+	// example: john likes pizza
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
 	TArray<UCiFCKBEntry*> mGeneralTruthEntries; // example: pizza is tasty
+
+private:
+	int32 getItemId(const FName item);
+
+	TArray<FName> mItemNames;    // item id -> item name, the ids are given in the order the items are first seen
+	TMap<FName, int32> mItemIds; // item name -> item id
+
+	TMap<FCiFCKBHeadKey, TArray<int32>> mItemsByHead; // sorted ids of the items a head is connected to
+	TMap<ETruthLabel, TArray<int32>> mItemsByTruth;   // sorted ids of the items with a truth label, INVALID for any label
+
+	mutable TMap<FCiFCKBQueryKey, TUniquePtr<TBitArray<>>> mItemBitsCache; // the bitsets stay where they are as the map grows
 };
@@ -0,0 +1,107 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "CiFDifferentialTester.generated.h"
+
+class UCiFCharacter;
+class UCiFManager;
+class UCiFGameObject;
+class UCiFPredicate;
+class UCiFSocialExchange;
+struct FCiFTriggerMatch;
+
+/**
+ * A point where the optimized evaluation disagreed with the reference evaluation
+ */
+USTRUCT(BlueprintType)
+struct FCiFDivergence
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	FString mDescription; // the predicate or trigger that diverged
+
+	UPROPERTY(BlueprintReadOnly)
+	TArray<FName> mTuple; // the game objects bound to the predicate or trigger roles
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 mTurn = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	bool mReferenceResult = false;
+
+	UPROPERTY(BlueprintReadOnly)
+	bool mOptimizedResult = false;
+};
+
+/**
+ * Debug mode that runs the reference evaluation side by side with the optimized one and reports where they disagree.
+ *
+ * Every optimized path (indices, caches, precomputed metadata) must be skipped when the manager's
+ * mIsReferenceEvaluation is set - that is how the reference result is computed. When enabled, each predicate
+ * evaluation and each trigger pass is repeated in reference mode and compared to the optimized result.
+ * The reference pass is only a query and doesn't change the social state.
+ */
+UCLASS(BlueprintType)
+class CIF_API UCiFDifferentialTester : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	void init(UCiFManager* cifManager);
+
+	UFUNCTION(BlueprintCallable)
+	void reset();
+
+	/* @return True if evaluations happening now should be checked against the reference */
+	bool isActive() const;
+
+	/**
+	 * Evaluates the predicate in reference mode and compares it to the optimized result
+	 * @param optimizedResult	The result of the optimized evaluation of the predicate on the same tuple
+	 */
+	void checkPredicate(UCiFPredicate* pred,
+	                    const UCiFGameObject* c1,
+	                    const UCiFGameObject* c2,
+	                    const UCiFGameObject* c3,
+	                    const UCiFSocialExchange* se,
+	                    const bool optimizedResult);
+
+	/**
+	 * Checks that an exchange the precondition prefilter discarded for the pair (see FCiFPreconditionSignature)
+	 * also fails its preconditions in reference mode. The prefilter may admit exchanges that fail, never the other way around
+	 */
+	void checkPreconditionFilter(UCiFSocialExchange* se,
+	                             UCiFCharacter* initiator,
+	                             UCiFGameObject* responder,
+	                             const TArray<UCiFGameObject*>& possibleOthers);
+
+	/* Compares the triggers that fired in the optimized trigger pass to those that fired in the reference pass */
+	void checkTriggerMatches(const TArray<FCiFTriggerMatch>& optimized, const TArray<FCiFTriggerMatch>& reference);
+
+	UFUNCTION(BlueprintCallable)
+	bool hasDiverged() const { return mNumDivergences > 0; }
+
+private:
+	void reportDivergence(const FCiFDivergence& divergence);
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool mIsEnabled = false;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 mNumChecks = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 mNumDivergences = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	FCiFDivergence mFirstDivergence; // only valid if hasDiverged()
+
+private:
+	UPROPERTY()
+	UCiFManager* mCifManager = nullptr;
+};
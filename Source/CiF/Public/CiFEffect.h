@@ -68,6 +68,8 @@ public:
 	bool hasSFDBLabel() const;
 
 	bool isRoleRequired(const FName role) const;
+	bool isResponderRequired() const;
+	bool isOtherRequired() const;
 
 	/**
 	 * @return predicate of type CKBEntry or null if no such predicate in effect's condition rule
@@ -181,4 +181,7 @@ public:
 	
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly)
 	uint8 mNetworkId; // The ID that this character is represented by in a social network.
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 mHandle = INDEX_NONE; // The handle of this object in the manager's game object registry (see FCiFGameObjectRegistry)
 };
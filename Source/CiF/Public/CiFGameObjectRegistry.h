@@ -0,0 +1,78 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CiFGameObject.h"
+
+class UCiFCharacter;
+class UCiFItem;
+class UCiFKnowledge;
+
+/**
+ * All the game objects of the manager in one array indexed by handle, so every object has a handle that can be kept
+ * and passed around instead of its name. Names are resolved with a single hash lookup.
+ * Handles are stable: objects added later (e.g. UCiFCast::addCharacter) are appended with new handles, and the handle
+ * of an object that was removed is never reused, it resolves to null (see update).
+ */
+struct CIF_API FCiFGameObjectRegistry
+{
+	/**
+	 * Assigns handles to the objects in this order, replacing the ones assigned before
+	 * @param version	The version of the arrays, see isBuiltFrom
+	 */
+	void build(const TArray<UCiFCharacter*>& characters, const TArray<UCiFItem*>& items, const TArray<UCiFKnowledge*>& knowledge, const uint32 version);
+
+	/* Appends the objects that aren't registered yet, and drops the registered ones that aren't in these arrays anymore */
+	void update(const TArray<UCiFCharacter*>& characters, const TArray<UCiFItem*>& items, const TArray<UCiFKnowledge*>& knowledge, const uint32 version);
+
+	void reset();
+
+	/* @return The handle of the object named @name, or INVALID_HANDLE if there is none */
+	int32 getHandle(const FName name) const
+	{
+		const auto handle = mHandles.Find(name);
+		return handle ? *handle : INVALID_HANDLE;
+	}
+
+	/* @return The object of @handle, or nullptr if the handle is invalid or stale (its object was removed) */
+	UCiFGameObject* getObject(const int32 handle) const { return mObjectsByHandle.IsValidIndex(handle) ? mObjectsByHandle[handle] : nullptr; }
+
+	/* @return The object named @name, or nullptr if there is none */
+	UCiFGameObject* findObject(const FName name) const { return getObject(getHandle(name)); }
+
+	/* @return The registered objects in the order of their handles */
+	TConstArrayView<UCiFGameObject*> getObjects() const { return mObjects; }
+
+	/* @return The objects of @type in the order of their handles */
+	TConstArrayView<UCiFGameObject*> getObjectsOfType(const ECiFGameObjectType type) const { return mObjectsByType[static_cast<int32>(type)]; }
+
+	int32 num() const { return mObjects.Num(); }
+
+	/**
+	 * @return False if the arrays changed since the registry was built or updated from them: their version changed
+	 * (e.g. an object was replaced, see UCiFCast::markCharactersChanged) or objects were added or removed
+	 */
+	bool isBuiltFrom(const TArray<UCiFCharacter*>& characters, const TArray<UCiFItem*>& items, const TArray<UCiFKnowledge*>& knowledge, const uint32 version) const
+	{
+		return mSourceVersion == version && mNumSourceObjects == characters.Num() + items.Num() + knowledge.Num();
+	}
+
+	inline static constexpr int32 INVALID_HANDLE = INDEX_NONE;
+
+private:
+	static constexpr int32 NUM_TYPES = static_cast<int32>(ECiFGameObjectType::KNOWLEDGE) + 1;
+
+	/* Gives @go the next handle, unless it is registered already or its name is taken */
+	void add(UCiFGameObject* go);
+
+	/* Drops @go, its handle stays reserved and resolves to null */
+	void remove(UCiFGameObject* go);
+
+	TArray<UCiFGameObject*> mObjectsByHandle;        // handle -> object, null for the objects that were removed
+	TArray<UCiFGameObject*> mObjects;                // the registered objects, without the removed ones
+	TArray<UCiFGameObject*> mObjectsByType[NUM_TYPES];
+	TMap<FName, int32> mHandles;                     // object name -> handle
+	int32 mNumSourceObjects = INDEX_NONE;            // the objects the registry was updated from, duplicate names included
+	uint32 mSourceVersion = 0;                       // the version of the arrays the registry was updated from
+};
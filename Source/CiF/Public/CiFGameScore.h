@@ -25,6 +25,11 @@ struct FGameScore
 	UPROPERTY()
 	int8 mScore;
 
+	friend FArchive& operator<<(FArchive& ar, FGameScore& score)
+	{
+		return ar << score.mName << score.mInitiator << score.mResponder << score.mOther << score.mScore;
+	}
+
 	bool operator<(const FGameScore& o) const
 	{
 		// score in a descending order
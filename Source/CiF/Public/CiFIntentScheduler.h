@@ -0,0 +1,135 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tickable.h"
+#include "UObject/Object.h"
+#include "CiFIntentScheduler.generated.h"
+
+class UCiFManager;
+class UCiFCharacter;
+class UCiFGameObject;
+class UCiFSocialExchange;
+struct FCiFSessionCallScope;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnIntentFormationProgress, float, progress);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCharacterIntentFormed, UCiFCharacter*, initiator);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnIntentFormationCompleted);
+
+/**
+ * Splits the intent formation pass (formIntentForAll) into small work items of
+ * initiator x responder x chunk of social exchanges, and runs them under a time budget
+ * on every game tick so a full pass doesn't stall the game thread.
+ *
+ * Initiators are processed one after the other, so each character's prospective memory is
+ * cleared right before its first work item and is fully refreshed once its last work item
+ * is done. Characters that weren't reached yet keep the memory from the previous pass.
+ */
+UCLASS(BlueprintType)
+class CIF_API UCiFIntentScheduler : public UObject, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	void init(UCiFManager* cifManager);
+
+	/**
+	 * Starts a new intent formation pass over the current cast and social exchanges library.
+	 * If a pass is already running it is restarted from the beginning.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void startPass();
+
+	/* Stops the current pass. Characters that weren't finished keep a partially formed prospective memory */
+	UFUNCTION(BlueprintCallable)
+	void cancelPass();
+
+	/**
+	 * Runs work items until the time budget is exhausted or the pass is done.
+	 * This is called automatically every tick while a pass is running, but can be called
+	 * manually to advance the pass with a custom budget.
+	 * @param budgetMs	The time budget in milliseconds
+	 * @return True if the pass is finished
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool runForBudget(const float budgetMs);
+
+	/**
+	 * Runs @numWorkItems work items, or less if the pass is done before. Used to replay the slices of a recorded pass
+	 * @return True if the pass is finished
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool runWorkItems(const int32 numWorkItems);
+
+	UFUNCTION(BlueprintCallable)
+	bool isRunning() const { return mIsRunning; }
+
+	/* @return True if the character finished forming intents in the current (or last) pass */
+	UFUNCTION(BlueprintCallable)
+	bool isIntentFormedFor(const UCiFCharacter* character) const;
+
+	/* @return The fraction [0,1] of the work items that were processed in the current pass */
+	UFUNCTION(BlueprintCallable)
+	float getProgress() const;
+
+	/************************** FTickableGameObject *******************************/
+
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+
+private:
+	/* Runs the work item at the cursor and advances it. @return False if it was the last work item */
+	bool runWorkItem();
+
+	/* Advances the cursor to the next work item. @return False if there are no work items left */
+	bool advanceCursor();
+
+	/* Records the work items that ran in a slice, and broadcasts the progress if the pass isn't done */
+	void endSlice(const FCiFSessionCallScope& sessionScope, const int32 numWorkItems);
+
+	void finishInitiator();
+
+public:
+	UPROPERTY(BlueprintAssignable, Category = "Events")
+	FOnIntentFormationProgress OnIntentFormationProgress;
+
+	UPROPERTY(BlueprintAssignable, Category = "Events")
+	FOnCharacterIntentFormed OnCharacterIntentFormed;
+
+	UPROPERTY(BlueprintAssignable, Category = "Events")
+	FOnIntentFormationCompleted OnIntentFormationCompleted;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float mFrameBudgetMs = 2.f; // time in milliseconds that the scheduler is allowed to spend on each tick
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 mExchangesPerWorkItem = 4; // number of social exchanges scored between time checks
+
+private:
+	UPROPERTY()
+	UCiFManager* mCifManager = nullptr;
+
+	/* Snapshot of the cast taken when the pass started, so the cursor stays valid across ticks */
+	UPROPERTY()
+	TArray<UCiFCharacter*> mCharacters;
+
+	int32 mNumExchanges = 0; // exchanges are formed by their library index, the library shouldn't change during a pass
+
+	UPROPERTY()
+	TArray<UCiFGameObject*> mPossibleOthers;
+
+	TArray<bool> mIsInitiatorDone; // indexed same as mCharacters
+
+	// cursor of the next work item
+	int32 mInitiatorIndex = 0;
+	int32 mResponderIndex = 0;
+	int32 mExchangeIndex = 0;
+	bool mIsInitiatorStarted = false; // true once the prospective memory of the current initiator was cleared
+
+	int32 mProcessedExchanges = 0;
+	int32 mTotalExchanges = 0;
+
+	bool mIsRunning = false;
+};
@@ -0,0 +1,154 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Utilities.h"
+#include "UObject/Object.h"
+#include "CiFJournal.generated.h"
+
+class UCiFManager;
+class UCiFSocialFactsDataBase;
+class FWriteAheadLog;
+struct FCiFSFDBRecord;
+enum class ESocialNetworkType : uint8;
+enum class EStatus : uint8;
+
+UENUM()
+enum class ECiFJournalOp : uint8
+{
+	NETWORK_WEIGHT,
+	ADD_STATUS,
+	REMOVE_STATUS,
+	UPDATE_STATUS_DURATIONS,
+	STATUS_DURATION,
+	SFDB_RECORD,
+	EFFECT_SEEN,
+	TIME
+};
+
+/**
+ * Crash-safe journal of the social state, kept in a write-ahead log (see FWriteAheadLog).
+ *
+ * Every change to the social state is journaled where it happens - network weights, statuses, SFDB records, the time
+ * effects were last seen and the CiF time - at every call depth, so changeSocialState, trigger valuations and direct
+ * changes made by the game are all covered. The changes of an outermost call (e.g. a whole changeSocialState) are
+ * committed together with a single write, so a turn is either recovered whole or not at all. Every mCheckpointInterval
+ * turns the log is replaced by a checkpoint of the whole state, and recovery loads the checkpoint and replays the tail.
+ *
+ * Network weights are journaled by value and SFDB records in full, but statuses by the call that changed them, so
+ * recovery must start from a manager initialized from the same data as the journaled one.
+ */
+UCLASS(BlueprintType)
+class CIF_API UCiFJournal : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	UCiFJournal();
+	virtual ~UCiFJournal() override;
+
+	void init(UCiFManager* cifManager);
+
+	/**
+	 * Starts journaling to a new log at @filePath, beginning with a checkpoint of the current state
+	 * @return False if the log can't be written
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool start(const FString& filePath);
+
+	/* Stops journaling, changes that weren't committed yet are dropped */
+	UFUNCTION(BlueprintCallable)
+	void stop();
+
+	UFUNCTION(BlueprintCallable)
+	bool isJournaling() const;
+
+	/**
+	 * Sets the state to the one journaled in the log at @filePath and continues journaling to it.
+	 * Must be called on a manager that was initialized from the same data as the journaled one.
+	 * @return False if the log has no valid checkpoint or it can't be loaded on this manager
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool recover(const FString& filePath);
+
+	/* Replaces the log with a checkpoint of the current state */
+	UFUNCTION(BlueprintCallable)
+	bool checkpoint();
+
+	/**
+	 * Called when the state changed without being journaled (e.g. restoring a fork). The log is checkpointed when the
+	 * next journaled call commits, instead of on every restore; until then recovery gives the state before the restore.
+	 */
+	void requestCheckpoint();
+
+	/* @return The journal changes should be journaled to now, or null if there is none or it is suspended */
+	static UCiFJournal* getActiveJournal() { return mActiveJournal && !mActiveJournal->mIsSuspended ? mActiveJournal : nullptr; }
+
+	void logNetworkWeight(const ESocialNetworkType type, const uint8 c1, const uint8 c2, const uint8 weight);
+	void logAddStatus(const FName object, const EStatus statusType, const int32 duration, const FName towards);
+	void logRemoveStatus(const FName object, const EStatus statusType, const FName towards);
+	void logUpdateStatusDurations(const FName object, const int32 timeElapsed);
+	void logStatusDuration(const FName object, const EStatus statusType, const FName towards, const int32 remainingDuration);
+	void logSFDBRecord(const UCiFSocialFactsDataBase* sfdb, const FCiFSFDBRecord& record);
+	void logEffectSeen(const FName socialExchange, const IdType effectId, const int32 time);
+	void logTime(const int32 time);
+
+	/**
+	 * Marks the beginning/end of a call that changes the social state. The end of the outermost call commits
+	 * its changes to the log, and checkpoints it if mCheckpointInterval turns passed since the last checkpoint.
+	 */
+	void beginCall() { mCallDepth++; }
+	void endCall();
+
+	virtual void BeginDestroy() override;
+
+	inline static UCiFJournal* mActiveJournal = nullptr; // the journal that is journaling, if any
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 mCheckpointInterval = 50; // turns between checkpoints, 0 only checkpoints when started
+
+	/**
+	 * Set while the state is changed speculatively and will be restored (e.g. lookahead planning), so the changes
+	 * aren't journaled. The state must be back where it was when journaling resumes.
+	 */
+	bool mIsSuspended = false;
+
+private:
+	void writeCheckpoint(TArray<uint8>& outCheckpoint) const;
+	bool readCheckpoint(const TArray<uint8>& checkpointData);
+	void replayChanges(const TArray<uint8>& changes);
+
+	UPROPERTY()
+	UCiFManager* mCifManager = nullptr;
+
+	TUniquePtr<FWriteAheadLog> mLog; // FileSystemUtilities is a private dependency, so the log isn't exposed by this header
+	TArray<uint8> mChanges; // the changes of the current outermost call, committed to the log as one record
+	int32 mCallDepth = 0;
+	int32 mCheckpointTime = 0; // CiF time of the last checkpoint
+	bool mIsCheckpointRequested = false; // the log is behind the state, the next commit writes a checkpoint instead
+};
+
+/**
+ * Scopes a call that changes the social state for the journal, so its changes are committed when the outermost call ends
+ */
+struct FCiFJournalScope
+{
+	FCiFJournalScope()
+		: mJournal(UCiFJournal::mActiveJournal)
+	{
+		if (mJournal) {
+			mJournal->beginCall();
+		}
+	}
+
+	~FCiFJournalScope()
+	{
+		if (mJournal) {
+			mJournal->endCall();
+		}
+	}
+
+private:
+	UCiFJournal* mJournal;
+};
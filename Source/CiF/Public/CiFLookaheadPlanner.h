@@ -0,0 +1,120 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CiFSocialNetwork.h"
+#include "UObject/Object.h"
+#include "CiFLookaheadPlanner.generated.h"
+
+class UCiFManager;
+class UCiFCharacter;
+class UCiFGameObject;
+class UCiFSocialExchange;
+
+/**
+ * A goal of an NPC expressed as a network edge it wants to raise.
+ * For example {ROMANCE, "Edward", true} means "I want Edward to have romantic feelings towards me".
+ */
+USTRUCT(BlueprintType)
+struct FCiFSocialGoal
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	ESocialNetworkType mNetworkType;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	FName mTarget; // the character on the other side of the edge
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool mIsTargetTowardsSelf = true; // true if the edge is target->self, false if self->target
+};
+
+/**
+ * The first move of the best sequence found by the planner
+ */
+USTRUCT(BlueprintType)
+struct FCiFPlannedMove
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	FName mSocialExchangeName;
+
+	UPROPERTY(BlueprintReadOnly)
+	FName mResponderName;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 mGoalValue = 0; // the goal edge weight at the end of the best sequence
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 mExpandedNodes = 0; // number of simulated moves that were needed to find this move
+};
+
+/**
+ * Plans a few social moves ahead for an NPC instead of greedily picking the move with the highest volition.
+ *
+ * Each node in the search plays a social exchange with playGame/changeSocialState on the live state,
+ * scores the state against the NPC's goal (or continues deeper), and then restores the state from a
+ * fork taken before the move. The search is a depth-limited branch and bound:
+ *	- exchanges whose initiator influence rules can't sum to a positive volition are never considered,
+ *	  since the NPC would never want to play them.
+ *	- each exchange has an upper bound of how much it can raise the goal edge (the sum of its network
+ *	  increases, plus the increases of the triggers that run after it), and a branch is cut when even
+ *	  this bound can't beat the best sequence found so far. The pruning is heuristic: a trigger that fires
+ *	  for more than one binding in a turn raises the edge more than once, which the bound doesn't count.
+ *	- the total number of simulated moves is capped by a node budget.
+ * The rollouts run one after the other on the game thread, since each one plays on the live state.
+ */
+UCLASS(BlueprintType)
+class CIF_API UCiFLookaheadPlanner : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	void init(UCiFManager* cifManager);
+
+	/**
+	 * @param npc	The character to plan for
+	 * @param goal	The goal edge to raise
+	 * @param outMove	The first move of the best sequence that was found
+	 * @return True if a move was found
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool planBestMove(UCiFCharacter* npc, const FCiFSocialGoal& goal, FCiFPlannedMove& outMove);
+
+private:
+	/* Static per-exchange bounds, computed once per goal network type */
+	struct FExchangeBounds
+	{
+		UCiFSocialExchange* mExchange = nullptr;
+		float mMaxInitiatorVolition = 0; // sum of the positive initiator influence rule weights
+		int32 mMaxGoalIncrease = 0; // the highest increase of the goal network any of the effects can do, with the triggers'
+	};
+
+	void computeBounds(const ESocialNetworkType goalNetworkType);
+
+	/* @return The best goal value reachable within depth moves from the current live state */
+	int32 search(UCiFCharacter* npc, UCiFGameObject* target, const int32 depth, int32 bestSoFar, FCiFPlannedMove* outFirstMove);
+
+	int32 evaluateGoal(const UCiFCharacter* npc, const UCiFGameObject* target) const;
+
+public:
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 mDepth = 2; // number of moves to look ahead
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 mNodeBudget = 256; // max number of simulated moves per plan
+
+private:
+	UPROPERTY()
+	UCiFManager* mCifManager = nullptr;
+
+	TArray<FExchangeBounds> mBounds; // sorted by max goal increase, descending
+	ESocialNetworkType mBoundsNetworkType;
+	bool mIsBoundsValid = false;
+
+	FCiFSocialGoal mGoal;
+	int32 mExpandedNodes = 0;
+};
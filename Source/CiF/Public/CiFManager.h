@@ -5,8 +5,11 @@
 #include "CoreMinimal.h"
 #include "CiFCharacter.h"
 #include "CiFEffect.h"
+#include "CiFGameObjectRegistry.h"
 #include "CiFSocialExchange.h"
 #include "CiFSocialNetwork.h"
+#include "CiFSocialStateDiff.h"
+#include "CiFSocialStateSnapshot.h"
 #include "UObject/Object.h"
 #include "CiFManager.generated.h"
 
@@ -24,11 +27,54 @@ class UCiFSocialFactsDataBase;
 class UCiFSocialExchange;
 class UCiFSocialExchangesLibrary;
 class UCiFCast;
+class UCiFIntentScheduler;
+class UCiFLookaheadPlanner;
+class UCiFSessionRecorder;
+class UCiFDifferentialTester;
+class UCiFJournal;
+struct FCiFSessionEvent;
+struct FCiFSessionCallScope;
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnSocialNetworkUpdated, ESocialNetworkType, type);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnRelationshipUpdated, ERelationshipType, type);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnStatusUpdated, EPredicateType, predType);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnSocialStateCommitted, int32, time);
 
+/**
+ * Result of a fast forward simulation
+ */
+USTRUCT(BlueprintType)
+struct FCiFFastForwardStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 mTurnsPlayed = 0; // turns where a social exchange was actually played
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 mTurnsSkipped = 0; // turns where the initiator had nothing it wanted to play
+
+	UPROPERTY(BlueprintReadOnly)
+	float mSeconds = 0.f;
+
+	UPROPERTY(BlueprintReadOnly)
+	float mTurnsPerSecond = 0.f;
+};
+
+/**
+ * A social state change that was played but not yet applied, waiting for the next sync point
+ */
+USTRUCT()
+struct FPendingSocialStateChange
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UCiFSocialExchangeContext* mContext = nullptr;
+
+	UPROPERTY()
+	TArray<UCiFGameObject*> mOtherCast;
+};
 
 /**
  * 
@@ -54,10 +100,20 @@ public:
 
 	UPROPERTY(BlueprintAssignable, Category = "Events")
 	FOnSocialNetworkUpdated OnSocialNetworkUpdated;
+
+	UPROPERTY(BlueprintAssignable, Category = "Events")
+	FOnSocialStateCommitted OnSocialStateCommitted;
 	
 	UFUNCTION(BlueprintCallable)
 	void formIntentForAll();
 
+	/**
+	 * Same as formIntentForAll but spreads the work over multiple ticks under the time budget
+	 * of the intent scheduler. Listen to the scheduler's delegates to know when the pass is done.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void formIntentForAllTimeSliced();
+
 	/**
 	 * Performs intent planning for a single character. This process scores
 	 * all possible social games for all other characters and stores the 
@@ -80,6 +136,17 @@ public:
 	 */
 	void formIntentForSocialGames(UCiFCharacter* initiator, UCiFGameObject* responder, const TArray<UCiFGameObject*>& possibleOthers = {});
 
+	/**
+	 * Forms intent for the social exchanges of the library in [firstIndex, endIndex) between two characters.
+	 * The exchanges whose precondition signature doesn't admit the pair (see FCiFPreconditionSignature) are scored
+	 * as failing their preconditions without evaluating them.
+	 */
+	void formIntentForSocialExchangeRange(UCiFCharacter* initiator,
+	                                      UCiFGameObject* responder,
+	                                      const TArray<UCiFGameObject*>& possibleOthers,
+	                                      const int32 firstIndex,
+	                                      const int32 endIndex);
+
 	void formIntentForSpecificSocialExchange(UCiFSocialExchange* socialExchange,
 	                                         UCiFCharacter* initiator,
 	                                         UCiFGameObject* responder,
@@ -161,6 +228,151 @@ public:
 	                          TArray<UCiFGameObject*> levelCast = {});
 
 	void changeSocialState(UCiFSocialExchangeContext* sgContext, TArray<UCiFGameObject*> otherCast = {});
+
+	/**
+	 * Queues the social state change of a played social exchange instead of applying it immediately.
+	 * Queued changes are applied in order on the next call to syncSocialState, so the game can decide
+	 * when the (relatively heavy) valuations and triggers run.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void queueSocialStateChange(UCiFSocialExchangeContext* sgContext, TArray<UCiFGameObject*> otherCast);
+
+	/**
+	 * The sync point between the live social state and the committed one.
+	 * Applies all queued social state changes and then copies the resulting networks and statuses into the
+	 * committed snapshot that is read by getCommittedNetworkWeight and hasCommittedStatus.
+	 * The evaluation runs on the game thread: predicates and rule scoring make UObjects (rule records, status
+	 * predicates) and read actor components, so it can't move to a worker thread. Intent formation is spread over
+	 * ticks by UCiFIntentScheduler instead.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void syncSocialState();
+
+	UFUNCTION(BlueprintCallable)
+	bool hasPendingSocialStateChanges() const { return !mPendingStateChanges.IsEmpty(); }
+
+	/**
+	 * Reads a network weight from the last committed social state. Meant for UI and animation
+	 * code that should see a stable state between sync points.
+	 */
+	UFUNCTION(BlueprintCallable)
+	uint8 getCommittedNetworkWeight(const ESocialNetworkType netType, const uint8 id1, const uint8 id2) const;
+
+	/**
+	 * The UCiFGameObject::hasStatus of the last committed social state, see getCommittedNetworkWeight.
+	 * @param towards	The name of the object the status is directed to, none if not looking for a directed status
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool hasCommittedStatus(const FName objectName, const EStatus statusType, const FName towards = NAME_None) const;
+
+	/**
+	 * Re-seeds the manager's random stream. All the random choices CiF makes (ties between
+	 * others, picking CKB objects) are drawn from this stream or from substreams derived from it,
+	 * so the same seed and the same calls always give the same results.
+	 */
+	UFUNCTION(BlueprintCallable)
+	void setRandomSeed(const int32 seed);
+
+	UFUNCTION(BlueprintCallable)
+	int32 getRandomSeed() const { return mRandomSeed; }
+
+	/**
+	 * @return The stream that random choices should currently be drawn from. This is the substream
+	 *			of the current task (e.g. forming intent of a specific initiator) or the main stream
+	 */
+	const FRandomStream& getRandomStream() const { return mActiveRandomStream ? *mActiveRandomStream : mRandomStream; }
+
+	/**
+	 * Derives an independent stream from the seed and the given keys. The derived stream doesn't
+	 * depend on how many numbers were drawn from the main stream, so a task that uses its own substream
+	 * gives the same results no matter in which order (or in how many slices) the tasks run.
+	 */
+	FRandomStream makeSubstream(const uint32 key1, const uint32 key2 = 0) const;
+
+	/**
+	 * Simulates NPC to NPC play for a number of turns in a tight batch, for generating backstory or balancing.
+	 * Every turn the next character in the cast forms intents, plays its highest scored social exchange and
+	 * the social state is changed accordingly. No delegates are broadcast and the trace logs are skipped while simulating
+	 * (see mIsTraceLogging), and the random stream is seeded so the same seed and state always give the same history.
+	 * @param numTurns			Number of turns to simulate
+	 * @param seed				Seed of the random stream used while simulating
+	 * @param excludedCharacter	A character that shouldn't initiate, respond or be the other (e.g. the player)
+	 * @return Statistics about the simulation, including throughput in turns per second
+	 */
+	UFUNCTION(BlueprintCallable)
+	FCiFFastForwardStats fastForward(const int32 numTurns, const int32 seed = 0, const FName excludedCharacter = "");
+
+	/**
+	 * Forks the mutable social state: social networks, relationship network, statuses, SFDB tail and time.
+	 * The network rows are shared with the live state and copied only when one of the sides writes to them
+	 * (e.g. by predicate valuation), so forking is much cheaper than re-initializing or deep copying.
+	 * Typical what-if usage: fork, play and change the social state, evaluate, then restoreFork.
+	 * The SFDB history after the fork isn't compacted while the fork is alive (see getEarliestRestorableTime).
+	 * @return The forked state
+	 */
+	TSharedRef<FCiFSocialStateSnapshot> fork() const;
+
+	/* Sets the live social state back to a previously forked state. If the journal is journaling, it is checkpointed on its next commit */
+	void restoreFork(const FCiFSocialStateSnapshot& forkedState);
+
+	/**
+	 * Saves the complete mutable CiF state to a versioned binary file: social and relationship networks, traits, statuses
+	 * with their durations, prospective memory scores, the times effects were last seen, the SFDB history and the time.
+	 * The data the manager was initialized from (cast, social exchanges, rules) isn't saved.
+	 * @return True if the file was written
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool saveState(const FString& filePath);
+
+	/**
+	 * Loads a state saved by saveState. Must be called on a manager initialized from the same data as the saved one.
+	 * Pending social state changes are dropped, and the journal is checkpointed on its next commit if it is journaling.
+	 * @return False if the file can't be read or is of an unsupported version, or a game object of it doesn't exist
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool loadState(const FString& filePath);
+
+	/**
+	 * Writes or reads the complete mutable state (see saveState), also used for the journal checkpoints
+	 * @return False if the read state can't be applied to this manager
+	 */
+	bool serializeState(FArchive& ar);
+
+	/**
+	 * The SFDB records from this time on may still be removed by a rollback, a live fork or a tracking diff, so they
+	 * must not be folded by the history compaction. Diffs that were cut and are kept by the game aren't known here.
+	 * @return The earliest time the state can be set back to, MAX_int32 if it can't be set back
+	 */
+	int32 getEarliestRestorableTime() const;
+
+	/**
+	 * Passes a write to a network cell on to the active session recorder, journal and diff. Every network write goes
+	 * through here so the three see the same changes.
+	 * @param sessionScope		Scope of the network call, the event is recorded only for the outermost call
+	 * @param event				The call to record, with its type and argument set; the network and the cell are set here
+	 */
+	static void notifyNetworkWrite(const FCiFSessionCallScope& sessionScope, FCiFSessionEvent& event, ESocialNetworkType type,
+	                               uint8 c1, uint8 c2, uint8 oldWeight, uint8 newWeight);
+
+	inline static constexpr uint32 STATE_MAGIC = 0x53464943; // "CIFS"
+	inline static constexpr uint32 STATE_VERSION = 4;
+
+	/**
+	 * Keeps the changes of the last @numTurns turns so they can be rolled back (see rollbackTo), 0 stops keeping them.
+	 * The changes are kept with their inverse as they are made (see FCiFSocialStateDiff), so nothing is copied per turn.
+	 * The SFDB history of these turns isn't compacted, whatever the retention window (see getEarliestRestorableTime).
+	 */
+	UFUNCTION(BlueprintCallable)
+	void setUndoDepth(const int32 numTurns);
+
+	/**
+	 * Undoes every change made since @time, from the last one, so it costs as much as the changes undone.
+	 * The kept turns are dropped when a state is loaded. Changes that don't go through the state writing
+	 * functions (restoring a fork, applying a diff) aren't kept, and rolling back over them gives a wrong state.
+	 * @return False if @time is in the future or older than the kept turns
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool rollbackTo(const int32 time);
 	
 	/**
 	 * Figures out how important each predicate was in the initiator's desire to play a game
@@ -188,6 +400,22 @@ public:
 	/********************************** Getters ********************************/
 	UFUNCTION(BlueprintCallable)
 	UCiFGameObject* getGameObjectByName(const FName name) const;
+
+	/**
+	 * @return The handle of the game object named @name, or FCiFGameObjectRegistry::INVALID_HANDLE if there is none.
+	 * Code that looks the same objects up repeatedly should keep their handles (or UCiFGameObject::mHandle) instead of their names
+	 */
+	UFUNCTION(BlueprintCallable)
+	int32 getGameObjectHandle(const FName name) const;
+
+	UFUNCTION(BlueprintCallable)
+	UCiFGameObject* getGameObjectByHandle(const int32 handle) const;
+
+	/**
+	 * The characters, items and knowledge with their handles. It is updated if game objects were added or removed since
+	 * it was updated last (e.g. UCiFCast::addCharacter), the handles of the objects that are still there don't change
+	 */
+	const FCiFGameObjectRegistry& getGameObjectRegistry() const;
 	
 	UCiFItem* getItemByName(const FName name) const;
 	UCiFKnowledge* getKnowledgeByName(const FName name) const;
@@ -197,6 +425,7 @@ public:
 
 	UCiFMicrotheory* getMicrotheoryByName(const FName mtName);
 	
+	/* Appends all game objects, see getGameObjectRegistry for iterating them without a copy */
 	void getAllGameObjects(TArray<UCiFGameObject*>& outGameObjs) const;
 	void getAllGameObjectsNames(TArray<FName>& outObjNames) const;
 	
@@ -215,8 +444,7 @@ private:
 
 	/* Load the needed components and CiF state from json files.
 	 * This is for new game initialization.
-	 * For loading existing state, it is suggested to just load game from a
-	 * serialized UE save game system. TODO - when load game will be supported later on
+	 * For loading existing state, initialize from the same files and then loadState.
 	 */
 	void loadSocialGameLib(const FString& filePath, const UObject* worldContextObject);
 	void loadMicrotheories(const FString& filePath, const UObject* worldContextObject);
@@ -263,10 +491,74 @@ public:
 	UPROPERTY(BlueprintReadOnly)
 	UCiFRelationshipNetwork* mRelationshipNetworks;
 
+	UPROPERTY(BlueprintReadOnly)
+	UCiFIntentScheduler* mIntentScheduler;
+
+	UPROPERTY(BlueprintReadOnly)
+	UCiFLookaheadPlanner* mLookaheadPlanner;
+
+	UPROPERTY(BlueprintReadOnly)
+	UCiFSessionRecorder* mSessionRecorder;
+
+	UPROPERTY(BlueprintReadOnly)
+	UCiFDifferentialTester* mDifferentialTester;
+
+	UPROPERTY(BlueprintReadOnly)
+	UCiFJournal* mJournal;
+
+	/**
+	 * When false, social state changes are not broadcast to the game.
+	 * Used while the state is changed speculatively (e.g. lookahead planning) or in batch simulation.
+	 */
+	bool mIsNotifyingChanges = true;
+
+	/**
+	 * When true, evaluation skips every optimized path (indices, caches, precomputed metadata) and uses the
+	 * straightforward implementation. Set by the differential tester while it computes the reference results.
+	 */
+	bool mIsReferenceEvaluation = false;
+
+	/**
+	 * When false, the Log lines written for every rule set scored and every exchange considered are skipped.
+	 * Cleared while fast forwarding, warnings and errors are still logged.
+	 */
+	inline static bool mIsTraceLogging = true;
+
 	/**
 	 * this will always hold the last other that the last responder used while deciding accept/reject
 	 * it should only be referenced immediately after play game
 	 */
 	UPROPERTY()
 	UCiFGameObject* mLastResponderOther;
+
+private:
+	friend UCiFLookaheadPlanner; // scopes its rollouts in random substreams
+	friend UCiFJournal; // recovery moves the sync point to the recovered state
+	friend UCiFSessionRecorder; // replays with the recorded seed and restores the random stream afterwards
+
+	UPROPERTY()
+	TArray<FPendingSocialStateChange> mPendingStateChanges; // changes waiting for the next sync point, in play order
+
+	FCiFSocialStateSnapshot mCommittedState; // the social state as of the last sync point
+
+	mutable FCiFGameObjectRegistry mGameObjectRegistry; // built on demand, see getGameObjectRegistry
+
+	/* Makes the live networks and statuses the committed state, see syncSocialState */
+	void commitState();
+
+	/* Keeps the changes of the turn that ended as an undo step, and drops the oldest step beyond the undo depth */
+	void pushUndoStep();
+
+	/* Drops the kept turns, the state they would roll back to is gone */
+	void clearUndo();
+
+	int32 mUndoDepth = 0;
+	FCiFSocialStateDiff mUndoTracking; // the changes of the current turn, tracked while the undo depth isn't 0
+	TArray<FCiFSocialStateDiff> mUndoSteps; // a diff per turn, the newest last
+
+	mutable TArray<TWeakPtr<FCiFSocialStateSnapshot>> mLiveForks; // the forks that may still be restored
+
+	int32 mRandomSeed = 0;
+	FRandomStream mRandomStream;
+	const FRandomStream* mActiveRandomStream = nullptr; // substream of the current task, nullptr when using the main stream
 };
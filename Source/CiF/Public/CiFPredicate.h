@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "CiFCKBEntry.h"
 #include "CiFGameObject.h"
+#include "CiFGameObjectRegistry.h"
 #include "CiFGameObjectStatus.h"
 #include "UObject/Object.h"
 #include "CiFSocialFactsDataBase.h"
@@ -12,6 +13,7 @@
 #include "CiFPredicate.generated.h"
 
 class UCiFCharacter;
+class UCiFManager;
 enum class ETruthLabel;
 enum class ESubjectiveLabel : uint8;
 enum class ETrait : uint8;
@@ -82,6 +84,30 @@ enum class ENumTimesRoleSlot : uint8
 	SIZE
 };
 
+/**
+ * What a character slot of a predicate (primary, secondary or tertiary) refers to.
+ * Resolved once from the slot name so evaluation and valuation don't compare names.
+ */
+struct FCiFSlotBinding
+{
+	enum class EKind : uint8
+	{
+		NONE,     // empty slot
+		ROLE,     // initiator, responder or other
+		VARIABLE, // x, y or z
+		OBJECT    // a specific game object referenced by name
+	};
+
+	EKind mKind = EKind::NONE;
+	uint8 mIndex = 0; // for roles and variables: 0 for initiator/x, 1 for responder/y, 2 for other/z
+
+	FName mName; // the slot name, the reference evaluation binds by it (see UCiFPredicate::bindSlotByName)
+
+	// for objects: the handle is looked up on first use, as predicates are loaded before the game objects, and again
+	// while the object doesn't exist or its handle is stale
+	mutable int32 mObjectHandle = FCiFGameObjectRegistry::INVALID_HANDLE;
+};
+
 /**
  * The Predicate class is the terminal and functional end of the logic
  * constructs in CiF. All rules, influence rules, rule sets, and social
@@ -125,13 +151,25 @@ public:
 	 */
 	void valuation(UCiFGameObject* x, UCiFGameObject* y = nullptr, UCiFGameObject* z = nullptr);
 
-	void determinePredicatesVars(UCiFGameObject*& first,
+	void determinePredicatesVars(const UCiFManager* cifManager,
+	                             UCiFGameObject*& first,
 	                             UCiFGameObject*& second,
 	                             UCiFGameObject*& third,
 	                             UCiFGameObject* x,
 	                             UCiFGameObject* y,
 	                             UCiFGameObject* z) const;
 
+	/**
+	 * @return The game object bound to the slot given the characters in the roles/variables, or null if the slot is empty
+	 */
+	UCiFGameObject* bindSlot(const UCiFManager* cifManager, const FCiFSlotBinding& slot, UCiFGameObject* x, UCiFGameObject* y, UCiFGameObject* z) const;
+
+	/* The reference implementation of bindSlot, which compares the slot name with the role and variable names on every call */
+	UCiFGameObject* bindSlotByName(const UCiFManager* cifManager, const FName slotName, UCiFGameObject* x, UCiFGameObject* y, UCiFGameObject* z) const;
+
+	/* Resolves the slot bindings from the slot names. Must be called whenever mPrimary/mSecondary/mTertiary change */
+	void updateBindings();
+
 	/**
 	 * Evaluates the predicate for truth given the characters involved
 	 * bound to the parameters and determines how many times the predicate is
@@ -163,6 +201,9 @@ public:
 	//			opinion of 2 characters on 1 item, and what the truth label of that item, WTF?
 	void evalCKBEntryForObjects(const UCiFGameObject* first, const UCiFGameObject* second, TArray<FName>& outArray) const;
 
+	/* @return The number of items evalCKBEntryForObjects finds, counted over the cached CKB bitsets without listing them */
+	int32 countCKBEntryForObjects(const UCiFGameObject* first, const UCiFGameObject* second) const;
+
 	/**
 	 * Returns true if the input object to this method has the trait held by this predicate instance 
 	 */
@@ -326,8 +367,26 @@ public:
 	static UCiFPredicate* loadFromJson(TSharedPtr<FJsonObject> predJson, const UObject* worldContextObject);
 
 private:
+	/**
+	 * The evaluation itself, wrapped by evaluate() for differential testing.
+	 * Optimized paths in here must fall back to the reference implementation when cifManager->mIsReferenceEvaluation is set.
+	 */
+	bool evaluateInternal(const UCiFManager* cifManager,
+	                      const UCiFGameObject* c1,
+	                      const UCiFGameObject* c2,
+	                      const UCiFGameObject* c3,
+	                      const UCiFSocialExchange* se);
+
 	FName getValueOfPredicateVariable(const FName var) const;
 
+	/**
+	 * Number of SFDB contexts in the predicate's window with the predicate's label from @first to @second,
+	 * counted the way numTimesUniquelyTrue counts them
+	 */
+	int32 countSFDBLabelUniquelyTrue(const UCiFManager* cifManager, const UCiFGameObject* first, const UCiFGameObject* second) const;
+
+	static FCiFSlotBinding resolveSlotBinding(const FName slotName);
+
 	ERelationshipType comparatorTypeToRelationshipType(const EComparatorType comparatorType) const;
 
 	/* returns true if this predicate represent a SFDB predicate with a category label */
@@ -360,6 +419,11 @@ public:
 	UPROPERTY()
 	FName mTertiary;
 
+	// mPrimary/mSecondary/mTertiary resolved by updateBindings
+	FCiFSlotBinding mPrimaryBinding;
+	FCiFSlotBinding mSecondaryBinding;
+	FCiFSlotBinding mTertiaryBinding;
+
 
 	//TODO --	is this really the best way to implement this class? won't is be better just to
 	//			create an hierarchy of subclasses which will make this class less monolithic
@@ -62,6 +62,12 @@ public:
 	
 	/* Resets the object to its default state */
 	void clear();
+
+	/* Writes or reads the scores and the intent score caches. Rule records aren't kept, they are formed again with the intents */
+	void serializeSummary(FArchive& ar);
+
+	/* Copies the part of @other that serializeSummary writes */
+	void copySummary(const UCiFProspectiveMemory& other);
 public:
 
 	bool mIsCleared; // indicates if the prospective memory is clear before starting forming scores and storing here
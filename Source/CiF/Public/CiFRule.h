@@ -49,6 +49,16 @@ public:
 	UFUNCTION(BlueprintCallable)
 	bool isRoleRequired(const FName role) const;
 
+	bool isInitiatorRequired() const { return (getRoleFlags() & ROLE_INITIATOR) != 0; }
+	bool isResponderRequired() const { return (getRoleFlags() & ROLE_RESPONDER) != 0; }
+	bool isOtherRequired() const { return (getRoleFlags() & ROLE_OTHER) != 0; }
+
+	/**
+	 * Derives the static metadata of the rule (required roles, highest SFDB order) from its predicates.
+	 * It is derived lazily on first use, so this only needs to be called if the predicates change after that.
+	 */
+	void updateMetadata() const;
+
 	/**
 	 * Returns the conjunction of all the truth values of the Predicates
 	 * that compose the rules. 
@@ -86,11 +96,23 @@ public:
 	 */
 	static UCiFRule* loadFromJson(TSharedPtr<FJsonObject> ruleJson, const UObject* worldContextObject, UCiFRule* inputRule=nullptr);
 private:
+	enum ERoleFlags : uint8
+	{
+		ROLE_INITIATOR = 1 << 0,
+		ROLE_RESPONDER = 1 << 1,
+		ROLE_OTHER = 1 << 2
+	};
+
+	uint8 getRoleFlags() const;
+
+	/* Determines if the rule requires the role by going over its predicates */
+	bool computeIsRoleRequired(const FName role) const;
+
 	/**
 	 * Determines the highest SFDB order of the predicates in this rule.
 	 * @return The value of the highest SFDB order of this rule.
 	 */
-	int32 getHighestSFDBOrder();
+	int32 getHighestSFDBOrder() const;
 
 	/**
 	 * Evaluates a rule with respect to the time order specified in the predicates of the rule. 
@@ -125,4 +147,9 @@ public:
 
 private:
 	static UniqueIDGenerator mIDGenerator;
+
+	// metadata derived from the predicates, see updateMetadata
+	mutable bool mIsMetadataValid = false;
+	mutable uint8 mRoleFlags = 0;
+	mutable int32 mHighestSFDBOrder = 0;
 };
@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+struct FCiFSFDBRecord;
+struct FCiFSFDBRecordLabel;
+
+/**
+ * Index entry of a segment in the archive file, kept in memory so segments can be skipped without reading them
+ */
+struct FCiFSFDBArchiveSegment
+{
+	int64 mOffset = 0; // of the segment header in the file
+	int32 mNumRecords = 0;
+	int32 mNumLabels = 0;
+	int32 mMinTime = 0;
+	int32 mMaxTime = 0;
+	uint32 mLabelMask = 0; // union of the label masks of the records
+};
+
+/**
+ * Append-only file of SFDB records folded out of the history (see UCiFSocialFactsDataBase::compactHistory).
+ *
+ * Each compaction appends one segment with the records in a columnar layout - a column of times, of label masks,
+ * of characters etc. - followed by the columns of their labels. Names are SFDB name table handles, the name table
+ * stays in memory. The file is memory-mapped for reading, so only the pages of the segments a query touches are
+ * resident. Records keep only what the history queries read: the label columns and what isPredicateInChange of
+ * triggers and statuses needs. The file is rewritten when opened, and a saved state refers to it by its path and
+ * number of records so the archive is reopened along with the state (see reopen).
+ */
+class CIF_API FCiFSFDBArchive
+{
+public:
+	FCiFSFDBArchive();
+	~FCiFSFDBArchive();
+
+	/* Creates an empty archive at @filePath, replacing any file there. @return False if the file can't be written */
+	bool open(const FString& filePath);
+
+	/**
+	 * Opens the archive written before at @filePath with its first @numRecords records, e.g. those of a saved state.
+	 * The segment index is rebuilt from the segment headers, and the segments after these records (appended after
+	 * the state was saved) are cut from the file.
+	 * @return False if the file can't be read or doesn't hold @numRecords records in whole segments
+	 */
+	bool reopen(const FString& filePath, const int32 numRecords);
+
+	/**
+	 * Appends a segment with the records, which must be in ascending order of time and not older than the records already in the archive
+	 * @param labels	The labels the records' label ranges refer to
+	 */
+	bool append(TArrayView<const FCiFSFDBRecord> records, const TArray<FCiFSFDBRecordLabel>& labels);
+
+	/**
+	 * Calls @visitor on the archived records that have any label in @labelMask, in order of time, with the labels of the record.
+	 * Segments are skipped by their label mask and only the records that are visited are read from the columns.
+	 * The labels passed along with the record are its label range (its mFirstLabel is 0).
+	 * @param labelMask		The labels to look for, ~0 visits all the records including those without labels
+	 * @param isNewestFirst	Visit the records in descending order of time instead
+	 * @param visitor		Returns false to stop the visit
+	 */
+	void forEachRecord(const uint32 labelMask,
+	                   const bool isNewestFirst,
+	                   TFunctionRef<bool(const FCiFSFDBRecord&, TArrayView<const FCiFSFDBRecordLabel>)> visitor) const;
+
+	bool isOpen() const { return !mFilePath.IsEmpty(); }
+
+	bool isEmpty() const { return mSegments.IsEmpty(); }
+
+	int32 getNumRecords() const { return mNumRecords; }
+
+	const FString& getFilePath() const { return mFilePath; }
+
+private:
+	/* Maps the whole file, if it isn't mapped since the last append. @return The start of the file or null */
+	const uint8* map() const;
+
+	void unmap() const;
+
+public:
+	inline static constexpr uint32 SEGMENT_MAGIC = 0x47455343; // "CSEG"
+	inline static constexpr uint32 SEGMENT_VERSION = 1;
+	inline static constexpr int32 UNARCHIVED_OBJECT_INDEX = -2; // object index of visited records that referred to an object
+
+private:
+	FString mFilePath;
+	int64 mFileSize = 0;
+	int32 mNumRecords = 0;
+	TArray<FCiFSFDBArchiveSegment> mSegments; // in ascending order of time
+
+	// the mapping is made lazily by the first query after an append and released before the next append
+	mutable TUniquePtr<IMappedFileHandle> mMappedFile;
+	mutable TUniquePtr<IMappedFileRegion> mMappedRegion;
+};
@@ -0,0 +1,193 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CiFSocialFactsDataBase.h"
+#include "Utilities.h"
+#include "UObject/Object.h"
+#include "CiFSessionRecorder.generated.h"
+
+class UCiFManager;
+class UCiFGameObject;
+class UCiFSocialExchangeContext;
+
+UENUM()
+enum class ECiFSessionEventType : uint8
+{
+	FORM_INTENT_ALL,
+	FORM_INTENT,
+	FORM_INTENT_SOCIAL_GAMES,
+	PLAY_GAME,
+	CHANGE_SOCIAL_STATE,
+	FAST_FORWARD,
+	SET_NETWORK_WEIGHT,
+	ADD_NETWORK_WEIGHT,
+	MULTIPLY_NETWORK_WEIGHT,
+	ADD_STATUS,
+	REMOVE_STATUS,
+	UPDATE_STATUS_DURATIONS,
+	INTENT_PASS_START,  // a time sliced intent formation pass, see UCiFIntentScheduler
+	INTENT_PASS_SLICE,  // work items of the pass that ran together, between the calls recorded before and after them
+	INTENT_PASS_CANCEL
+};
+
+/**
+ * A single externally driven call into CiF. Which fields are used depends on the event type.
+ */
+USTRUCT()
+struct FCiFSessionEvent
+{
+	GENERATED_BODY()
+
+	ECiFSessionEventType mType;
+	int32 mTime = 0; // CiF time when the call was made
+
+	FName mExchange;
+	FName mInitiator; // also the game object for status events
+	FName mResponder; // also the status target for status events
+	FName mOther;
+	TArray<FName> mOtherCast;
+	TArray<FName> mLevelCast;
+
+	IdType mEffectId = CIF_INVALID_ID; // chosen effect for playGame, played effect for changeSocialState
+	IdType mResultEffectId = CIF_INVALID_ID; // the effect playGame ended up with, used to detect divergence in replay
+	FName mResultOther;
+
+	uint8 mEnumValue = 0; // network type or status type
+	uint8 mId1 = 0;
+	uint8 mId2 = 0;
+	int32 mValue = 0;
+	float mFloatValue = 0.f;
+	int32 mSeed = 0; // fast forward seed
+
+	// the rest of the social exchange context of changeSocialState, it ends up in the SFDB record
+	int32 mContextTime = 0;
+	FName mChosenItemCKB;
+	FName mPerformanceRealization;
+	int8 mInitiatorScore = 0;
+	int8 mResponderScore = 0;
+	bool mIsBackstory = false;
+	FSFDBLabel mSFDBLabel;
+	TArray<FSFDBLabel> mSFDBLabels;
+};
+
+/**
+ * Result of a replayed session
+ */
+USTRUCT(BlueprintType)
+struct FCiFReplayStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 mEvents = 0;
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 mDivergences = 0; // number of playGame calls that chose a different effect or other than in the recording
+
+	UPROPERTY(BlueprintReadOnly)
+	float mSeconds = 0.f;
+};
+
+/**
+ * Records every externally driven call into CiF (intent formation, play game, changing the social state and
+ * direct mutations of networks and statuses) along with the random seed, so a session can be saved and
+ * replayed later. A replayed session is a reproducible workload for benchmarking, and since every
+ * playGame result is recorded too, it is also an oracle for checking that optimizations don't change behavior.
+ *
+ * Only the outermost calls are recorded: calls CiF makes into itself while handling a recorded call
+ * (e.g. valuations changing networks inside changeSocialState) are reproduced by replaying the outer call.
+ * A replay must start from the same state the recording started from (e.g. right after init).
+ */
+UCLASS(BlueprintType)
+class CIF_API UCiFSessionRecorder : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	void init(UCiFManager* cifManager);
+
+	/* Starts a new recording. The manager is re-seeded with @seed so the recording is reproducible */
+	UFUNCTION(BlueprintCallable)
+	void startRecording(const int32 seed);
+
+	UFUNCTION(BlueprintCallable)
+	void stopRecording();
+
+	UFUNCTION(BlueprintCallable)
+	bool isRecording() const { return mIsRecording; }
+
+	UFUNCTION(BlueprintCallable)
+	bool saveToFile(const FString& filePath) const;
+
+	UFUNCTION(BlueprintCallable)
+	bool loadFromFile(const FString& filePath);
+
+	/**
+	 * Re-executes the recorded session on the manager with the recorded seed, without notifying the game and without
+	 * the trace logs (see UCiFManager::mIsTraceLogging). The random seed and stream of the manager are restored afterwards.
+	 * @return Statistics about the replay
+	 */
+	UFUNCTION(BlueprintCallable)
+	FCiFReplayStats replay();
+
+	void recordEvent(const FCiFSessionEvent& event);
+
+	/**
+	 * Marks the beginning/end of a call into CiF.
+	 * @return True if this is the outermost call and it should be recorded
+	 */
+	bool beginCall();
+	void endCall() { mCallDepth--; }
+
+	/* @return True if a direct mutation (network/status) happening now is made by the game and not by CiF itself */
+	static bool isRecordingExternalCall() { return mActiveRecorder && mActiveRecorder->mCallDepth == 0; }
+
+	static void namesOf(const TArray<UCiFGameObject*>& objects, TArray<FName>& outNames);
+
+	/* Copies the whole social exchange context into @outEvent, so the replay can make the same context */
+	static void recordContext(const UCiFSocialExchangeContext* context, FCiFSessionEvent& outEvent);
+
+	virtual void BeginDestroy() override;
+
+	inline static UCiFSessionRecorder* mActiveRecorder = nullptr; // the recorder that is currently recording, if any
+
+private:
+	void replayEvent(const FCiFSessionEvent& event, FCiFReplayStats& stats);
+	void objectsOf(const TArray<FName>& names, TArray<UCiFGameObject*>& outObjects) const;
+	UCiFSocialExchangeContext* makeContext(const FCiFSessionEvent& event);
+
+	UPROPERTY()
+	UCiFManager* mCifManager = nullptr;
+
+	TArray<FCiFSessionEvent> mEvents;
+	int32 mSeed = 0;
+	int32 mStartTime = 0;
+	int32 mCallDepth = 0;
+	bool mIsRecording = false;
+};
+
+/**
+ * Scopes a call into CiF for the session recorder, so nested calls aren't recorded
+ */
+struct FCiFSessionCallScope
+{
+	explicit FCiFSessionCallScope(UCiFSessionRecorder* recorder)
+		: mRecorder(recorder),
+		  mIsOutermost(recorder ? recorder->beginCall() : false) {}
+
+	~FCiFSessionCallScope()
+	{
+		if (mRecorder) {
+			mRecorder->endCall();
+		}
+	}
+
+	/* @return True if the call should be recorded */
+	bool shouldRecord() const { return mIsOutermost && mRecorder->isRecording(); }
+
+private:
+	UCiFSessionRecorder* mRecorder;
+	bool mIsOutermost;
+};
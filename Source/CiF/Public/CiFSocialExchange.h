@@ -16,6 +16,7 @@ class UCiFEffect;
 class UCiFCharacter;
 class UCiFRule;
 class UCiFGameObject;
+class UCiFManager;
 
 USTRUCT()
 struct FSocialGameNames
@@ -35,6 +36,47 @@ struct FSocialGameNames
 	// to just scrape it from the json instead of manually adding and removing when needed
 };
 
+/* The traits of an initiator and a responder and the relationships between them, as bitmasks. Index 0 is the initiator */
+struct FCiFPairSignature
+{
+	uint64 mTraits[2] = {};
+	uint8 mRelationships[2] = {}; // initiator towards responder, responder towards initiator (see UCiFRelationshipNetwork)
+
+	static FCiFPairSignature make(const UCiFManager* cifManager, const UCiFGameObject* initiator, const UCiFGameObject* responder);
+};
+
+/**
+ * Traits and relationships the initiator and responder must (or must not) have for the preconditions of a social exchange
+ * to hold. Extracted at load from the plain trait and relationship predicates of the preconditions, which hold whatever the
+ * other is, so a pair that isn't admitted can skip evaluating the preconditions. Index 0 is the initiator, as in FCiFPairSignature.
+ *
+ * Exchanges whose preconditions refer to the other get an empty signature that admits every pair: checkPreconditionsVariableOther
+ * accepts them without evaluating anything when the initiator or responder is among the possible others, as it is in intent formation.
+ */
+struct FCiFPreconditionSignature
+{
+	uint64 mRequiredTraits[2] = {};
+	uint64 mForbiddenTraits[2] = {};
+	uint8 mRequiredRelationships[2] = {};
+	uint8 mForbiddenRelationships[2] = {};
+
+	/* Adds the conditions of @rule, all of its predicates must hold for the preconditions to hold */
+	void addRule(const UCiFRule* rule);
+
+	/* @return False if the preconditions can't hold for the pair */
+	bool admits(const FCiFPairSignature& pair) const
+	{
+		for (int32 i = 0; i < 2; i++) {
+			if ((pair.mTraits[i] & mRequiredTraits[i]) != mRequiredTraits[i] || (pair.mTraits[i] & mForbiddenTraits[i]) != 0 ||
+				(pair.mRelationships[i] & mRequiredRelationships[i]) != mRequiredRelationships[i] ||
+				(pair.mRelationships[i] & mForbiddenRelationships[i]) != 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
 UENUM(BlueprintType)
 enum class ESocialExchangeIntent : uint8
 {
@@ -158,19 +200,27 @@ public:
 	 * formation process.
 	 * @return True if a third character is needed, false if not.
 	 */
-	bool isThirdNeededForIntentFormation();
+	bool isThirdNeededForIntentFormation() const;
 
 	/** todo - don't understand the different between this and @isThirdNeededForIntentFormation
 	 * Determines if we need to find a third character for social game 
 	 * play.
 	 * @return True if a third character is needed, false if not.
 	 */
-	bool isThirdForSocialExchangePlay();
+	bool isThirdForSocialExchangePlay() const;
 
 	// todo - what is the difference between this and the above?
 	bool isThirdParty() const { return mIsTalkAboutSomeone || mIsGetSomeoneToDoSomethingForYou; }
 
 	void updateRequiresOther();
+
+	/* @return True if a precondition refers to the other, so they are checked against every possible other */
+	bool isOtherRequiredByPreconditions() const { return mIsOtherRequiredByPreconditions; }
+
+	const FCiFPreconditionSignature& getPreconditionSignature() const { return mPreconditionSignature; }
+
+	/* Derives the per-exchange flags and intent type from the loaded rules, called once at load */
+	void updateMetadata();
 	
 	/* this method is more appropriate for mismanor than prom week because in mismanor you have items which
 	 * are also game objects, and because of that you need to check that the other is viable for social interactions
@@ -204,4 +254,13 @@ public:
 	TArray<UCiFInstantiation*> mInstantiations; // the realization of the outcome of the this social exchange
 	bool mIsTalkAboutSomeone;
 	bool mIsGetSomeoneToDoSomethingForYou;
+	int32 mIndex = INDEX_NONE; // the index in the social exchanges library, see UCiFSocialExchangesLibrary
+
+private:
+	// derived from the rules at load, see updateMetadata
+	EIntentType mIntentType = EIntentType::INVALID;
+	bool mIsThirdNeededForIntentFormation = false;
+	bool mIsThirdForPlay = false;
+	bool mIsOtherRequiredByPreconditions = false;
+	FCiFPreconditionSignature mPreconditionSignature;
 };
@@ -3,12 +3,36 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "CiFSocialExchange.h"
 #include "UObject/Object.h"
 #include "CiFSocialExchangesLibrary.generated.h"
 
+enum class EIntentType : uint8;
+enum class ECiFGameObjectType : uint8;
 class UCiFSocialExchange;
+
+enum class ECiFSocialExchangeFlags : uint8
+{
+	NONE = 0,
+	PRECONDITIONS_REQUIRE_OTHER = 1 << 0, // the preconditions have to be checked against every possible other
+	THIRD_NEEDED_FOR_PLAY = 1 << 1        // playing it takes the most salient other when none is given
+};
+ENUM_CLASS_FLAGS(ECiFSocialExchangeFlags);
+
+/* The static properties of a social exchange that intent formation reads, packed so the whole table fits a few cache lines */
+struct FCiFSocialExchangeDescriptor
+{
+	EIntentType mIntentType;
+	ECiFGameObjectType mResponderType;
+	ECiFSocialExchangeFlags mFlags;
+
+	bool hasFlag(const ECiFSocialExchangeFlags flag) const { return EnumHasAnyFlags(mFlags, flag); }
+};
+
 /**
- * 
+ * The social exchanges in a contiguous array, in the order they were added. The index of an exchange (see
+ * UCiFSocialExchange::mIndex) is stable as long as no exchange is removed, and indexes the descriptor table too.
+ * Intent formation runs over the exchanges by index, names are looked up only for exchanges that were stored by name.
  */
 UCLASS()
 class CIF_API UCiFSocialExchangesLibrary : public UObject
@@ -17,8 +41,10 @@ class CIF_API UCiFSocialExchangesLibrary : public UObject
 
 public:
 
+	/* Adds the exchange, or replaces the exchange with the same name at its index */
 	void addSocialExchange(UCiFSocialExchange* se);
 
+	/* Removes the exchange, the exchanges after it move down an index */
 	void removeSocialExchange(UCiFSocialExchange* se);
 
 	/**
@@ -26,9 +52,30 @@ public:
 	 */
 	UCiFSocialExchange* getSocialExchangeByName(const FName name);
 
+	UCiFSocialExchange* getSocialExchange(const int32 index) const { return mSocialExchanges[index]; }
+
+	const FCiFSocialExchangeDescriptor& getDescriptor(const int32 index) const { return mDescriptors[index]; }
+
+	const FCiFSocialExchangeDescriptor& getDescriptor(const UCiFSocialExchange* se) const;
+
+	const FCiFPreconditionSignature& getPreconditionSignature(const int32 index) const { return mPreconditionSignatures[index]; }
+
+	int32 num() const { return mSocialExchanges.Num(); }
+
 	void loadSocialGamesLibFromJson(const FString& jsonPath, const UObject* worldContextObject);
+
+private:
+	/* Assigns the indices of the exchanges from @firstIndex on and rebuilds their descriptors */
+	void updateIndices(const int32 firstIndex);
+
+	static FCiFSocialExchangeDescriptor makeDescriptor(const UCiFSocialExchange* se);
+
 public:
 	UPROPERTY()
-	TMap<FName, UCiFSocialExchange*> mSocialExchanges;
-	
+	TArray<UCiFSocialExchange*> mSocialExchanges;
+
+private:
+	TArray<FCiFSocialExchangeDescriptor> mDescriptors; // the descriptor of each exchange, at the same index
+	TArray<FCiFPreconditionSignature> mPreconditionSignatures; // copied from the exchanges, so matching a pair runs over one array
+	TMap<FName, int32> mIndicesByName;
 };
@@ -3,12 +3,15 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "CiFSFDBArchive.h"
+#include "CiFSFDBContext.h"
+#include "Utilities.h"
 #include "CiFSocialFactsDataBase.generated.h"
 
 class UCiFTrigger;
 class UCiFPredicate;
 class UCiFGameObject;
-class UCiFSFDBContext;
+class UCiFRule;
 
 UENUM(BlueprintType)
 enum class ESFDBLabelType : uint8
@@ -34,6 +37,8 @@ enum class ESFDBLabelType : uint8
 	SIZE
 };
 
+static_assert(static_cast<uint8>(ESFDBLabelType::SIZE) <= 32, "SFDB label masks are 32 bit");
+
 /**
  * A wrapper struct for an array that will be placed inside a static map
  * to arrange the SFDB labels into categories
@@ -63,19 +68,126 @@ struct FSFDBLabel
 	}
 };
 
-USTRUCT(BlueprintType)
-struct FSFDBEntry
+/**
+ * A social exchange, trigger or status entry in the SFDB history.
+ * Names are handles into the SFDB name table and the labels are a range of the SFDB label array, so the history is plain
+ * data - UObject contexts are made from records only on demand (see UCiFSocialFactsDataBase::makeContext).
+ */
+struct FCiFSFDBRecord
 {
-	GENERATED_BODY()
+	int32 mTime = 0; // at what time this entry happened
+	ESFDBContextType mType = ESFDBContextType::INVALID;
+	bool mIsBackstory = false; // social exchanges only, backstory labels match by initiator and responder
+	bool mIsNegated = false;   // statuses only, whether the status was removed
+	int8 mInitiatorScore = 0;
+	int8 mResponderScore = 0;
+	uint16 mInitiator = 0;
+	uint16 mResponder = 0;
+	uint16 mOther = 0;
+	uint16 mGameName = 0;
+	uint16 mChosenItemCKB = 0;
+	uint16 mPerformanceRealization = 0;
+	IdType mId = CIF_INVALID_ID;     // the effect of a social exchange or the trigger of a trigger
+	int32 mObjectIndex = INDEX_NONE; // the change rule of a trigger that isn't registered (e.g. status timeout) or the predicate of a status
+	uint32 mLabelMask = 0;           // one bit per ESFDBLabelType of the labels
+	int32 mFirstLabel = 0;
+	int32 mNumLabels = 0;
+
+	friend FArchive& operator<<(FArchive& ar, FCiFSFDBRecord& record)
+	{
+		ar << record.mTime << record.mType << record.mIsBackstory << record.mIsNegated << record.mInitiatorScore << record.mResponderScore;
+		ar << record.mInitiator << record.mResponder << record.mOther << record.mGameName << record.mChosenItemCKB << record.mPerformanceRealization;
+		return ar << record.mId << record.mObjectIndex << record.mLabelMask << record.mFirstLabel << record.mNumLabels;
+	}
+};
+
+/**
+ * An SFDB label of a record, with handles into the SFDB name table
+ */
+struct FCiFSFDBRecordLabel
+{
+	uint16 mFrom;
+	uint16 mTo; // the none handle for labels without a "to"
+	ESFDBLabelType mType;
 
-	FName exchangeName;
-	FName initiator;
-	FName responder;
-	float initiatorScore;
-	float responderScore;
-	int32 time;            // at what time this exchange happened
-	int32 effectID;        // indicates which specific instantiation of Bully happened (in this case, making fun of SAT scores)
-	ESFDBLabelType type; // todo: maybe should be an array - would be more clear later when using this system
+	friend FArchive& operator<<(FArchive& ar, FCiFSFDBRecordLabel& label)
+	{
+		return ar << label.mFrom << label.mTo << label.mType;
+	}
+};
+
+/**
+ * A trigger whose condition holds for a specific binding of characters, found in a trigger pass
+ */
+struct FCiFTriggerMatch
+{
+	UCiFTrigger* mTrigger = nullptr;
+	UCiFGameObject* mFirst = nullptr;
+	UCiFGameObject* mSecond = nullptr;
+	UCiFGameObject* mThird = nullptr;
+
+	bool operator==(const FCiFTriggerMatch& other) const
+	{
+		return mTrigger == other.mTrigger &&
+			mFirst == other.mFirst &&
+			mSecond == other.mSecond &&
+			mThird == other.mThird;
+	}
+};
+
+/**
+ * Key of the label count aggregates: a from character, a to character (none for labels without a "to") and a label or category
+ */
+struct FCiFLabelCountKey
+{
+	uint16 mFrom;
+	uint16 mTo;
+	ESFDBLabelType mLabel;
+
+	bool operator==(const FCiFLabelCountKey& other) const
+	{
+		return mFrom == other.mFrom &&
+			mTo == other.mTo &&
+			mLabel == other.mLabel;
+	}
+
+	friend uint32 GetTypeHash(const FCiFLabelCountKey& key)
+	{
+		return HashCombine(key.mFrom | (static_cast<uint32>(key.mTo) << 16), GetTypeHash(key.mLabel));
+	}
+
+	friend FArchive& operator<<(FArchive& ar, FCiFLabelCountKey& key)
+	{
+		return ar << key.mFrom << key.mTo << key.mLabel;
+	}
+};
+
+/**
+ * Prefix sum of the number of contexts matching a label count key, up to and including a time
+ */
+struct FCiFLabelCountBucket
+{
+	int32 mTime;
+	int32 mCount;
+
+	friend FArchive& operator<<(FArchive& ar, FCiFLabelCountBucket& bucket)
+	{
+		return ar << bucket.mTime << bucket.mCount;
+	}
+};
+
+/**
+ * Summary of the records folded out of the history that match a label count key
+ */
+struct FCiFFoldedLabelCount
+{
+	int32 mCount = 0;
+	int32 mLatestTime = 0; // the latest time of the folded records
+
+	friend FArchive& operator<<(FArchive& ar, FCiFFoldedLabelCount& folded)
+	{
+		return ar << folded.mCount << folded.mLatestTime;
+	}
 };
 
 /**
@@ -140,24 +252,137 @@ public:
 	/**
 	 * This function is used to deal with when we are seeing is a label is in a category.
 	 * If predicateLabel is not a category, returns false if it doesn't match contextLabel: true otherwise.
-	 * If predicateLabel is a category, it will loop through that category to see if contextLabel matches any in the category.
+	 * If predicateLabel is a category, returns true if contextLabel is one of the labels in the category.
+	 * Both are a single AND with the bitmask the categories are compiled into.
 	 * 
 	 * @param contextLabel		The context label type of the context
 	 * @param predicateLabel	The predicate label type to match to
 	 */
-	static bool doesMatchLabelOrCategory(const ESFDBLabelType contextLabel, const ESFDBLabelType predicateLabel) noexcept;
+	static bool doesMatchLabelOrCategory(const ESFDBLabelType contextLabel, const ESFDBLabelType predicateLabel) noexcept
+	{
+		return (labelBit(contextLabel) & mSFDBLabelMatchMasks[static_cast<uint8>(predicateLabel)]) != 0;
+	}
+
+	/* The reference implementation of doesMatchLabelOrCategory, which loops through the labels of the category */
+	static bool doesMatchLabelOrCategoryByScan(const ESFDBLabelType contextLabel, const ESFDBLabelType predicateLabel);
+
+	/* @return The bit of @label in the label bitmasks of contexts and categories */
+	static uint32 labelBit(const ESFDBLabelType label) noexcept { return 1u << static_cast<uint8>(label); }
+
+	/**
+	 * @return Bitmask of the context labels that can match a search for @label in any kind of context - the labels
+	 * of its category (or itself), and the label itself for backstory contexts which match it exactly. A wildcard matches all labels.
+	 * A context whose label mask doesn't intersect it can't match @label.
+	 */
+	static uint32 getLabelSearchMask(const ESFDBLabelType label) noexcept;
 
 	static TMap<ESFDBLabelType, FLabelCategoryArrayWrapper> initializeCategoriesMap();
 
-	/* Adds contexts and sorts in ascending order */
+	/* Compiles mSFDBLabelCategories into a bitmask per label of the context labels it matches */
+	static TArray<uint32> initializeLabelMatchMasks();
+
+	/**
+	 * Counts the social exchange and trigger contexts in the @window that have a label matching @label
+	 * from @first to @second. Same as the number of matches the strict findLabelFromValues finds (the one
+	 * used for numTimesUniquelyTrue predicates), but answered from the label count aggregates.
+	 * @param second	The "to" character, or null to count only labels without a "to"
+	 * @param window	The window in SFDB time to look back for matches. A window of 0 means the entire history
+	 */
+	int32 countLabelsInWindow(const ESFDBLabelType label, const UCiFGameObject* first, const UCiFGameObject* second, int window = 0) const;
+
+	/* Adds a record of the context to the history, in ascending order of time. The context object itself isn't kept */
 	void addContext(UCiFSFDBContext* context);
 
+	/**
+	 * Adds a record of a trigger that fired to the history, without making a trigger context for it
+	 * @param triggerId	The id of the trigger, or UCiFTrigger::mStatusTimeoutTriggerID
+	 * @param change	The change rule of the trigger
+	 */
+	void addTriggerRecord(const IdType triggerId, UCiFRule* change, const int32 time, UCiFGameObject* x, UCiFGameObject* y = nullptr, UCiFGameObject* z = nullptr);
+
+	/**
+	 * Removes the records added since the history had @length records (see getHistoryLength), from the latest one.
+	 * The records that were there before with the same time as the removed ones are kept.
+	 * History that was already folded by compactHistory can't be removed.
+	 */
+	void truncateToLength(const int32 length);
+
+	/* @return The number of records added to the history, the folded ones included. Compacting doesn't change it */
+	int32 getHistoryLength() const { return mNumFoldedRecords + mRecords.Num(); }
+
+	/**
+	 * Applies the retention policy: records older than mRetentionWindow turns are folded into per (from, to, label)
+	 * count summaries. SFDB label queries (findLabelFromValues, countLabelsInWindow) with a window inside the retention
+	 * window are answered exactly as before. Queries over the entire history count the folded records too, and queries
+	 * reaching partly past the retention window count all the folded records of a key if any of them is in the window.
+	 * Change queries (isPredicateInHistory) only see the records that weren't folded.
+	 * If an archive is open, the folded records are also appended to it, and queries over the entire history read them
+	 * from the archive instead: label queries find their exact times and change queries see them.
+	 * @param keepFromTime	Records from this time on aren't folded, whatever the retention window (see UCiFManager::getEarliestRestorableTime)
+	 */
+	void compactHistory(const int32 keepFromTime = MAX_int32);
+
+	/**
+	 * Opens an archive file the records folded by compactHistory are spilled to (see FCiFSFDBArchive), so the
+	 * history over the entire game stays queryable without keeping it in memory.
+	 * @return False if the file can't be created, or if history was already folded without an archive
+	 */
+	UFUNCTION(BlueprintCallable)
+	bool openArchive(const FString& filePath);
+
+	bool hasArchive() const { return mArchive.IsValid(); }
+
+	/* @return True if there is any history, detailed or folded */
+	bool hasHistory() const { return !mRecords.IsEmpty() || mNumFoldedRecords > 0; }
+
+	/**
+	 * Writes a record with its labels and object, with names instead of name table handles (see readRecord).
+	 * The objects that can be written are status predicates and change rules made of status predicates (status timeouts).
+	 */
+	void writeRecord(FArchive& ar, const FCiFSFDBRecord& record) const;
+
+	/* Reads a record written by writeRecord and adds it to the history */
+	void readRecord(FArchive& ar);
+
+	/**
+	 * Writes or reads the whole history: the name table, the records, their label counts, the folded summaries and
+	 * the path and size of the archive. Loading replaces the history and reopens the archive it was saved with (see
+	 * FCiFSFDBArchive::reopen), if that fails the folded summaries answer the queries over the entire history.
+	 * @return False if the archive has an error, a history that wasn't read whole doesn't replace this one
+	 */
+	bool serializeHistory(FArchive& ar);
+
+	/* Makes a context object of the record at @index in the history, for Blueprint or game code that needs one */
+	UFUNCTION(BlueprintCallable)
+	UCiFSFDBContext* makeContext(const int32 index);
+
+	UFUNCTION(BlueprintCallable)
+	int32 getNumContexts() const { return mRecords.Num(); }
+
+	/* @return The handle of @name in the name table, adding it if needed. The none name is always handle 0 */
+	uint16 getNameHandle(const FName name);
+
+	/* @return The handle of @name in the name table, or INVALID_NAME_HANDLE if no record refers to it */
+	uint16 findNameHandle(const FName name) const;
+
+	FName getName(const uint16 handle) const { return handle < mNames.Num() ? mNames[handle] : NAME_None; }
+
 	/**
 	 * Runs all the triggers over the social facts database for each
 	 * character. Meant to be called after playGame.
 	 */
 	void runTriggers(TArray<UCiFGameObject*> cast = {});
 
+	/**
+	 * Evaluates the conditions of all the triggers on every binding of the potential characters, without applying them.
+	 * @param potentialChars	The characters to bind to the trigger roles
+	 * @param outMatches		The triggers that fired with their bindings, in evaluation order
+	 */
+	void collectTriggerMatches(const TArray<UCiFGameObject*>& potentialChars, TArray<FCiFTriggerMatch>& outMatches);
+
+	/* Adds a trigger to the triggers that run every turn and indexes it by its id */
+	void addTrigger(UCiFTrigger* trigger);
+
 	/************************** Getters *******************************/
 	
 	UCiFTrigger* getTriggerByID(uint64_t id) const;
@@ -171,10 +396,103 @@ public:
 	/************************** Utility methods *******************************/
 	
 	static UCiFSocialFactsDataBase* loadFromJson(const TSharedPtr<FJsonObject> json, const UObject* worldContextObject);
+
+private:
+	/* Inserts the record with @labels after the records with the same time, and updates the label counts */
+	void addRecord(FCiFSFDBRecord& record, const TArray<FSFDBLabel>& labels);
+
+	/**
+	 * The label matching of social exchange and trigger contexts (doesSFDBLabelMatch and doesSFDBLabelMatchStrict) on a record
+	 * @param labels	The labels of the record
+	 * @param first		Handle of the first character, unset if there's no first character
+	 * @param second	Handle of the second character, unset if there's no second character
+	 */
+	bool doesRecordLabelMatch(const FCiFSFDBRecord& record,
+	                          TArrayView<const FCiFSFDBRecordLabel> labels,
+	                          const ESFDBLabelType label,
+	                          const TOptional<uint16> first,
+	                          const TOptional<uint16> second,
+	                          const bool isStrict) const;
+
+	/**
+	 * The reference implementation of doesRecordLabelMatch: the characters are compared by name like the contexts did,
+	 * and the categories are matched with doesMatchLabelOrCategoryByScan
+	 */
+	bool doesRecordLabelMatchByName(const FCiFSFDBRecord& record,
+	                                TArrayView<const FCiFSFDBRecordLabel> labels,
+	                                const ESFDBLabelType label,
+	                                const UCiFGameObject* first,
+	                                const UCiFGameObject* second,
+	                                const bool isStrict) const;
+
+	/* @return True if the manager evaluates on the reference path (see UCiFManager::mIsReferenceEvaluation) */
+	bool isReferenceEvaluation() const;
+
+	TArrayView<const FCiFSFDBRecordLabel> getRecordLabels(const FCiFSFDBRecord& record) const
+	{
+		return MakeArrayView(mRecordLabels.GetData() + record.mFirstLabel, record.mNumLabels);
+	}
+
+	/* The isPredicateInChange of the record's context type on the record */
+	bool isPredicateInRecordChange(const FCiFSFDBRecord& record,
+	                               const UCiFPredicate* pred,
+	                               const UCiFGameObject* x,
+	                               const UCiFGameObject* y,
+	                               const UCiFGameObject* z) const;
+
+	/* @return The change rule of a trigger record */
+	UCiFRule* getRecordChange(const FCiFSFDBRecord& record) const;
+
+	/* Collects the label count keys a record is counted under - each record is counted at most once per key */
+	void collectLabelCountKeys(const FCiFSFDBRecord& record, TSet<FCiFLabelCountKey>& outKeys) const;
+
+	void addLabelCounts(const FCiFSFDBRecord& record);
+
+	/* Undoes addLabelCounts of the record */
+	void removeLabelCounts(const FCiFSFDBRecord& record);
+
+	TOptional<uint16> findCharacterHandle(const UCiFGameObject* character) const;
+
+	/* Adds the record to the folded label counts, under every key findLabelFromValues could look it up by */
+	void foldRecord(const FCiFSFDBRecord& record);
+
+	/* @return The folded label count findLabelFromValues looks up for the arguments, if any */
+	const FCiFFoldedLabelCount* findFoldedLabelCount(const ESFDBLabelType label,
+	                                                 const TOptional<uint16> first,
+	                                                 const TOptional<uint16> second,
+	                                                 const bool isStrict) const;
+
 public:
-	TArray<UCiFSFDBContext*> mContexts; // contexts in ascending order - the latest is the last in the array
+	TArray<FCiFSFDBRecord> mRecords; // the history in ascending order of time - the latest is the last in the array
 	TArray<UCiFTrigger*> mTriggers; // triggers that are derived from the overall social status and not a specific social game
 	TArray<UCiFTrigger*> mStoryTriggers;
+	TArray<UCiFTrigger*> mTriggersById; // dense id->trigger table of mTriggers, null where an id isn't a trigger
 	static TMap<ESFDBLabelType, FLabelCategoryArrayWrapper> mSFDBLabelCategories;
+	static TArray<uint32> mSFDBLabelMatchMasks; // per label, the context labels it matches (the labels of a category or the label itself)
 	inline static int32 INVALID_TIME = -999;
+	inline static uint16 INVALID_NAME_HANDLE = MAX_uint16;
+	inline static uint16 ANY_NAME_HANDLE = MAX_uint16 - 1; // stands for any character in the folded label count keys
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	int32 mRetentionWindow = 0; // number of turns the full history is kept for, 0 keeps all of it (see compactHistory)
+
+	bool mIsCompactionSuspended = false; // set while a forked state may be restored, folded history can't be truncated back
+
+private:
+	TArray<FCiFSFDBRecordLabel> mRecordLabels; // the labels of all the records, each record refers to a range
+	TArray<FName> mNames; // name table of the records
+	TMap<FName, uint16> mNameHandles;
+
+	UPROPERTY()
+	TArray<UObject*> mRecordObjects; // objects records refer to by mObjectIndex
+	// per (from, to, label) prefix sums over time of the contexts matching them, each array ascending in time
+	TMap<FCiFLabelCountKey, TArray<FCiFLabelCountBucket>> mLabelCounts;
+
+	// summaries of the records folded out of the history by compactHistory, from and to may be ANY_NAME_HANDLE
+	TMap<FCiFLabelCountKey, FCiFFoldedLabelCount> mFoldedLabelCounts;
+	int32 mNumFoldedRecords = 0;
+	int32 mOldestFoldedTime = 0;
+	int32 mNewestFoldedTime = 0;
+
+	TUniquePtr<FCiFSFDBArchive> mArchive; // cold storage of the folded records, if opened
 };
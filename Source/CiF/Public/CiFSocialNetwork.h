@@ -34,6 +34,9 @@ enum class ERelationshipType : uint8
 	SIZE
 };
 
+/* A single row of a network matrix. Rows are shared between the network and its forks and copied on write */
+typedef TSharedRef<TArray<uint8>> FNetworkRow;
+
 /**
  * Social network is a complete bidirectional graph of some type of social connections
  * between all of the actors in the game. Generally it represents a non public connections,
@@ -88,14 +91,26 @@ public:
 	UFUNCTION(BlueprintCallable)
 	TArray<uint8> getReverseRelationshipsAboveThreshold(const uint8 c, const uint8 th);
 
+	/**
+	 * Returns the rows of the network without copying them. The rows stay shared until either
+	 * this network or the holder of the fork writes to them, so forking costs a pointer per character.
+	 */
+	TArray<FNetworkRow> fork() const { return mNetwork; }
+
+	/* Replaces the network rows with previously forked ones */
+	void restore(const TArray<FNetworkRow>& rows);
+
 	static UCiFSocialNetwork* loadFromJson(const TSharedPtr<FJsonObject> json, const UObject* worldContextObject);
 protected:
 	
 	void setAllArrayElements(uint8 val);
 
+	/* Returns a writable reference to the element, first copying its row if it is shared with a fork */
+	uint8& getElementForWrite(const uint8 c1, const uint8 c2);
+
 public:
 
-	TArray<TArray<uint8>> mNetwork; // represents 2d array of relationship value where Network[x][y] is the opinion of x towards y
+	TArray<FNetworkRow> mNetwork; // represents 2d array of relationship value where Network[x][y] is the opinion of x towards y
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 	ESocialNetworkType mType;
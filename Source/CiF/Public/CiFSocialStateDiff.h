@@ -0,0 +1,167 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CiFSocialStateSnapshot.h"
+
+class UCiFGameObject;
+class UCiFGameObjectStatus;
+class UCiFManager;
+class UCiFSocialFactsDataBase;
+struct FCiFSFDBRecord;
+
+/* A network cell that changed, with its weight before and after. Relationship bits are cells of the relationship network */
+struct FCiFNetworkCellChange
+{
+	ESocialNetworkType mNetwork;
+	uint8 mFrom;
+	uint8 mTo;
+	uint8 mOldWeight;
+	uint8 mNewWeight;
+
+	friend FArchive& operator<<(FArchive& ar, FCiFNetworkCellChange& change)
+	{
+		return ar << change.mNetwork << change.mFrom << change.mTo << change.mOldWeight << change.mNewWeight;
+	}
+};
+
+enum class ECiFStatusChangeType : uint8
+{
+	ADDED,
+	REMOVED,
+	UPDATED // the duration of an existing status changed
+};
+
+/* The time an effect was last seen, before and after it was seen again */
+struct FCiFEffectSeenChange
+{
+	FName mSocialExchange;
+	IdType mEffectId;
+	int32 mOldTime;
+	int32 mNewTime;
+
+	friend FArchive& operator<<(FArchive& ar, FCiFEffectSeenChange& change)
+	{
+		return ar << change.mSocialExchange << change.mEffectId << change.mOldTime << change.mNewTime;
+	}
+};
+
+/* A status that was added to, removed from or updated on a game object */
+struct FCiFStatusChange
+{
+	ECiFStatusChangeType mType;
+	FName mObject;
+	FCiFStatusRecord mStatus;   // the status after an add or update, or before a remove
+	FCiFStatusRecord mPrevious; // the status before an update
+
+	friend FArchive& operator<<(FArchive& ar, FCiFStatusChange& change)
+	{
+		ar << change.mType << change.mObject << change.mStatus;
+		if (change.mType == ECiFStatusChangeType::UPDATED) {
+			ar << change.mPrevious;
+		}
+		return ar;
+	}
+};
+
+/**
+ * The changes made to the social state between two CiF times: changed network cells (relationship bits included),
+ * status adds, removes and duration updates, the times effects were seen and the SFDB records that were appended.
+ *
+ * A diff is filled while it is tracking (see beginTracking) by the functions that write the state, so producing
+ * it costs a few bytes per write and nothing is compared or copied in full. It can be written and read, applied
+ * to a state that is at its "from" time (incremental saves, replication) and reverted on the state at its "to"
+ * time (undo). Diffs can track at the same time, a diff that starts tracking while another one does records into
+ * both, and they should stop in the reverse order they started.
+ */
+struct CIF_API FCiFSocialStateDiff
+{
+	FCiFSocialStateDiff() = default;
+	FCiFSocialStateDiff(FCiFSocialStateDiff&& other);
+	FCiFSocialStateDiff& operator=(FCiFSocialStateDiff&& other);
+	~FCiFSocialStateDiff();
+
+	/**
+	 * Starts recording the changes made to the state of @cifManager into this diff, from its current time.
+	 * Should start between turns, the SFDB records are reverted by time.
+	 */
+	void beginTracking(const UCiFManager* cifManager);
+
+	/* Stops recording, the diff ends at the current time of @cifManager */
+	void endTracking(const UCiFManager* cifManager);
+
+	bool isTracking() const { return mIsTracking; }
+
+	/**
+	 * Takes the changes recorded so far, up to the current time of @cifManager, and keeps tracking from it into this
+	 * diff, now empty. Used to split a long tracking into consecutive diffs (e.g. one per turn)
+	 * @return The changes recorded so far, as a diff that isn't tracking
+	 */
+	FCiFSocialStateDiff cut(const UCiFManager* cifManager);
+
+	/* @return The diff changes should be recorded to now, or null if none is tracking */
+	static FCiFSocialStateDiff* getActiveDiff() { return mActiveDiff; }
+
+	/* @return The earliest "from" time of the diffs that are tracking, MAX_int32 if none is */
+	static int32 getEarliestTrackedTime();
+
+	void recordWeight(const ESocialNetworkType type, const uint8 c1, const uint8 c2, const uint8 oldWeight, const uint8 newWeight);
+	void recordStatusAdded(const UCiFGameObject* go, const EStatus key, const UCiFGameObjectStatus* status);
+	void recordStatusRemoved(const UCiFGameObject* go, const EStatus key, const UCiFGameObjectStatus* status);
+	void recordStatusUpdated(const UCiFGameObject* go, const FCiFStatusRecord& previous, const UCiFGameObjectStatus* status);
+	void recordSFDBRecord(const UCiFSocialFactsDataBase* sfdb, const FCiFSFDBRecord& record);
+	void recordEffectSeen(const FName socialExchange, const IdType effectId, const int32 oldTime, const int32 newTime);
+
+	/**
+	 * Plays the changes on the state of @cifManager, which should be at the "from" time of the diff.
+	 * The changes aren't recorded by the session recorder, the journal or a diff that is tracking, so the journal
+	 * should be checkpointed afterwards (see UCiFJournal::requestCheckpoint).
+	 */
+	void apply(UCiFManager* cifManager) const;
+
+	/* Undoes the changes on the state of @cifManager, which should be at the "to" time of the diff. See apply */
+	void revert(UCiFManager* cifManager) const;
+
+	void serialize(FArchive& ar);
+
+	bool isEmpty() const { return mCells.IsEmpty() && mStatuses.IsEmpty() && mEffects.IsEmpty() && mNumSFDBRecords == 0; }
+
+	/* Clears the changes, keeps tracking if it does */
+	void reset();
+
+	int32 mFromTime = 0;
+	int32 mToTime = 0;
+
+	TArray<FCiFNetworkCellChange> mCells; // one change per cell, from its first old weight to its last new weight
+	TArray<FCiFStatusChange> mStatuses;   // in the order they were made
+	TArray<FCiFEffectSeenChange> mEffects; // in the order they were seen
+
+	/* The appended SFDB records as written by UCiFSocialFactsDataBase::writeRecord, so they don't depend on the name table */
+	TArray<uint8> mSFDBRecords;
+	int32 mNumSFDBRecords = 0;
+
+private:
+	static uint32 getCellKey(const ESocialNetworkType type, const uint8 c1, const uint8 c2)
+	{
+		return static_cast<uint32>(type) << 16 | static_cast<uint32>(c1) << 8 | c2;
+	}
+
+	void applyStatuses(UCiFManager* cifManager, const bool isReverting) const;
+
+	/* Removes this diff from the diffs that are tracking */
+	void unlink();
+
+	/* A status of a game object, as (object, key, type, directed towards) */
+	using FStatusKey = TTuple<FName, EStatus, EStatus, FName>;
+
+	TMap<uint32, int32> mCellIndices; // cell key -> index in mCells, used while tracking
+	TMap<FStatusKey, int32> mStatusUpdateIndices; // status -> index in mStatuses of its last change if it's an update, used while tracking
+
+	bool mIsTracking = false;
+	FCiFSocialStateDiff* mOuterDiff = nullptr; // the diff that was the active one when this one started tracking
+
+public:
+	/* The diff that started tracking last, the others are reached through it. Null while tracking is suspended (e.g. lookahead rollouts) */
+	inline static FCiFSocialStateDiff* mActiveDiff = nullptr;
+};
@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CiFSocialNetwork.h"
+
+enum class EStatus : uint8;
+class UCiFGameObjectStatus;
+class UCiFManager;
+
+/* Plain copy of a single game object status */
+struct CIF_API FCiFStatusRecord
+{
+	EStatus mKey; // the key under which the status is stored in the game object's statuses map
+	EStatus mType;
+	FName mDirectedTowards;
+	bool mHasDuration = false;
+	int32 mRemainingDuration = 0;
+	int32 mInitialDuration = 0;
+
+	/* Copies a status stored under @key */
+	static FCiFStatusRecord make(const EStatus key, const UCiFGameObjectStatus* status);
+
+	/* @return A new status with the values of this record */
+	UCiFGameObjectStatus* makeStatus() const;
+
+	friend FArchive& operator<<(FArchive& ar, FCiFStatusRecord& record)
+	{
+		return ar << record.mKey << record.mType << record.mDirectedTowards << record.mHasDuration << record.mRemainingDuration << record.mInitialDuration;
+	}
+};
+
+/**
+ * A copy of the mutable social state at a specific CiF time.
+ *
+ * The network matrices are not deep copied: the snapshot holds the same rows as the live networks
+ * and the rows are copied on write (see UCiFSocialNetwork::getElementForWrite), so capturing a
+ * snapshot costs a pointer per character per network. This is used both as the "committed" buffer that
+ * the game reads from between sync points, and as a fork of the state that can be restored later
+ * (what-if evaluation, rollback).
+ */
+struct CIF_API FCiFSocialStateSnapshot
+{
+	/* Shares the networks of the manager with this snapshot */
+	void capture(const UCiFManager* cifManager);
+
+	/* Copies the statuses of all game objects into this snapshot */
+	void captureStatuses(const UCiFManager* cifManager);
+
+	/**
+	 * Sets the live state of the manager back to this snapshot: networks, statuses (if captured),
+	 * removes the SFDB contexts that were added after the snapshot was captured and restores the time.
+	 * @param isRestoringHistory	False to leave the SFDB history as it is, e.g. when it was loaded with the snapshot
+	 */
+	void restore(UCiFManager* cifManager, const bool isRestoringHistory = true) const;
+
+	/* Writes or reads the snapshot, for keeping it outside of memory. Loaded network rows aren't shared with anything */
+	void serialize(FArchive& ar);
+
+	/* @return The weight of the edge id1->id2 in the network, or 0 if the network or ids aren't part of the snapshot */
+	uint8 getWeight(const ESocialNetworkType type, const uint8 id1, const uint8 id2) const;
+
+	/**
+	 * The UCiFGameObject::hasStatus of the captured statuses, false if they weren't captured
+	 * @param towards	The object the status is directed to, none if not looking for a directed status
+	 */
+	bool hasStatus(const FName object, const EStatus statusType, const FName towards = NAME_None) const;
+
+	bool isValid() const { return mTime != INVALID_SNAPSHOT_TIME; }
+
+	inline static constexpr int32 INVALID_SNAPSHOT_TIME = -1;
+
+	int32 mTime = INVALID_SNAPSHOT_TIME;
+	int32 mSFDBHistoryLength = 0; // see UCiFSocialFactsDataBase::getHistoryLength
+	TMap<ESocialNetworkType, TArray<FNetworkRow>> mNetworks; // includes the relationship network under RELATIONSHIP
+
+	bool mHasStatuses = false;
+	TMap<FName, TArray<FCiFStatusRecord>> mStatuses; // game object name -> its statuses
+};
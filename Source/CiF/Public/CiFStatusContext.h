@@ -33,6 +33,13 @@ public:
 	                                 const UCiFGameObject* y,
 	                                 const UCiFGameObject* z) override;
 
+	/* Same as isPredicateInChange, for a status context whose predicate's negation is @isNegated */
+	static bool isStatusPredicateInChange(const bool isNegated,
+	                                      const UCiFPredicate* pred,
+	                                      const UCiFGameObject* x,
+	                                      const UCiFGameObject* y,
+	                                      const UCiFGameObject* z);
+
 	static UCiFStatusContext* loadFromJson(const TSharedPtr<FJsonObject> json, const UObject* worldContextObject);
 
 public:
@@ -7,7 +7,9 @@
 #include "CiFTrigger.generated.h"
 
 class UCiFGameObject;
+class UCiFRule;
 class UCiFTriggerContext;
+struct FSFDBLabel;
 /**
  * The Trigger class consists of conditional rules that look over the recent
  * social state and perform social change based on evaluation of the conditions.
@@ -49,6 +51,13 @@ public:
 	 */
 	UCiFTriggerContext* makeTriggerContext(const int32 time, UCiFGameObject* x, UCiFGameObject* y = nullptr, UCiFGameObject* z = nullptr) const;
 
+	/* Makes the SFDB labels of the SFDB label predicates in @change for the characters bound to x, y and z */
+	static void makeSFDBLabels(const UCiFRule* change,
+	                           const UCiFGameObject* x,
+	                           const UCiFGameObject* y,
+	                           const UCiFGameObject* z,
+	                           TArray<FSFDBLabel>& outLabels);
+
 	static UCiFTrigger* loadFromJson(const TSharedPtr<FJsonObject> json, const UObject* worldContextObject);
 	
 public:
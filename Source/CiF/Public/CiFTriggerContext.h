@@ -43,6 +43,13 @@ public:
 	                                 const UCiFGameObject* y,
 	                                 const UCiFGameObject* z) override;
 
+	/* Same as isPredicateInChange, for a trigger context whose change rule is @change */
+	static bool isPredicateInChangeRule(const UCiFRule* change,
+	                                    const UCiFPredicate* pred,
+	                                    const UCiFGameObject* x,
+	                                    const UCiFGameObject* y,
+	                                    const UCiFGameObject* z);
+
 	/**
 	 * This one is used with numTimesUniquelyTrue sfdb label predicates
 	 * 
@@ -101,11 +108,11 @@ private:
 	 * and tertiary character variables match the character names from the non-context
 	 * character variables x,y, and z respectively.
 	 */
-	bool doPredicateRoleMatchCharacterVariables(UCiFPredicate* predInChange,
-	                                            UCiFGameObject* c1,
-	                                            UCiFGameObject* c2,
-	                                            UCiFGameObject* c3,
-	                                            UCiFPredicate* predInEvalRule = nullptr) const;
+	static bool doPredicateRoleMatchCharacterVariables(UCiFPredicate* predInChange,
+	                                                   UCiFGameObject* c1,
+	                                                   UCiFGameObject* c2,
+	                                                   UCiFGameObject* c3,
+	                                                   UCiFPredicate* predInEvalRule = nullptr);
 
 	/**
 	 * Determines if the character variable binding between the context and the predicate's
@@ -119,13 +126,13 @@ private:
 	 * character variable matches the character names from the non-context
 	 * character variables, x,y, and z.
 	 */
-	bool doesPredicateRoleMatch(UCiFPredicate* predInEvalRule,
-	                            const FName roleInEval,
-	                            UCiFPredicate* predInChange,
-	                            const FName roleInChange,
-	                            UCiFGameObject* x,
-	                            UCiFGameObject* y,
-	                            UCiFGameObject* z) const;
+	static bool doesPredicateRoleMatch(UCiFPredicate* predInEvalRule,
+	                                   const FName roleInEval,
+	                                   UCiFPredicate* predInChange,
+	                                   const FName roleInChange,
+	                                   UCiFGameObject* x,
+	                                   UCiFGameObject* y,
+	                                   UCiFGameObject* z);
 
 public:
 	FName mInitiatorName; // name of the initiator of this social exchange
@@ -137,6 +144,9 @@ public:
 	UPROPERTY()
 	UCiFRule* mStatusTimeoutChange; // is this a trigger that occurs from a status ending?
 
+	UPROPERTY()
+	UCiFRule* mChange = nullptr; // the change rule of the trigger that made this context, see getChange
+
 	// todo - why is there many labels associated with this context entry? i need an example to understand what does it mean
 	TArray<FSFDBLabel> mSFDBLabels; // the SFDB labels associated with this context entry
 
@@ -63,3 +63,13 @@ bool UReadWriteFiles::writeJson(const FString& filePath, TSharedPtr<FJsonObject>
 	
 	return true;
 }
+
+bool UReadWriteFiles::appendBytesToFile(const FString& filePath, const TArray<uint8>& data)
+{
+	if (!FFileHelper::SaveArrayToFile(data, *filePath, &IFileManager::Get(), FILEWRITE_Append)) {
+		UE_LOG(LogTemp, Error, TEXT("Couldn't append to the file at %s. Check path validity and write access"), *filePath);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,142 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "WriteAheadLog.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/FileHelper.h"
+
+FWriteAheadLog::~FWriteAheadLog()
+{
+	close();
+}
+
+bool FWriteAheadLog::open(const FString& filePath, const TArray<uint8>& checkpoint)
+{
+	close();
+	mFilePath = filePath;
+	return this->checkpoint(checkpoint);
+}
+
+void FWriteAheadLog::close()
+{
+	mFile.Reset();
+	mPending.Reset();
+}
+
+void FWriteAheadLog::append(const TArray<uint8>& record)
+{
+	appendFrame(mPending, EFrameType::RECORD, record);
+}
+
+bool FWriteAheadLog::commit()
+{
+	if (mPending.IsEmpty()) {
+		return true;
+	}
+	if (!mFile) {
+		UE_LOG(LogTemp, Error, TEXT("Committing to a write-ahead log that isn't open"));
+		return false;
+	}
+
+	const bool isWritten = mFile->Write(mPending.GetData(), mPending.Num()) && mFile->Flush(true);
+	mPending.Reset();
+	if (!isWritten) {
+		UE_LOG(LogTemp, Error, TEXT("Couldn't write to the write-ahead log at %s. Check disk space and write access"), *mFilePath);
+	}
+	return isWritten;
+}
+
+bool FWriteAheadLog::checkpoint(const TArray<uint8>& checkpoint)
+{
+	close();
+	auto& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	TArray<uint8> data;
+	data.Append(reinterpret_cast<const uint8*>(&LOG_MAGIC), sizeof(LOG_MAGIC));
+	data.Append(reinterpret_cast<const uint8*>(&LOG_VERSION), sizeof(LOG_VERSION));
+	appendFrame(data, EFrameType::CHECKPOINT, checkpoint);
+
+	// the new log is complete on disk before it replaces the old one
+	const FString tempPath = mFilePath + TEXT(".tmp");
+	{
+		const TUniquePtr<IFileHandle> tempFile(platformFile.OpenWrite(*tempPath));
+		if (!tempFile || !tempFile->Write(data.GetData(), data.Num()) || !tempFile->Flush(true)) {
+			UE_LOG(LogTemp, Error, TEXT("Couldn't write the write-ahead log checkpoint to %s"), *tempPath);
+			return false;
+		}
+	}
+	if (!IFileManager::Get().Move(*mFilePath, *tempPath, true)) {
+		UE_LOG(LogTemp, Error, TEXT("Couldn't replace the write-ahead log at %s with its checkpoint"), *mFilePath);
+		return false;
+	}
+
+	mFile.Reset(platformFile.OpenWrite(*mFilePath, true));
+	if (!mFile) {
+		UE_LOG(LogTemp, Error, TEXT("Couldn't open the write-ahead log at %s for appending"), *mFilePath);
+		return false;
+	}
+	return true;
+}
+
+bool FWriteAheadLog::read(const FString& filePath, TArray<uint8>& outCheckpoint, TArray<TArray<uint8>>& outRecords)
+{
+	TArray<uint8> data;
+	if (!FFileHelper::LoadFileToArray(data, *filePath)) {
+		UE_LOG(LogTemp, Error, TEXT("Couldn't read the write-ahead log at %s"), *filePath);
+		return false;
+	}
+
+	constexpr int64 fileHeaderSize = 2 * sizeof(uint32);
+	constexpr int64 frameHeaderSize = 3 * sizeof(uint32);
+	if (data.Num() < fileHeaderSize ||
+		reinterpret_cast<const uint32*>(data.GetData())[0] != LOG_MAGIC ||
+		reinterpret_cast<const uint32*>(data.GetData())[1] != LOG_VERSION) {
+		UE_LOG(LogTemp, Error, TEXT("%s isn't a write-ahead log of a supported version"), *filePath);
+		return false;
+	}
+
+	bool hasCheckpoint = false;
+	int64 offset = fileHeaderSize;
+	while (offset + frameHeaderSize <= data.Num()) {
+		uint32 header[3];
+		FMemory::Memcpy(header, data.GetData() + offset, frameHeaderSize);
+		const uint32 size = header[0];
+		const uint32 crc = header[1];
+		const auto type = static_cast<EFrameType>(header[2]);
+
+		const uint8* payload = data.GetData() + offset + frameHeaderSize;
+		if (offset + frameHeaderSize + size > data.Num() || FCrc::MemCrc32(payload, size) != crc) {
+			break;
+		}
+		// the checkpoint is always the first frame and only the first
+		if (type != (hasCheckpoint ? EFrameType::RECORD : EFrameType::CHECKPOINT)) {
+			break;
+		}
+
+		if (type == EFrameType::CHECKPOINT) {
+			outCheckpoint = TArray<uint8>(payload, size);
+			hasCheckpoint = true;
+		}
+		else {
+			outRecords.Emplace(payload, size);
+		}
+		offset += frameHeaderSize + size;
+	}
+
+	if (offset < data.Num()) {
+		UE_LOG(LogTemp, Warning, TEXT("Discarded %lld bytes of torn or corrupt records at the end of the write-ahead log at %s"),
+		       data.Num() - offset, *filePath);
+	}
+	if (!hasCheckpoint) {
+		UE_LOG(LogTemp, Error, TEXT("The write-ahead log at %s has no valid checkpoint"), *filePath);
+	}
+	return hasCheckpoint;
+}
+
+void FWriteAheadLog::appendFrame(TArray<uint8>& buffer, const EFrameType type, const TArray<uint8>& payload)
+{
+	const uint32 header[3] = {static_cast<uint32>(payload.Num()), FCrc::MemCrc32(payload.GetData(), payload.Num()), static_cast<uint32>(type)};
+	buffer.Append(reinterpret_cast<const uint8*>(header), sizeof(header));
+	buffer.Append(payload);
+}
@@ -50,4 +50,12 @@ public:
 	 * @return true if written successfully
 	 */
 	static bool writeJson(const FString& filePath, TSharedPtr<FJsonObject> jsonObject);
+
+	/**
+	 * Appends raw bytes to the end of a file, creating it if it doesn't exist
+	 * @param filePath file path of the binary file
+	 * @param data the bytes to append
+	 * @return true if written successfully
+	 */
+	static bool appendBytesToFile(const FString& filePath, const TArray<uint8>& data);
 };
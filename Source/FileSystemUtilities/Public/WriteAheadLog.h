@@ -0,0 +1,74 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class IFileHandle;
+
+/**
+ * Append-only binary log of records that starts with a checkpoint.
+ * Appended records are buffered and written with a single sequential write when committed, flushed all the way to disk.
+ * A checkpoint replaces the log with a new one that holds only the checkpoint. It is written to a temporary file that is
+ * then moved over the log, so a crash leaves either the old log or the new one.
+ * Every frame has a CRC, and reading stops at the first torn or corrupt frame - the tail a crash interrupted.
+ */
+class FILESYSTEMUTILITIES_API FWriteAheadLog
+{
+public:
+	~FWriteAheadLog();
+
+	/**
+	 * Starts a new log at the file path, replacing any log there
+	 * @param checkpoint The data the records that will be appended apply to
+	 * @return true if the log was written successfully
+	 */
+	bool open(const FString& filePath, const TArray<uint8>& checkpoint);
+
+	/* Closes the log, records that weren't committed are dropped */
+	void close();
+
+	bool isOpen() const { return mFile.IsValid(); }
+
+	/* Buffers a record, it is written by the next commit */
+	void append(const TArray<uint8>& record);
+
+	bool hasPendingRecords() const { return !mPending.IsEmpty(); }
+
+	/**
+	 * Writes the buffered records to the end of the log and flushes it to disk
+	 * @return true if written successfully
+	 */
+	bool commit();
+
+	/**
+	 * Replaces the log with a new one that starts with @checkpoint. Buffered records are dropped, the checkpoint already includes them
+	 * @return true if written successfully, otherwise the log is closed
+	 */
+	bool checkpoint(const TArray<uint8>& checkpoint);
+
+	/**
+	 * Reads a log written by this class
+	 * @param outCheckpoint The checkpoint the log starts with
+	 * @param outRecords The records that were committed after the checkpoint, up to the first torn or corrupt one
+	 * @return true if the log has a valid checkpoint
+	 */
+	static bool read(const FString& filePath, TArray<uint8>& outCheckpoint, TArray<TArray<uint8>>& outRecords);
+
+	inline static constexpr uint32 LOG_MAGIC = 0x4C415743; // "CWAL"
+	inline static constexpr uint32 LOG_VERSION = 1;
+
+private:
+	enum class EFrameType : uint32
+	{
+		CHECKPOINT,
+		RECORD
+	};
+
+	/* Frames are a header of the payload size, its CRC and the frame type, followed by the payload */
+	static void appendFrame(TArray<uint8>& buffer, const EFrameType type, const TArray<uint8>& payload);
+
+	FString mFilePath;
+	TUniquePtr<IFileHandle> mFile;
+	TArray<uint8> mPending; // frames of the records appended since the last commit
+};